@@ -114,16 +114,20 @@ paddr_t ram_getfirstfree(void);
  * TLB shootdown bits.
  *
  * We'll take up to 16 invalidations before just flushing the whole TLB.
+ * Each request covers a range of pages of one address space; requests
+ * for adjacent or overlapping ranges are coalesced when queued.
  */
 
+struct addrspace;
+
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	struct addrspace *ts_as;	/* address space owning the mappings */
+	vaddr_t ts_start;		/* first page-aligned virtual address */
+	unsigned ts_npages;		/* number of pages in the range */
 };
 
 #define TLBSHOOTDOWN_MAX 16
+#define TLBSHOOTDOWN_ALL (TLBSHOOTDOWN_MAX+1)	/* c_numshootdown: flush all */
 
 
 #endif /* _MIPS_VM_H_ */
@@ -164,6 +164,18 @@ syscall(struct trapframe *tf)
                 break;
 #endif
 
+#if OPT_C1_PAG
+	    case SYS_sbrk:
+	        err = sys_sbrk((intptr_t)tf->tf_a0, &retval);
+                break;
+	    case SYS_mmap:
+	        err = sys_mmap(tf, &retval);
+                break;
+	    case SYS_munmap:
+	        err = sys_munmap((userptr_t)tf->tf_a0, (size_t)tf->tf_a1);
+                break;
+#endif
+
 #endif
 
 	    default:
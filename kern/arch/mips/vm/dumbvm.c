@@ -241,6 +241,21 @@ vm_tlbshootdown(const struct tlbshootdown *ts)
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
+void
+vm_tlbshootdown_all(void)
+{
+	panic("dumbvm tried to do tlb shootdown?!\n");
+}
+
+int
+vm_tlbshootdown_merge(struct tlbshootdown *dst,
+		      const struct tlbshootdown *src)
+{
+	(void)dst;
+	(void)src;
+	return 0;
+}
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
@@ -609,6 +624,21 @@ vm_tlbshootdown(const struct tlbshootdown *ts)
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
+void
+vm_tlbshootdown_all(void)
+{
+	panic("dumbvm tried to do tlb shootdown?!\n");
+}
+
+int
+vm_tlbshootdown_merge(struct tlbshootdown *dst,
+		      const struct tlbshootdown *src)
+{
+	(void)dst;
+	(void)src;
+	return 0;
+}
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
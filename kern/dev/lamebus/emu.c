@@ -845,13 +845,22 @@ emufs_namefile(struct vnode *v, struct uio *uio)
 
 /*
  * VOP_MMAP
+ *
+ * Any range of a regular file can be mapped: the VM system pages it in
+ * and out with emufs_read and emufs_write.
  */
 static
 int
-emufs_mmap(struct vnode *v)
+emufs_mmap(struct vnode *v, off_t offset, size_t len, int prot)
 {
 	(void)v;
-	return ENOSYS;
+	(void)len;
+	(void)prot;
+
+	if (offset < 0) {
+		return EINVAL;
+	}
+	return 0;
 }
 
 //////////////////////////////
@@ -1121,7 +1130,7 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_gettype = emufs_dir_gettype,
 	.vop_isseekable = emufs_isseekable,
 	.vop_fsync = emufs_void_op_isdir,
-	.vop_mmap = emufs_void_op_isdir,
+	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = emufs_truncate_isdir,
 	.vop_namefile = emufs_namefile,
 
@@ -232,14 +232,21 @@ sfs_fsync(struct vnode *v)
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). Any range of a regular file can be mapped; the VM
+ * system pages it in and out with sfs_read and sfs_write.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v, off_t offset, size_t len, int prot)
 {
 	(void)v;
-	return ENOSYS;
+	(void)len;
+	(void)prot;
+
+	if (offset < 0) {
+		return EINVAL;
+	}
+	return 0;
 }
 
 /*
@@ -41,6 +41,24 @@
 
 struct vnode;
 
+/*
+ * Cache software delle traduzioni (direct-mapped, indicizzata dal numero di
+ * pagina virtuale): vm_fault ricarica la TLB da qui senza percorrere la page
+ * table. Una voce e' valida solo se la sua generazione coincide con stlb_gen
+ * dell'address space, incrementata ad ogni eviction di una sua pagina.
+ */
+#define STLB_SIZE 64                                   // Voci per address space (potenza di 2)
+#define STLB_INDEX(va) (((va) >> 12) & (STLB_SIZE - 1)) // Voce associata alla pagina di va
+#define STLB_NO_VPN 0xffffffff                         // Voce vuota (non allineata a pagina)
+
+#define AS_MAXMMAP 16   // Regioni create con mmap presenti insieme in un address space
+
+struct stlb_entry {
+        vaddr_t vpn;            // Indirizzo virtuale della pagina
+        uint32_t elo;           // Valore EntryLo da scrivere nella TLB
+        unsigned int gen;       // Generazione dell'address space al momento del riempimento
+};
+
 
 /*
  * Address space - data structure associated with the virtual memory
@@ -65,6 +83,12 @@ struct addrspace {
         struct segment* code;   // suddivisione addrspace nei tre segmenti "code", "data" e lo stack
         struct segment* data;       
         struct segment* stack;
+        struct segment* heap;   // Heap del processo, da sbrk (vuoto finche' non viene caricato l'ELF)
+        struct segment* mmaps[AS_MAXMMAP]; // Regioni di file mappate con mmap (NULL: posto libero)
+
+        struct stlb_entry stlb[STLB_SIZE];  // Cache software delle traduzioni recenti
+        volatile unsigned int stlb_gen;     // Generazione corrente delle voci di stlb
+        unsigned int asid;                  // Generazione e ASID delle voci nella TLB (0: non assegnato)
 #endif
 };
 
@@ -131,6 +155,15 @@ int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 struct segment*   as_get_segment(struct addrspace *as, vaddr_t va);
+#if !OPT_DUMBVM
+struct segment*   as_grow_stack(struct addrspace *as, vaddr_t va);
+int               as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbreak);
+int               as_set_stack_limit(unsigned int npages);
+int               as_mmap(struct addrspace *as, struct vnode *v, size_t len, int prot,
+                          int flags, off_t offset, vaddr_t *addr);
+int               as_munmap(struct addrspace *as, vaddr_t addr, size_t len);
+void              as_munmap_all(struct addrspace *as);
+#endif
 
 
 /*
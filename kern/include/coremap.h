@@ -4,32 +4,92 @@
 #include <addrspace.h>
 #include <types.h>
 
+/**
+ * Numero di bucket per i run di frame liberi: il bucket b contiene i run
+ * di lunghezza compresa in [2^b, 2^(b+1)), l'ultimo anche tutti i run piu' lunghi.
+ * 18 bucket coprono i 512 MB indirizzabili tramite kseg0.
+ */
+#define COREMAP_FREE_BUCKETS 18
+
+/**
+ * Cache di frame liberi per CPU: capacita' e numero di frame spostati
+ * da/verso la free list globale ad ogni refill o svuotamento.
+ */
+#define FRAME_CACHE_SIZE  32
+#define FRAME_CACHE_BATCH 16
+
+/**
+ * Riserva di frame gia' azzerati, riempita dai CPU inattivi e usata per
+ * prima dai page fault su pagine da azzerare (stack, heap).
+ */
+#define ZERO_POOL_SIZE 32
+
+/**
+ * Voci della mappa inversa per frame della RAM: ogni mappatura di un frame
+ * oltre alla prima (fork, cache delle pagine di codice) ne occupa una. Se il
+ * pool e' esaurito la pagina non viene condivisa.
+ */
+#define COREMAP_RMAP_PER_FRAME 2
+
+/**
+ * Finestra del working set per WSClock, in unita' di tempo virtuale
+ * (ricariche TLB): una pagina non riferita da piu' di WSCLOCK_TAU unita'
+ * e' considerata fuori dal working set.
+ */
+#define WSCLOCK_TAU 512
+
 /**
  * Enum per rappresentare lo stato di una pagina fisica:
  * fixed: richiesto dal kernel (non liberabile).
- * free: pagina libera e disponibile per l'allocazione.
+ * free: pagina libera, inserita in un run della free list.
  * dirty: pagina richiesta da un programma utente.
- * clean: non ancora richiesta e gestita da `ram_stealmem`.
+ * busy: pagina utente in corso di swap-out; non va rimappata finche' non termina.
  */
 enum status_t {
     fixed,  // Pagine riservate per il kernel
     free,   // Pagine disponibili per l'uso
     dirty,  // Pagine assegnate a un programma utente
-    clean   // Pagine non allocate e disponibili da "rubare" (steal)
+    busy    // Pagine utente scelte come vittima, in scrittura sullo swap
 };
 
 /**
  * Struttura che rappresenta una singola entry nella coremap.
- * - as: puntatore allo spazio degli indirizzi associato a questa pagina.
+ * - as: spazio degli indirizzi della prima mappatura della pagina (proprietario).
  * - status: stato corrente della pagina (enum status_t).
- * - vaddr: indirizzo virtuale della pagina (in intervallo [0x80000000, 0x80000000 + ram_size]).
+ * - vaddr: indirizzo virtuale della pagina nel proprietario.
  * - alloc_size: dimensione dell'allocazione per le pagine contigue richieste.
+ * - next_free/prev_free: collegamenti del run libero nel suo bucket (solo sul primo frame del run).
+ * - free_len: lunghezza del run libero (valida solo sul primo e sull'ultimo frame del run).
+ * - referenced/last_use: informazioni di recency usate dalle politiche Clock e WSClock.
+ * - refcount: numero di mappature del frame; e' maggiore di 1 per le pagine
+ *   condivise in copy-on-write dopo una fork o tramite la cache delle pagine di
+ *   codice. Vale 0 per un frame appena allocato, non sostituibile finche' non
+ *   e' pubblicato (coremap_publish).
+ * - rmap: mappature oltre a quella del proprietario (mappa inversa), nel pool
+ *   di voci della coremap: l'eviction di un frame condiviso aggiorna le PTE di
+ *   tutte. Quando esce il proprietario la prima voce ne prende il posto.
+ * - modified: 1 se il contenuto del frame non ha una copia valida altrove. Con
+ *   modified a 0 la pagina ha una copia identica nello swap (swap_offset) o,
+ *   altrimenti, nell'eseguibile ELF: l'eviction la scarta senza scriverla.
+ * - swap_offset: slot dello swap associato alla pagina residente (-1 se
+ *   assente). Lo slot segue il frame anche quando e' condiviso dopo una fork,
+ *   viene riusato dall'eviction (condiviso tra le PTE di tutte le mappature)
+ *   e liberato con il frame.
  */
 struct coremap_entry {
     struct addrspace *as;    // Spazio degli indirizzi associato (se applicabile)
     enum status_t status;    // Stato della pagina nella coremap
     vaddr_t vaddr;           // Indirizzo virtuale della pagina
     unsigned int alloc_size; // Dimensione di allocazione (in pagine contigue)
+    int next_free;           // Run libero successivo nel bucket (-1 se assente)
+    int prev_free;           // Run libero precedente nel bucket (-1 se assente)
+    unsigned int free_len;   // Lunghezza del run libero (boundary tag)
+    unsigned int referenced; // Reference bit, impostato ad ogni ricarica TLB della pagina
+    unsigned int last_use;   // Tempo virtuale dell'ultimo riferimento osservato (WSClock)
+    unsigned int refcount;   // Page table che mappano il frame (copy-on-write)
+    unsigned int modified;   // Il contenuto va scritto nello swap prima di liberare il frame
+    off_t swap_offset;       // Slot dello swap della pagina (-1 se assente)
+    int rmap;                // Prima mappatura aggiuntiva nella mappa inversa (-1 se assente)
 };
 
 /**
@@ -58,10 +118,159 @@ void coremap_shutdown(void);
 paddr_t page_alloc(vaddr_t vaddr/*, int state*/); //Parametro state DA VALUTARE
 
 /**
- * Libera una pagina fisica, rendendola disponibile per nuove allocazioni.
+ * Come page_alloc, ma per l'address space as invece di quello corrente
+ * (usata da as_copy per le pagine del figlio).
+ */
+paddr_t page_alloc_as(struct addrspace *as, vaddr_t vaddr);
+
+/**
+ * Come page_alloc_as, ma non sceglie vittime: se non ci sono frame liberi
+ * restituisce 0. Usata per il read-ahead dello swap, che non deve causare eviction.
+ */
+paddr_t page_alloc_noevict(struct addrspace *as, vaddr_t vaddr);
+
+/**
+ * Come page_alloc, ma restituisce un frame gia' azzerato: preso dalla
+ * riserva se non e' vuota, altrimenti allocato e azzerato sul momento.
+ */
+paddr_t page_alloc_zeroed(vaddr_t vaddr);
+
+/**
+ * Azzera un frame libero e lo aggiunge alla riserva di frame azzerati.
+ * Chiamata dal ciclo idle di thread_switch, con le interruzioni abilitate.
+ * @return 1 se un frame e' stato azzerato, 0 se la riserva e' piena o
+ *         disattivata o non ci sono frame liberi.
+ */
+int coremap_zero_pool_fill(void);
+
+/**
+ * Attiva (enabled != 0) o disattiva le cache di frame per CPU; ritorna il
+ * valore precedente. Disattivandole le cache vengono svuotate e ogni
+ * allocazione e rilascio di una pagina passa dalla free list globale sotto
+ * freemem_lock (usato dal benchmark vm1 per misurare la free list).
+ */
+int coremap_frame_cache_set_enabled(int enabled);
+
+/**
+ * Attiva (enabled != 0) o disattiva la riserva per i page fault e per il
+ * ciclo idle; ritorna il valore precedente. I frame gia' nella riserva
+ * restano disponibili come frame liberi.
+ */
+int coremap_zero_pool_set_enabled(int enabled);
+
+/**
+ * Pagine azzerate richieste dai page fault servite dalla riserva (hits) o
+ * azzerate sul momento (misses).
+ */
+void coremap_zero_pool_stats(unsigned int *hits, unsigned int *misses);
+
+/**
+ * Rende sostituibile un frame appena allocato, dopo che il chiamante lo ha
+ * riempito e inserito nella page table. Fino ad allora il frame non puo' essere
+ * scelto come vittima.
+ * @param modified 1 se il contenuto non ha una copia nello swap o nell'ELF
+ *                 (pagine azzerate, copie copy-on-write).
+ * @param swap_offset Slot dello swap da cui la pagina e' stata letta, che
+ *                    passa dalla page table al frame (-1 se assente).
+ */
+void coremap_publish(paddr_t paddr, int modified, off_t swap_offset);
+
+/**
+ * Restituisce un frame allocato con page_alloc* e mai pubblicato, quando il
+ * chiamante rinuncia a inserirlo nella page table.
+ */
+void page_discard(paddr_t paddr);
+
+/**
+ * Indica se la pagina nel frame paddr e' stata modificata rispetto alla sua copia.
+ */
+int coremap_is_modified(paddr_t paddr);
+
+/**
+ * Slot dello swap con una copia della pagina nel frame paddr (-1 se assente).
+ */
+off_t coremap_get_swap_offset(paddr_t paddr);
+
+/**
+ * Rilascia la mappatura (as, va) di una pagina fisica utente: il frame torna
+ * disponibile per nuove allocazioni solo quando non e' piu' mappato da
+ * nessuna page table. Se il frame e' in corso di swap-out attende che
+ * l'eviction abbia aggiornato la PTE, senza rilasciare nulla.
  * @param paddr Indirizzo fisico della pagina da liberare.
+ * @param as, va Mappatura da rilasciare (page table e indirizzo della PTE).
+ */
+void page_free(paddr_t paddr, struct addrspace *as, vaddr_t va);
+
+/**
+ * Come page_free, ma senza attendere: rilascia la mappatura (as, va) solo se
+ * il frame non e' stato scelto come vittima nel frattempo e la mappatura c'e'
+ * ancora. Usata da vm_fault_cow dopo aver copiato un frame condiviso.
+ * @return 1 se la mappatura e' stata rilasciata, 0 altrimenti (la PTE e'
+ *         stata o sta per essere aggiornata da un'eviction).
+ */
+int coremap_unshare(paddr_t paddr, struct addrspace *as, vaddr_t va);
+
+/**
+ * Esito di coremap_share.
+ */
+#define COREMAP_SHARE_BUSY   0   // Frame in corso di swap-out o non ancora pubblicato
+#define COREMAP_SHARE_OK     1   // Mappatura aggiunta
+#define COREMAP_SHARE_NOMEM  2   // Pool della mappa inversa esaurito
+
+/**
+ * Aggiunge la mappatura (as, va) al frame utente paddr, condiviso in
+ * copy-on-write con un'altra page table (as_copy) o, per le pagine di codice,
+ * tramite la cache delle pagine (pagecache_lookup). L'eventuale slot dello
+ * swap resta al frame: finche' nessuno ci scrive ne e' ancora una copia valida.
+ * Il chiamante scrive prima la PTE di (as, va) e la azzera se la condivisione
+ * fallisce: un'eviction che vede la nuova mappatura trova la PTE da aggiornare.
+ * Con from != NULL il frame deve essere ancora mappato da (from, va), cosi'
+ * che un frame liberato e riusato dopo la lettura della PTE venga rifiutato.
+ * @return COREMAP_SHARE_OK; COREMAP_SHARE_BUSY se il frame e' in corso di
+ *         swap-out o non e' piu' di from (il chiamante deve attendere e
+ *         rileggere la page table) o non e' ancora pubblicato;
+ *         COREMAP_SHARE_NOMEM se la mappa inversa non ha voci libere (la
+ *         pagina va copiata o riletta).
+ */
+int coremap_share(paddr_t paddr, struct addrspace *from, struct addrspace *as, vaddr_t va);
+
+/**
+ * Esito di coremap_cow_claim.
+ */
+#define COREMAP_COW_SHARED 0   // Frame ancora condiviso: la pagina va copiata
+#define COREMAP_COW_OWNED  1   // as e' l'unico proprietario: basta renderla scrivibile
+#define COREMAP_COW_BUSY   2   // Frame in corso di swap-out: attendere e ripetere l'accesso
+
+/**
+ * Tenta di rendere as l'unico proprietario del frame paddr, mappato in va,
+ * per mapparlo in scrittura. Riesce se il frame non e' (piu') condiviso: in tal
+ * caso la pagina puo' essere resa scrivibile senza copiarla, e viene marcata
+ * come modificata. Un frame scelto come vittima non va ne' reso scrivibile
+ * ne' copiato: l'eviction sta per aggiornare la PTE.
+ * @return COREMAP_COW_OWNED, COREMAP_COW_SHARED o COREMAP_COW_BUSY.
+ */
+int coremap_cow_claim(paddr_t paddr, struct addrspace *as, vaddr_t va);
+
+/**
+ * Gestione dei frame in corso di swap-out: coremap_is_busy lo verifica senza
+ * attendere (anche con le interruzioni disabilitate), coremap_wait_busy
+ * sospende il thread finche' lo swap-out non e' terminato.
+ */
+int coremap_is_busy(paddr_t paddr);
+void coremap_wait_busy(paddr_t paddr);
+
+/**
+ * Numero (stimato) di frame liberi e numero totale di frame, usati dal
+ * demone di pageout per le soglie.
+ */
+unsigned int coremap_free_frames(void);
+unsigned int coremap_total_frames(void);
+
+/**
+ * Esegue lo swap-out in blocco di al massimo max frame utente (demone di pageout).
+ * @return Numero di frame liberati.
  */
-void page_free(paddr_t paddr);
+unsigned int coremap_pageout(unsigned int max);
 
 
 // Funzioni per l'allocazione e liberazione di pagine contigue per il kernel
@@ -81,4 +290,22 @@ vaddr_t alloc_kpages(unsigned long npages);
  */
 void free_kpages(vaddr_t addr);
 
+/**
+ * Segnala un riferimento alla pagina fisica paddr (chiamata da vm_fault ad ogni
+ * ricarica della TLB): imposta il reference bit usato dalle politiche Clock e WSClock.
+ * @param paddr Indirizzo fisico della pagina riferita.
+ */
+void coremap_set_referenced(paddr_t paddr);
+
+/**
+ * Restituisce il nome della politica di rimpiazzo selezionata a compile time.
+ */
+const char *coremap_policy_name(void);
+
+/**
+ * Stampa le statistiche della coremap: frame liberi, acquisizioni (e contese)
+ * del lock globale e hit/miss delle cache di frame per CPU.
+ */
+void coremap_print_statistics(void);
+
 #endif
\ No newline at end of file
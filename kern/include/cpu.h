@@ -82,10 +82,18 @@ struct cpu {
 	 * The contents of struct tlbshootdown are also machine-
 	 * dependent and might reasonably be either an address space
 	 * and vaddr pair, or a paddr, or something else.
+	 *
+	 * If the queue overflows, c_numshootdown is set to
+	 * TLBSHOOTDOWN_ALL and the whole TLB is flushed instead.
+	 * c_shootdown_req counts the requests queued so far and
+	 * c_shootdown_done the ones already carried out, so a sender
+	 * can wait for its request to complete.
 	 */
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	unsigned c_numshootdown;
+	unsigned c_shootdown_req;
+	volatile unsigned c_shootdown_done;
 	struct spinlock c_ipi_lock;
 
 	/*
@@ -155,6 +163,11 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * It returns a ticket that can be passed to ipi_tlbshootdown_wait.
+ * ipi_tlbshootdown_wait waits until the target has carried out the
+ * shootdown identified by the ticket (and everything queued before).
+ * ipi_tlbshootdown_broadcast sends a batch of shootdowns to all other
+ * CPUs and waits for all of them to complete.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -168,7 +181,11 @@ void cpu_halt(void);
 
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
-void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+unsigned ipi_tlbshootdown(struct cpu *target,
+			  const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_wait(struct cpu *target, unsigned ticket);
+void ipi_tlbshootdown_broadcast(const struct tlbshootdown *mappings,
+				unsigned n);
 
 void interprocessor_interrupt(void);
 
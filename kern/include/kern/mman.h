@@ -0,0 +1,19 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Constants for mmap(), shared between the kernel and userland.
+ */
+
+/* Page protections (prot argument) */
+#define PROT_NONE     0      /* Pages cannot be accessed */
+#define PROT_READ     1      /* Pages can be read */
+#define PROT_WRITE    2      /* Pages can be written */
+#define PROT_EXEC     4      /* Pages can be executed */
+
+/* Mapping type (flags argument); exactly one must be given */
+#define MAP_SHARED    1      /* Writes go back to the file */
+#define MAP_PRIVATE   2      /* Writes stay private to the process */
+
+
+#endif /* _KERN_MMAN_H_ */
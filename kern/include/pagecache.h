@@ -0,0 +1,51 @@
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+#include <types.h>
+#include <pt.h>
+
+struct vnode;
+struct addrspace;
+
+/**
+ * Cache delle pagine di codice: associa a (vnode, offset nel file) il frame
+ * che contiene la pagina, cosi' che i processi che eseguono lo stesso
+ * eseguibile mappino lo stesso frame invece di rileggerlo dall'ELF. Il frame
+ * e' condiviso tramite la mappa inversa della coremap (coremap_share), come
+ * le pagine copy-on-write, e resta nella cache finche' qualche page table lo
+ * mappa: viene rimosso quando e' liberato o scelto come vittima. Un frame di
+ * codice condiviso e' sostituibile: l'eviction azzera la PTE di ogni processo
+ * che lo mappa (la pagina e' pulita e viene riletta dall'ELF o di nuovo
+ * dalla cache) e lo toglie dalla cache.
+ */
+#define PAGECACHE_BUCKETS 256   // Bucket della tabella hash (potenza di 2)
+
+/**
+ * Alloca la tabella, una voce per frame della RAM (chiamata da vm_bootstrap,
+ * dopo coremap_init).
+ */
+void pagecache_init(void);
+
+/**
+ * Cerca la pagina offset del file vn e, se c'e', la mappa nella PTE pte di
+ * (as, va), aggiungendo la mappatura al suo frame. La PTE e' scritta prima
+ * della condivisione (vedi coremap_share) e resta a 0 se la pagina non c'e'.
+ * @return L'indirizzo fisico del frame, 0 se la pagina non e' nella cache o
+ *         il frame e' in corso di swap-out o non ancora pubblicato.
+ */
+paddr_t pagecache_lookup(struct vnode *vn, off_t offset, struct addrspace *as, vaddr_t va, pte_t *pte);
+
+/**
+ * Inserisce il frame pa, appena letto dall'ELF e non ancora pubblicato
+ * (coremap_publish), come pagina offset del file vn.
+ * @return 1 se inserito, 0 se la pagina e' gia' nella cache con un altro frame.
+ */
+int pagecache_insert(struct vnode *vn, off_t offset, paddr_t pa);
+
+/**
+ * Rimuove il frame pa dalla cache, se presente: chiamata quando il frame
+ * perde l'ultimo riferimento o diventa vittima, prima che venga riusato.
+ */
+void pagecache_remove(paddr_t pa);
+
+#endif /* _PAGECACHE_H_ */
@@ -0,0 +1,30 @@
+#ifndef _PAGEOUT_H_
+#define _PAGEOUT_H_
+
+#include <types.h>
+
+/**
+ * Demone di pageout: un thread del kernel che mantiene una riserva di frame
+ * liberi, cosi' che i page fault trovino quasi sempre un frame pronto senza
+ * dover attendere la scrittura di una vittima sullo swap.
+ *
+ * Il demone si risveglia quando i frame liberi scendono sotto la soglia bassa
+ * (PAGEOUT_LOW_DIV-esimo della RAM) ed esegue swap-out in blocchi di
+ * PAGEOUT_BATCH pagine finche' non risale sopra la soglia alta (il doppio).
+ */
+#define PAGEOUT_LOW_DIV  32   // Soglia bassa: 1/32 dei frame della RAM
+#define PAGEOUT_LOW_MIN  4    // Soglia bassa minima, in frame
+#define PAGEOUT_BATCH    8    // Pagine scritte sullo swap ad ogni giro
+
+/**
+ * Calcola le soglie e avvia il thread del demone (chiamata da vm_bootstrap).
+ */
+void pageout_bootstrap(void);
+
+/**
+ * Segnala al demone il numero corrente di frame liberi: se e' sotto la soglia
+ * bassa e il demone e' inattivo, lo risveglia. Economica quando non serve.
+ */
+void pageout_notify(unsigned int nfree);
+
+#endif /* _PAGEOUT_H_ */
@@ -3,7 +3,7 @@
 
 /* Costanti per la gestione delle page table */
 #define SIZE_PT_OUTER 1024         // Numero di entry nella outer table
-#define SIZE_PT_INNER 1024         // Numero di entry nella inner table
+#define SIZE_PT_INNER 1024         // Numero di entry nella inner table (una pagina di PTE)
 #define PFN_NOT_USED 0x00000000    // Indica che una pagina non è utilizzata
 
 /* Maschere per estrarre i vari campi da un indirizzo virtuale */
@@ -11,33 +11,50 @@
 #define P_IN_MASK 0x003FF000       // Maschera per il livello inner della page table
 #define D_MASK 0x00000FFF          // Maschera per il displacement (offset interno alla pagina)
 
-/* Strutture dati per la gestione della page table */
-
-/**
- * Entry della inner table (livello 2).
+/*
+ * Formato di una PTE (32 bit):
+ *  - bit 31..12: numero del frame fisico (PTE_PRESENT) o dello slot dello
+ *    swap (PTE_SWAPPED) che contiene la pagina;
+ *  - bit 2..0: stato della pagina.
+ * Una PTE a 0 indica una pagina mai caricata (o scartata senza copia nello
+ * swap): al prossimo fault viene azzerata o riletta dall'ELF. Una pagina
+ * trovata piena di zeri al momento dell'eviction (PTE_ZERO) non occupa ne'
+ * un frame ne' uno slot: in lettura viene mappato il frame di zeri condiviso
+ * del kernel, in scrittura riceve un frame azzerato. Lo slot di una
+ * pagina residente e pulita e' registrato nella coremap, insieme al frame.
+ * Dopo una fork lo stesso slot puo' comparire in piu' page table: ognuna ne
+ * possiede un riferimento (swap_share, swap_free).
+ * I permessi restano quelli del segmento (struct segment).
  */
-struct pt_inner_entry {
-    unsigned int valid;             // Indica se la pagina è valida (1: valida, 0: non valida)
-    paddr_t pfn;                    // Physical Frame Number (numero di frame fisico)
-    off_t swap_offset;              // off_t è un tipo di dato che rappresenta un offset in un file
-                                    // Indica l'offset nel file di swap in cui è stata salvata la pagina
-};
+typedef uint32_t pte_t;
 
-/**
- * Entry della outer table (livello 1).
- */
-struct pt_outer_entry {
-    unsigned int valid;               // Indica se l'inner table associata è valida
-    unsigned int size;                // Dimensione dell'inner table
-    struct pt_inner_entry* pages;     // Puntatore all'inner table (array di entry)
-};
+#define PTE_PRESENT  0x00000001    // La pagina e' in memoria, nel frame indicato
+#define PTE_SWAPPED  0x00000002    // La pagina e' nello swap, nello slot indicato
+#define PTE_ZERO     0x00000004    // La pagina contiene solo zeri: nessun frame ne' slot
+#define PTE_NUMBER   0xFFFFF000    // Numero del frame o dello slot (gia' moltiplicato per PAGE_SIZE)
+
+/* Lettura dello stato da una PTE (valore letto tramite l'handle di pt_walk) */
+#define PTE_GET_PA(pte) \
+    (((pte) & PTE_PRESENT) ? (paddr_t)((pte) & PTE_NUMBER) : PFN_NOT_USED)
+#define PTE_GET_OFFSET(pte) \
+    ((((pte) & (PTE_PRESENT | PTE_SWAPPED)) == PTE_SWAPPED) ? (off_t)((pte) & PTE_NUMBER) : -1)
+#define PTE_IS_ZERO(pte) ((pte) == PTE_ZERO)
+
+struct addrspace;
+
+/* Strutture dati per la gestione della page table */
 
 /**
- * Struttura principale della page table (outer table).
+ * Struttura principale della page table (outer table): i puntatori alle inner
+ * table occupano esattamente una pagina, come ognuna delle inner table, ed
+ * entrambe vengono allocate direttamente dalla coremap. La bitmap populated
+ * indica le inner table allocate, cosi' che distruzione e copia non debbano
+ * scorrere tutte le SIZE_PT_OUTER entry.
  */
 struct pt_directory {
-    unsigned int size;                // Dimensione della outer table (numero di entry)
-    struct pt_outer_entry* pages;     // Puntatore alla outer table (array di entry)
+    struct addrspace *as;                      // Address space proprietario (mappature nella coremap)
+    pte_t **tables;                            // Inner table (NULL se non ancora allocata)
+    uint32_t populated[SIZE_PT_OUTER / 32];    // Bitmap delle inner table allocate
 };
 
 /* Dichiarazioni delle funzioni di gestione della page table */
@@ -45,29 +62,86 @@ struct pt_directory {
 /**
  * Crea una nuova page table a due livelli.
  * Inizialmente tutte le entry dell'outer table puntano a NULL.
+ * @param as Address space a cui appartiene: le pagine rilasciate dalla page
+ *           table sono mappature (as, va) nella coremap.
  * @return Puntatore alla nuova struttura di page table.
  */
-struct pt_directory* pt_create(void);
+struct pt_directory* pt_create(struct addrspace *as);
 
 /**
- * Distrugge una page table a due livelli, liberando tutta la memoria associata.
+ * Distrugge una page table a due livelli, liberando la directory e le inner
+ * table allocate. Le pagine vanno prima rilasciate con pt_destroy_range.
  * @param pt Puntatore alla struttura di page table da distruggere.
  */
 void pt_destroy(struct pt_directory* pt);
 
+/**
+ * Rilascia i frame e gli slot dello swap delle pagine in [start, end),
+ * visitando solo le inner table allocate; le inner table restano allocate.
+ * @param pt Puntatore alla page table.
+ * @param start Primo indirizzo dell'intervallo (allineato alla pagina).
+ * @param end Fine dell'intervallo, esclusa (allineata alla pagina).
+ */
+void pt_destroy_range(struct pt_directory* pt, vaddr_t start, vaddr_t end);
+
+/**
+ * Rimuove le pagine in [start, end) e libera le inner table rimaste vuote.
+ * Le voci della TLB e della cache software vanno invalidate dal chiamante.
+ * @param pt Puntatore alla page table.
+ * @param start Primo indirizzo dell'intervallo (allineato alla pagina).
+ * @param end Fine dell'intervallo, esclusa (allineata alla pagina).
+ */
+void pt_unmap(struct pt_directory* pt, vaddr_t start, vaddr_t end);
+
+/**
+ * Duplica la page table src nella page table vuota dst per una fork:
+ * le pagine residenti vengono condivise in copy-on-write, quelle nello swap
+ * condividono lo slot e vengono lette dal figlio solo al primo accesso.
+ * @return 0, ENOMEM se manca la memoria per le inner table di dst.
+ */
+int pt_copy(struct pt_directory *src, struct pt_directory *dst, struct addrspace *dst_as);
+
 /**
  * Definisce una nuova inner table per una specifica entry della outer table.
  * Viene allocata una nuova inner table e inizializzata con valori di default.
  * @param pt Puntatore alla page table.
  * @param va Indirizzo virtuale che richiede una nuova inner table.
+ * @return 0, ENOMEM se non c'e' memoria per la tabella.
+ */
+int pt_define_inner(struct pt_directory* pt, vaddr_t va);
+
+
+/**
+ * Percorre la page table una sola volta e restituisce il puntatore alla PTE
+ * di va, da leggere con PTE_GET_PA/PTE_GET_OFFSET e aggiornare con
+ * pte_set_pa/pte_set_offset. Con create alloca la inner table se manca,
+ * altrimenti in quel caso restituisce NULL. L'handle resta valido finche'
+ * la page table non viene distrutta o pt_unmap non rimuove l'intervallo che
+ * contiene va, liberando la inner table rimasta vuota: gli handle non vanno
+ * conservati attraverso una riduzione dell'heap o una munmap.
+ * @param pt Puntatore alla page table.
+ * @param va Indirizzo virtuale.
+ * @param create Se diverso da 0, alloca la inner table mancante.
+ * @return Puntatore alla PTE, NULL se la inner table non esiste e create e' 0.
  */
-void pt_define_inner(struct pt_directory* pt, vaddr_t va);
+pte_t *pt_walk(struct pt_directory* pt, vaddr_t va, int create);
 
 /**
-  * Distrugge una inner table e libera la memoria associata.
-  */
-void pt_destroy_inner(struct pt_outer_entry pt_inner);
+ * Aggiorna la PTE (handle di pt_walk): la pagina e' residente nel frame pa.
+ */
+void pte_set_pa(pte_t *pte, paddr_t pa);
 
+/**
+ * Aggiorna la PTE (handle di pt_walk): la pagina e' nello slot offset dello
+ * swap, oppure (offset -1) non ha copia nello swap.
+ */
+void pte_set_offset(pte_t *pte, off_t offset);
+
+/**
+ * Aggiorna la PTE (handle di pt_walk): la pagina contiene solo zeri e non ha
+ * ne' un frame ne' uno slot dello swap.
+ */
+void pte_set_zero(pte_t *pte);
 
 /**
  * Recupera l'indirizzo fisico corrispondente a un indirizzo virtuale.
@@ -88,23 +162,33 @@ int pt_get_pa(struct pt_directory* pt, vaddr_t va);
 void pt_set_pa(struct pt_directory* pt, vaddr_t va, paddr_t pa);
 
 /**
- * Recupera lo stato di una pagina in una page table.
- * Controlla se la pagina è swappata su disco, valida o non valida.
+ * Recupera l'offset nello swap di una pagina non residente.
  *
  * @param pt La page table in cui cercare.
  * @param va L'indirizzo virtuale della pagina.
+ * @return Offset dello slot, -1 se la pagina e' residente o non ha copia nello swap.
  */
 off_t pt_get_offset(struct pt_directory* pt, vaddr_t va);
 
 /**
- * Imposta l'offset di una pagina in una page table.
- * Permette di aggiornare il campo swapped_out per indicare se la pagina è swappata o meno.
+ * Segna la pagina come non piu' residente: la sua copia si trova nello swap
+ * all'offset indicato, oppure (offset -1) non ha copia nello swap e al
+ * prossimo fault verra' riletta dall'ELF.
  *
  * @param pt La page table in cui aggiornare lo stato.
  * @param va L'indirizzo virtuale della pagina.
- * @param offset offset da impostare per la pagina della page table
+ * @param offset Offset dello slot nello swap, -1 se assente.
  */
 void pt_set_offset(struct pt_directory* pt, vaddr_t va, off_t offset);
 
+/**
+ * Segna la pagina come non piu' residente e piena di zeri: al prossimo fault
+ * non viene letta ne' dallo swap ne' dall'ELF.
+ *
+ * @param pt La page table in cui aggiornare lo stato.
+ * @param va L'indirizzo virtuale della pagina.
+ */
+void pt_set_zero(struct pt_directory* pt, vaddr_t va);
+
 
 #endif /* PT_H */
@@ -5,6 +5,9 @@
 #include <pt.h>
 #include <addrspace.h>
 
+#define SEG_FAULTAROUND      4   // Pagine lette dall'ELF dopo quella del fault (predefinito)
+#define SEG_FAULTAROUND_MAX  16  // Massima finestra di fault-around
+
 struct segment {
     uint32_t		p_type;
 	uint32_t		p_offset;
@@ -13,6 +16,7 @@ struct segment {
 	uint32_t		p_memsz;
 	uint32_t		p_permission;
 	struct vnode	*vnode;
+	uint32_t		p_mapflags;	// MAP_SHARED o MAP_PRIVATE per le regioni di mmap, 0 altrimenti
 };
 
 struct segment* seg_create(void);
@@ -31,6 +35,11 @@ int seg_define(struct segment* seg, uint32_t p_type, uint32_t p_offset, uint32_t
 void seg_destroy(struct segment*);
 int seg_define_stack(struct segment*);
 int seg_load_page(struct segment* seg, vaddr_t va, paddr_t pa);
+int seg_load_pages(struct segment* seg, vaddr_t va, const paddr_t *pas, unsigned int n); // Carica n pagine con una sola lettura
+unsigned int seg_faultaround_window(struct segment* seg, vaddr_t va); // Pagine da leggere in anticipo dopo va
+int seg_set_faultaround(unsigned int npages); // Imposta la finestra di fault-around (comando elfra)
+unsigned int seg_get_faultaround(void);
+int seg_text_key(struct segment* seg, vaddr_t va, off_t *key); // Chiave della pagina di codice va nella cache delle pagine
 int seg_copy(struct segment *old, struct segment **ret);
 void zero(paddr_t paddr, size_t n);
 
@@ -12,7 +12,17 @@
 #define STATISTICS_ELF_FILE_READ          7  // Lettura di un file ELF (Executable and Linkable Format)
 #define STATISTICS_SWAP_FILE_READ         8  // Lettura da un file di swap
 #define STATISTICS_SWAP_FILE_WRITE        9  // Scrittura su un file di swap
-#define N_STATS                           10 // Numero totale delle statistiche
+#define STATISTICS_COW_FAULT              10 // Copia di una pagina condivisa in copy-on-write
+#define STATISTICS_CLEAN_EVICT            11 // Eviction di una pagina pulita, senza scrittura sullo swap
+#define STATISTICS_SWAP_READAHEAD         12 // Pagina letta in anticipo dallo swap insieme a quella del fault
+#define STATISTICS_STLB_HIT               13 // Ricarica TLB servita dalla cache software, senza page table
+#define STATISTICS_ELF_FAULTAROUND        14 // Pagina letta dall'ELF insieme a quella del fault (fault-around)
+#define STATISTICS_TEXT_SHARED            15 // Pagina di codice trovata in memoria per un altro processo (cache delle pagine)
+#define STATISTICS_ZERO_EVICT             16 // Eviction di una pagina di soli zeri, senza scrittura ne' slot nello swap
+#define STATISTICS_ZSWAP_STORE            17 // Pagina compressa nella cache in memoria invece di essere scritta su disco
+#define STATISTICS_ZSWAP_HIT              18 // Page fault risolto decomprimendo la pagina dalla cache dello swap
+#define STATISTICS_ZSWAP_BYTES            19 // Byte occupati in totale dalle pagine compresse (rapporto di compressione)
+#define N_STATS                           20 // Numero totale delle statistiche
 
 /* Funzione per inizializzare tutte le statistiche */
 void init_statistics(void);
@@ -20,7 +30,20 @@ void init_statistics(void);
 /* Funzione per incrementare il contatore di una statistica specifica */
 void increment_statistics(unsigned int stat);
 
+/* Funzione per aggiungere n al contatore di una statistica specifica */
+void add_statistics(unsigned int stat, unsigned int n);
+
+/* Funzione per incrementare insieme, con un solo acquisto dello spinlock, i contatori in mask */
+#define STATISTICS_BIT(stat) (1U << (stat))
+void increment_statistics_mask(unsigned int mask);
+
 /* Funzione per stampare tutte le statistiche */
 void print_all_statistics(void);
 
+/* Funzione per copiare in snapshot il valore corrente di tutti i contatori */
+void get_statistics(unsigned int snapshot[N_STATS]);
+
+/* Funzione per stampare l'incremento dei contatori rispetto a uno snapshot precedente */
+void print_statistics_delta(const unsigned int snapshot[N_STATS]);
+
 #endif /* STATISTICS_H */
@@ -3,23 +3,30 @@
 
 #include <types.h>
 
-#define FILE_SIZE 9*1024*1024 //9MB
-#define NUM_PAGES FILE_SIZE / PAGE_SIZE
-
-struct swap_page {
-    // Inizializzazione della swap page
-    paddr_t ppadd;
-    vaddr_t pvadd;       // Usato per lo swap in
-    off_t swap_offset ;
-    int free;               // 1: libera, 0: occupata
-
-
-};
+#define SWAP_INITIAL_SIZE 9*1024*1024   // Dimensione iniziale dello swapfile: 9MB
+#define SWAP_MAX_SIZE 128*1024*1024     // Dimensione massima predefinita (comando "swap" del menu)
+#define SWAP_GROW_PAGES 256             // Crescita minima dello swapfile, in slot (multiplo di 8)
+#define SWAP_BATCH_MAX 16               // Pagine al massimo in un singolo trasferimento (swap_out_batch, swap_in_cluster)
+#define SWAP_READAHEAD 4                // Read-ahead predefinito allo swap-in, in pagine (comando "swapra" del menu)
+#define SWAP_DEVNAME_MAX 16             // Lunghezza massima del nome del disco di swap (es. "lhd1")
+#define SWAP_SECTOR_SIZE 512            // Settore dei dischi lhd: gli slot devono esserne multipli
 
 void swapfile_init(void);
+int swap_set_max_size(unsigned int mb); // Imposta la dimensione massima in MB
+int swap_set_device(const char *name); // Sceglie il supporto: disco grezzo "lhdN" o "file"
+const char *swap_device_name(void);
 int swap_out(paddr_t ppaddr, vaddr_t pvaddr);
+void swap_out_batch(const paddr_t *ppaddrs, unsigned int n, off_t *offsets); // Swap-out di n pagine
 int swap_in(paddr_t ppadd, off_t offset);
+int swap_in_cluster(const paddr_t *ppaddrs, unsigned int n, off_t offset); // Swap-in di n slot consecutivi
+int swap_set_readahead(unsigned int npages); // Imposta il read-ahead dello swap-in, in pagine
+unsigned int swap_get_readahead(void);
+int swap_read(paddr_t ppadd, off_t offset); // Legge la pagina senza aggiornare le statistiche
+void swap_free(off_t offset); // Rilascia un riferimento allo slot all'offset dato
+void swap_share(off_t offset); // Aggiunge un riferimento allo slot (condiviso dopo una fork)
+int swap_is_shared(off_t offset); // 1 se lo slot ha piu' di un riferimento
+void swap_get_usage(unsigned int *used, unsigned int *npages, unsigned int *max); // Slot occupati, dimensione corrente e massima
 void swap_shutdown(void);
 int getIn(void);
 int getOut(void);
-#endif
\ No newline at end of file
+#endif
@@ -35,6 +35,7 @@
 #include "opt-syscalls.h"
 #include "opt-fork.h"
 #include "opt-file.h"
+#include "opt-c1_pag.h"
 
 struct trapframe; /* from <machine/trapframe.h> */
 
@@ -65,9 +66,11 @@ int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
 #if OPT_SYSCALLS
 #if OPT_FILE
 struct openfile;
+struct vnode;
 void openfileIncrRefCount(struct openfile *of);
 int sys_open(userptr_t path, int openflags, mode_t mode, int *errp);
 int sys_close(int fd);
+struct vnode *file_getvnode(int fd);
 #endif
 int sys_write(int fd, userptr_t buf_ptr, size_t size);
 int sys_read(int fd, userptr_t buf_ptr, size_t size);
@@ -77,6 +80,11 @@ pid_t sys_getpid(void);
 #if OPT_FORK
 int sys_fork(struct trapframe *ctf, pid_t *retval);
 #endif
+#if OPT_C1_PAG
+int sys_sbrk(intptr_t amount, int32_t *retval);
+int sys_mmap(struct trapframe *tf, int32_t *retval);
+int sys_munmap(userptr_t addr, size_t len);
+#endif
 
 #endif
 
@@ -95,6 +95,21 @@ int kmalloctest3(int, char **);
 int kmalloctest4(int, char **);
 int nettest(int, char **);
 
+/* virtual memory tests (c1_pag) */
+int vmallocbench(int, char **);
+int vmallocstress(int, char **);
+int vmshootdownstress(int, char **);
+int vmswapslotbench(int, char **);
+int vmswapdevbench(int, char **);
+int vmstlbbench(int, char **);
+int vmasidbench(int, char **);
+int vmptbench(int, char **);
+int vmelfbench(int, char **);
+int vmzerobench(int, char **);
+int vmzswaptest(int, char **);
+int vmforktest(int, char **);
+int vmtextevicttest(int, char **);
+
 /* Routine for running a user-level program. */
 int runprogram(char *progname);
 
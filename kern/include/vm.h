@@ -63,6 +63,11 @@
 
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
+void vm_tlbshootdown_all(void);
+
+/* Coalesce SRC into DST if possible (called from ipi_tlbshootdown) */
+int vm_tlbshootdown_merge(struct tlbshootdown *dst,
+			  const struct tlbshootdown *src);
 
 
 #endif /* _VM_H_ */
@@ -1,7 +1,27 @@
 #ifndef _VM_TLB_H_
 #define _VM_TLB_H_
 #include <types.h>
+#include <vm.h>
 
+struct addrspace;
+
+/*
+ * ASID: campo PID (6 bit) di EntryHi. L'ASID 0 non viene mai assegnato a un
+ * address space: etichetta le voci invalide e quelle scritte direttamente dai test.
+ */
+#define TLB_ASID_SHIFT 6            // Posizione del campo PID in EntryHi
+#define TLB_ASID_MASK  0x00000fc0   // Campo PID di EntryHi
+#define TLB_NASID      64           // Numero di ASID distinti
+
+/*
+ * Insieme di richieste di shootdown da inviare insieme alle altre CPU:
+ * le pagine adiacenti dello stesso address space vengono fuse in un
+ * unico intervallo e si attende una sola volta il completamento.
+ */
+struct tlb_batch {
+    unsigned tb_count;
+    struct tlbshootdown tb_ts[TLBSHOOTDOWN_MAX];
+};
 
 /**
  * Rimuove una voce dal TLB associata a un indirizzo virtuale.
@@ -10,4 +30,84 @@
  * @return 1 se la voce è stata rimossa, 0 altrimenti.
  */
 int tlb_remove_by_va(vaddr_t va);
-#endif
\ No newline at end of file
+
+/**
+ * Invalida nella TLB locale la voce che mappa l'indirizzo virtuale va
+ * nell'address space attivo sulla CPU, se presente.
+ *
+ * @param va Indirizzo virtuale (allineato a pagina) da invalidare.
+ */
+void tlb_invalidate_va(vaddr_t va);
+
+/**
+ * Attiva l'address space as sulla CPU corrente, caricandone l'ASID in
+ * EntryHi; gli assegna un nuovo ASID se il suo appartiene a una generazione
+ * precedente. La TLB viene svuotata solo quando gli ASID si esauriscono.
+ */
+void tlb_asid_activate(struct addrspace *as);
+
+/**
+ * Toglie ad as il suo ASID, rendendo inutilizzabili su tutte le CPU le sue
+ * voci nella TLB. Il nuovo ASID viene assegnato alla prossima attivazione.
+ */
+void tlb_asid_renew(struct addrspace *as);
+
+/**
+ * Restituisce il valore di EntryHi (pagina e ASID attivo sulla CPU) con cui
+ * scrivere nella TLB la traduzione di va. Va chiamata con le interruzioni
+ * disabilitate.
+ */
+uint32_t tlb_ehi(vaddr_t va);
+
+/**
+ * Abilita o disabilita gli ASID (disabilitati, ogni attivazione svuota la
+ * TLB); ritorna il valore precedente.
+ */
+int tlb_asid_set_enabled(int enabled);
+
+/**
+ * Invalida su tutte le CPU la traduzione della pagina va dell'address space as:
+ * localmente se as è l'address space corrente, sulle altre CPU tramite
+ * un'IPI di TLB shootdown.
+ *
+ * @param as Address space proprietario della mappatura.
+ * @param va Indirizzo virtuale (allineato a pagina) da invalidare.
+ */
+void tlb_shootdown_va(struct addrspace *as, vaddr_t va);
+
+/**
+ * Invalida nella TLB locale le voci di as per npages pagine a partire da
+ * start, anche se as non e' l'address space attivo: può essere chiamata da
+ * un interrupt (shootdown) o da un thread del kernel.
+ * Per intervalli piu' grandi della TLB scorre le voci invece di fare una
+ * probe per pagina.
+ */
+void tlb_invalidate_range(struct addrspace *as, vaddr_t start, unsigned npages);
+
+/**
+ * Invalida tutte le voci della TLB locale.
+ */
+void tlb_invalidate_all(void);
+
+/**
+ * Restituisce l'indice di una voce invalida della TLB locale, -1 se non ce
+ * ne sono. Sovrascrive EntryHi: va seguita dalla scrittura della nuova voce,
+ * con le interruzioni disabilitate.
+ */
+int tlb_find_free(void);
+
+/**
+ * Come tlb_shootdown_va, ma per un intervallo di npages pagine.
+ * Ritorna solo quando tutte le altre CPU hanno eseguito lo shootdown.
+ */
+void tlb_shootdown_range(struct addrspace *as, vaddr_t start, unsigned npages);
+
+/**
+ * Gestione dei batch di shootdown: tlb_batch_add accoda (e fonde) la pagina
+ * va di as, tlb_batch_flush invia le richieste accodate e ne attende il
+ * completamento. Un batch pieno viene inviato automaticamente.
+ */
+void tlb_batch_init(struct tlb_batch *tb);
+void tlb_batch_add(struct tlb_batch *tb, struct addrspace *as, vaddr_t va);
+void tlb_batch_flush(struct tlb_batch *tb);
+#endif
@@ -4,6 +4,7 @@
 #include <vm.h>
 
 #define VMC1_STACKPAGES 12  // Numero di pagine riservate per lo stack
+#define VMC1_STACKMAXPAGES 256  // Dimensione massima predefinita dello stack, in pagine, raggiunta per crescita
 
 /*
  * Inizializza il sottosistema di memoria virtuale.
@@ -29,8 +30,28 @@ void vm_shutdown(void);
  */
 int vm_fault(int fault_type, vaddr_t fault_addr);
 
+/*
+ * Abilita (enabled != 0) o disabilita la ricarica della TLB dalla cache
+ * software delle traduzioni di ogni address space; ritorna il valore precedente.
+ */
+int vm_stlb_set_enabled(int enabled);
+
+/*
+ * Restituisce il nome della politica di rimpiazzo delle voci TLB
+ * selezionata con le opzioni c1_tlb_*.
+ */
+const char *vm_tlb_policy_name(void);
+
 
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *ts);
+void vm_tlbshootdown_all(void);
+
+/*
+ * Fonde la richiesta di shootdown src in dst se riguardano lo stesso
+ * address space e intervalli adiacenti o sovrapposti.
+ * Ritorna 1 se la fusione e' avvenuta, 0 altrimenti.
+ */
+int vm_tlbshootdown_merge(struct tlbshootdown *dst, const struct tlbshootdown *src);
 
 #endif
@@ -0,0 +1,56 @@
+#ifndef _ZSWAP_H_
+#define _ZSWAP_H_
+
+#include <types.h>
+
+/**
+ * Cache compressa dello swap: le pagine portate nello swap vengono compresse
+ * in memoria (blocchi kmalloc) invece di essere scritte su disco, finche' la
+ * memoria occupata non supera ZSWAP_PERCENT della RAM. La cache e'
+ * indicizzata dallo slot dello swap assegnato alla pagina: lo slot viene
+ * allocato comunque, ma il disco viene letto e scritto solo per le pagine
+ * che non stanno nella cache. Il contenuto valido di uno slot e' quello
+ * nella cache, se presente, altrimenti quello sul disco.
+ *
+ * La compressione e' per parole di 32 bit (come WKdm): ogni parola e' zero,
+ * uguale o con gli stessi 22 bit alti di una parola recente (dizionario di
+ * ZSWAP_DICT_SIZE voci), oppure viene copiata intera.
+ */
+#define ZSWAP_PERCENT 20      // Percentuale predefinita della RAM per la cache (comando "zswap" del menu)
+#define ZSWAP_BUCKETS 256     // Bucket della tabella hash (potenza di 2)
+#define ZSWAP_DICT_SIZE 16    // Voci del dizionario del compressore (potenza di 2)
+
+/**
+ * Comprime la pagina nel frame pa come contenuto dello slot offset. Una
+ * copia precedente dello slot viene comunque scartata.
+ * @return 1 se la pagina e' nella cache, 0 se va scritta su disco (cache
+ *         piena o disattivata, pagina poco comprimibile, memoria esaurita).
+ */
+int zswap_store(paddr_t pa, off_t offset);
+
+/**
+ * Decomprime nel frame pa il contenuto dello slot offset, che resta nella
+ * cache come copia valida della pagina (come lo slot dopo uno swap-in).
+ * @return 1 se lo slot era nella cache, 0 se va letto dal disco.
+ */
+int zswap_load(paddr_t pa, off_t offset);
+
+/**
+ * Scarta il contenuto dello slot offset, se presente (chiamata da swap_free).
+ */
+void zswap_invalidate(off_t offset);
+
+/**
+ * Imposta la percentuale della RAM utilizzabile dalla cache (0 la disattiva
+ * per i nuovi swap-out; le pagine gia' compresse restano leggibili).
+ * @return 0, EINVAL se percent supera 100.
+ */
+int zswap_set_percent(unsigned int percent);
+unsigned int zswap_get_percent(void);
+
+/**
+ * Stampa l'occupazione corrente della cache.
+ */
+void zswap_print_statistics(void);
+
+#endif /* _ZSWAP_H_ */
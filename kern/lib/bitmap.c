@@ -120,6 +120,42 @@ bitmap_alloc(struct bitmap *b, unsigned *index)
         return ENOSPC;
 }
 
+/*
+ * Next-fit variant of bitmap_alloc: the search starts at the word
+ * containing bit START, so that callers keeping a hint just past the
+ * last allocation skip the full words at the front of the map. Whole
+ * words with no clear bit are skipped at once.
+ */
+int
+bitmap_alloc_from(struct bitmap *b, unsigned start, unsigned *index)
+{
+        unsigned ix, i;
+        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+        unsigned offset;
+
+        if (start >= b->nbits) {
+                start = 0;
+        }
+
+        for (i=0; i<maxix; i++) {
+                ix = (start / BITS_PER_WORD + i) % maxix;
+                if (b->v[ix]!=WORD_ALLBITS) {
+                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
+                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
+
+                                if ((b->v[ix] & mask)==0) {
+                                        b->v[ix] |= mask;
+                                        *index = (ix*BITS_PER_WORD)+offset;
+                                        KASSERT(*index < b->nbits);
+                                        return 0;
+                                }
+                        }
+                        KASSERT(0);
+                }
+        }
+        return ENOSPC;
+}
+
 static
 inline
 void
@@ -45,6 +45,17 @@
 #include <test.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-c1_pag.h"
+
+#if OPT_C1_PAG
+#include <addrspace.h>
+#include <coremap.h>
+#include <segments.h>
+#include <statistics.h>
+#include <swapfile.h>
+#include <vmc1.h>
+#include <zswap.h>
+#endif
 
 /*
  * In-kernel menu and command dispatcher.
@@ -155,6 +166,194 @@ cmd_prog(int nargs, char **args)
 	return common_prog(nargs, args);
 }
 
+#if OPT_C1_PAG
+/*
+ * Command for running a user program and reporting the VM statistics
+ * it generated, together with the page replacement policy compiled in.
+ * Running the same program on kernels built with different policies
+ * gives a direct comparison of their swap-in/swap-out counts.
+ */
+static
+int
+cmd_progbench(int nargs, char **args)
+{
+	unsigned int before[N_STATS];
+	int result;
+
+	if (nargs < 2) {
+		kprintf("Usage: pb program [arguments]\n");
+		return EINVAL;
+	}
+
+	/* drop the leading "pb" */
+	args++;
+	nargs--;
+
+	get_statistics(before);
+	result = common_prog(nargs, args);
+	if (result) {
+		return result;
+	}
+
+	kprintf("VM statistics for %s (replacement policy: %s, "
+		"TLB policy: %s):\n",
+		args[0], coremap_policy_name(), vm_tlb_policy_name());
+	print_statistics_delta(before);
+	return 0;
+}
+
+/*
+ * Command for setting the maximum size the swap file may grow to.
+ * Menu commands can be given on the sys161 command line, so this
+ * makes the swap size a boot-time parameter, e.g.
+ *	sys161 kernel "swap 32; p testbin/huge"
+ */
+static
+int
+cmd_swapsize(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: swap megabytes\n");
+		return EINVAL;
+	}
+
+	result = swap_set_max_size(atoi(args[1]));
+	if (result) {
+		kprintf("swap: size must be at least %d MB and not below "
+			"the current swap file size\n",
+			SWAP_INITIAL_SIZE / (1024*1024));
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Command for choosing the swap backing store: a raw disk (e.g. lhd1)
+ * used as a swap partition, or "file" for emu0:/SWAPFILE. It must be
+ * given before any page has been swapped out, e.g.
+ *	sys161 kernel "swapdev lhd1; p testbin/huge"
+ */
+static
+int
+cmd_swapdev(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: swapdev lhdN|file\n");
+		return EINVAL;
+	}
+
+	result = swap_set_device(args[1]);
+	if (result) {
+		kprintf("swapdev: %s: %s\n", args[1], strerror(result));
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Command for setting how many following pages are read ahead from
+ * swap together with the faulting one (0 disables read-ahead), e.g.
+ *	sys161 kernel "swapra 8; pb testbin/matmult"
+ */
+static
+int
+cmd_swapreadahead(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: swapra pages\n");
+		return EINVAL;
+	}
+
+	result = swap_set_readahead(atoi(args[1]));
+	if (result) {
+		kprintf("swapra: read-ahead must be below %d pages\n",
+			SWAP_BATCH_MAX);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Command for setting the percentage of RAM that may hold compressed
+ * swapped-out pages (0 sends every page to disk), e.g.
+ *	sys161 kernel "zswap 0; pb testbin/matmult"
+ */
+static
+int
+cmd_zswap(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: zswap percent\n");
+		return EINVAL;
+	}
+
+	result = zswap_set_percent(atoi(args[1]));
+	if (result) {
+		kprintf("zswap: percentage must be at most 100\n");
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Command for setting how many following pages of the executable are
+ * read together with the faulting one (0 disables fault-around), e.g.
+ *	sys161 kernel "elfra 8; pb testbin/matmult"
+ */
+static
+int
+cmd_elffaultaround(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: elfra pages\n");
+		return EINVAL;
+	}
+
+	result = seg_set_faultaround(atoi(args[1]));
+	if (result) {
+		kprintf("elfra: fault-around must be at most %d pages\n",
+			SEG_FAULTAROUND_MAX);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Command for setting how many pages the user stack may grow to on
+ * faults below its base, e.g.
+ *	sys161 kernel "stackmax 1024; p testbin/bigstack"
+ */
+static
+int
+cmd_stackmax(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: stackmax pages\n");
+		return EINVAL;
+	}
+
+	result = as_set_stack_limit(atoi(args[1]));
+	if (result) {
+		kprintf("stackmax: limit must be at least %d pages\n",
+			VMC1_STACKPAGES);
+		return result;
+	}
+	return 0;
+}
+#endif
+
 /*
  * Command for starting the system shell.
  */
@@ -521,6 +720,15 @@ showmenu(const char *name, const char *x[])
 static const char *opsmenu[] = {
 	"[s]       Shell                     ",
 	"[p]       Other program             ",
+#if OPT_C1_PAG
+	"[pb]      Program + VM statistics   ",
+	"[swap]    Set max swap size (MB)    ",
+	"[swapra]  Set swap read-ahead pages ",
+	"[swapdev] Swap on lhdN or file       ",
+	"[zswap]   Set compressed swap % RAM ",
+	"[stackmax] Set max stack pages      ",
+	"[elfra]   Set ELF fault-around pages",
+#endif
 	"[mount]   Mount a filesystem        ",
 	"[unmount] Unmount a filesystem      ",
 	"[bootfs]  Set \"boot\" filesystem     ",
@@ -572,6 +780,21 @@ static const char *testmenu[] = {
 	"[fs4] FS write stress 2             ",
 	"[fs5] FS long stress                ",
 	"[fs6] FS create stress              ",
+#if OPT_C1_PAG
+	"[vm1] Coremap allocator benchmark   ",
+	"[vm2] Concurrent coremap benchmark  ",
+	"[vm3] TLB shootdown stress test     ",
+	"[vm4] Swap slot allocator benchmark ",
+	"[vm5] Swap backend benchmark        ",
+	"[vm6] Software TLB reload benchmark ",
+	"[vm7] ASID context switch benchmark ",
+	"[vm8] Page table walk benchmark     ",
+	"[vm9] ELF fault-around benchmark    ",
+	"[vm10] Zero-page pool benchmark     ",
+	"[vm11] Compressed swap cache test   ",
+	"[vm12] Fork + memory overcommit test",
+	"[vm13] Shared text eviction test    ",
+#endif
 	NULL
 };
 
@@ -629,6 +852,15 @@ static struct {
 	/* operations */
 	{ "s",		cmd_shell },
 	{ "p",		cmd_prog },
+#if OPT_C1_PAG
+	{ "pb",		cmd_progbench },
+	{ "swap",	cmd_swapsize },
+	{ "swapra",	cmd_swapreadahead },
+	{ "swapdev",	cmd_swapdev },
+	{ "zswap",	cmd_zswap },
+	{ "stackmax",	cmd_stackmax },
+	{ "elfra",	cmd_elffaultaround },
+#endif
 	{ "mount",	cmd_mount },
 	{ "unmount",	cmd_unmount },
 	{ "bootfs",	cmd_bootfs },
@@ -702,6 +934,23 @@ static struct {
 	{ "fs5",	longstress },
 	{ "fs6",	createstress },
 
+#if OPT_C1_PAG
+	/* virtual memory tests */
+	{ "vm1",	vmallocbench },
+	{ "vm2",	vmallocstress },
+	{ "vm3",	vmshootdownstress },
+	{ "vm4",	vmswapslotbench },
+	{ "vm5",	vmswapdevbench },
+	{ "vm6",	vmstlbbench },
+	{ "vm7",	vmasidbench },
+	{ "vm8",	vmptbench },
+	{ "vm9",	vmelfbench },
+	{ "vm10",	vmzerobench },
+	{ "vm11",	vmzswaptest },
+	{ "vm12",	vmforktest },
+	{ "vm13",	vmtextevicttest },
+#endif
+
 	{ NULL, NULL }
 };
 
@@ -238,6 +238,21 @@ sys_close(int fd)
   return 0;
 }
 
+/*
+ * vnode of an open file descriptor of the current process (used by mmap),
+ * NULL if fd is not open
+ */
+struct vnode *
+file_getvnode(int fd)
+{
+  struct openfile *of;
+
+  if (fd<0||fd>=OPEN_MAX) return NULL;
+  of = curproc->fileTable[fd];
+  if (of==NULL) return NULL;
+  return of->vn;
+}
+
 #endif
 
 /*
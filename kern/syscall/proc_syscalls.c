@@ -25,6 +25,12 @@
 void
 sys__exit(int status)
 {
+#if OPT_C1_PAG
+  /* shared mappings are written back while the address space is still current */
+  if (proc_getas() != NULL) {
+    as_munmap_all(proc_getas());
+  }
+#endif
 #if OPT_WAITPID
   struct proc *p = curproc;
   p->p_status = status & 0xff; /* just lower 8 bits returned */
@@ -0,0 +1,112 @@
+/*
+ * System call per la gestione della memoria virtuale (opzione c1_pag).
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <vnode.h>
+#include <kern/mman.h>
+#include <mips/trapframe.h>
+#include <syscall.h>
+
+/*
+ * sbrk: sposta il break dell'heap del processo di amount byte e restituisce
+ * il valore precedente. Le pagine dell'heap vengono caricate su richiesta
+ * da vm_fault.
+ */
+int
+sys_sbrk(intptr_t amount, int32_t *retval)
+{
+  struct addrspace *as;
+  vaddr_t oldbreak;
+  int result;
+
+  as = proc_getas();
+  if (as == NULL) {
+    return EFAULT;
+  }
+
+  result = as_sbrk(as, amount, &oldbreak);
+  if (result) {
+    return result;
+  }
+  *retval = (int32_t)oldbreak;
+  return 0;
+}
+
+/*
+ * mmap: mappa una parte di un file aperto. Gli argomenti sono quelli di
+ * mmap(addr, len, prot, flags, fd, offset): i primi quattro nei registri
+ * a0-a3, fd e l'offset a 64 bit (allineato) sullo stack utente. L'indirizzo
+ * addr e' solo un suggerimento e viene ignorato (MAP_FIXED non e' supportato).
+ */
+int
+sys_mmap(struct trapframe *tf, int32_t *retval)
+{
+#if OPT_FILE
+  struct addrspace *as;
+  struct vnode *v;
+  size_t len;
+  int prot, flags, fd, result;
+  off_t offset;
+  vaddr_t addr;
+
+  len = (size_t)tf->tf_a1;
+  prot = (int)tf->tf_a2;
+  flags = (int)tf->tf_a3;
+  result = copyin((const_userptr_t)(tf->tf_sp + 16), &fd, sizeof(fd));
+  if (result) {
+    return result;
+  }
+  result = copyin((const_userptr_t)(tf->tf_sp + 24), &offset, sizeof(offset));
+  if (result) {
+    return result;
+  }
+
+  as = proc_getas();
+  if (as == NULL) {
+    return EFAULT;
+  }
+  v = file_getvnode(fd);
+  if (v == NULL) {
+    return EBADF;
+  }
+
+  /* the file system decides whether the range can be mapped */
+  result = VOP_MMAP(v, offset, len, prot);
+  if (result) {
+    return result;
+  }
+  result = as_mmap(as, v, len, prot, flags, offset, &addr);
+  if (result) {
+    return result;
+  }
+  *retval = (int32_t)addr;
+  return 0;
+#else
+  (void)tf;
+  (void)retval;
+  return ENOSYS;
+#endif
+}
+
+/*
+ * munmap: rimuove una regione creata da mmap, scrivendo nel file le
+ * modifiche se e' condivisa.
+ */
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+  struct addrspace *as;
+
+  as = proc_getas();
+  if (as == NULL) {
+    return EFAULT;
+  }
+  return as_munmap(as, (vaddr_t)addr, len);
+}
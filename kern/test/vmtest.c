@@ -0,0 +1,1903 @@
+/*
+ * Test e benchmark per il sottosistema di memoria virtuale (opzione c1_pag).
+ *
+ * I benchmark riportano il tempo medio per operazione misurato con gettime();
+ * vanno eseguiti con diverse dimensioni di RAM (ramsize in sys161.conf) per
+ * confrontare il comportamento al crescere della memoria fisica.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <spl.h>
+#include <membar.h>
+#include <clock.h>
+#include <thread.h>
+#include <proc.h>
+#include <synch.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <mips/tlb.h>
+#include <bitmap.h>
+#include <vfs.h>
+#include <test.h>
+
+#include <coremap.h>
+#include <pt.h>
+#include <vm_tlb.h>
+#include <swapfile.h>
+#include <segments.h>
+#include <vmc1.h>
+#include <statistics.h>
+#include <zswap.h>
+#include <pagecache.h>
+
+////////////////////////////////////////////////////////////
+// vm1
+
+#define VM1_NPAGES  256   // Numero massimo di pagine tenute allocate contemporaneamente
+#define VM1_ROUNDS  16    // Ripetizioni di ogni fase
+#define VM1_FAULT_PAGES   VMC1_STACKPAGES  // Pagine dello stack toccate ad ogni giro di fault
+#define VM1_FAULT_ROUNDS  200
+
+/*
+ * Restituisce in nanosecondi l'intervallo trascorso da before.
+ */
+static
+uint64_t
+vmtest_elapsed_ns(const struct timespec *before)
+{
+	struct timespec after, duration;
+
+	gettime(&after);
+	timespec_sub(&after, before, &duration);
+	return (uint64_t)duration.tv_sec * 1000000000ULL + duration.tv_nsec;
+}
+
+static
+void
+vmtest_report(const char *what, uint64_t ns, unsigned long ops)
+{
+	if (ops == 0) {
+		kprintf("vm: %-28s no operations\n", what);
+		return;
+	}
+	kprintf("vm: %-28s %8lu ops, %8llu ns/op\n", what, ops,
+		(unsigned long long)(ns / ops));
+}
+
+/*
+ * Esegue VM1_FAULT_ROUNDS giri di page fault in scrittura sulle
+ * VM1_FAULT_PAGES pagine dello stack di as, che vengono azzerate come nuove
+ * pagine, e dopo ogni giro le rimuove dalla page table, restituendo i frame
+ * all'allocatore. Solo i fault sono cronometrati. Ritorna il tempo totale
+ * dei fault in nanosecondi, 0 in caso di errore.
+ */
+static
+uint64_t
+vm1_fault_run(struct addrspace *as)
+{
+	struct timespec before;
+	uint64_t ns;
+	unsigned i, r;
+	vaddr_t base;
+
+	base = as->stack->p_vaddr;
+	ns = 0;
+	for (r = 0; r < VM1_FAULT_ROUNDS; r++) {
+		gettime(&before);
+		for (i = 0; i < VM1_FAULT_PAGES; i++) {
+			if (vm_fault(VM_FAULT_WRITE, base + i * PAGE_SIZE)) {
+				kprintf("vm1: fault on 0x%x failed\n", base + i * PAGE_SIZE);
+				return 0;
+			}
+		}
+		ns += vmtest_elapsed_ns(&before);
+
+		tlb_asid_renew(as);
+		as_activate();
+		as->stlb_gen++;
+		pt_unmap(as->pt, base, USERSTACK);
+	}
+	return ns == 0 ? 1 : ns;
+}
+
+/*
+ * Benchmark dell'allocatore di frame della coremap.
+ *
+ * Fase 1: page fault su pagine da azzerare di un address space di prova (il
+ * percorso di page_alloc), con la riserva di frame azzerati disattivata, una
+ * volta con le cache di frame per CPU e una volta con le cache svuotate e
+ * disattivate, cosi' che ogni frame passi dalla free list.
+ * Fase 2: alloca e libera singole pagine del kernel dalla free list,
+ * liberandole in ordine alternato per frammentarla.
+ * Fase 3: alloca e libera run di 2..8 pagine contigue (kmalloc di grandi
+ * dimensioni).
+ */
+int
+vmallocbench(int nargs, char **args)
+{
+	static vaddr_t pages[VM1_NPAGES];
+	struct addrspace *as, *old;
+	struct timespec before;
+	uint64_t ns, ns_cache, ns_list;
+	unsigned long ops, held;
+	unsigned i, r, npages;
+	int pool, cache;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting coremap allocator benchmark (%u frames)...\n",
+		coremap_total_frames());
+
+	as = as_create();
+	if (as == NULL) {
+		panic("vmallocbench: as_create failed\n");
+	}
+	seg_define_stack(as->stack);
+	old = proc_setas(as);
+	as_activate();
+
+	// Ogni fault deve prelevare il frame dall'allocatore, non dalla riserva
+	pool = coremap_zero_pool_set_enabled(0);
+	cache = coremap_frame_cache_set_enabled(1);
+	ns_cache = vm1_fault_run(as);
+	coremap_frame_cache_set_enabled(0);
+	ns_list = vm1_fault_run(as);
+
+	proc_setas(old);
+	as_activate();
+	tlb_invalidate_all();
+	as_destroy(as);
+
+	if (ns_cache == 0 || ns_list == 0) {
+		coremap_frame_cache_set_enabled(cache);
+		coremap_zero_pool_set_enabled(pool);
+		kprintf("vm1: FAILED\n");
+		return 1;
+	}
+	ops = (unsigned long)VM1_FAULT_ROUNDS * VM1_FAULT_PAGES;
+	vmtest_report("zero-fill fault, cpu cache", ns_cache, ops);
+	vmtest_report("zero-fill fault, free list", ns_list, ops);
+
+	// Le cache restano disattivate: le fasi seguenti misurano la free list
+	ops = 0;
+	gettime(&before);
+	for (r = 0; r < VM1_ROUNDS; r++) {
+		for (held = 0; held < VM1_NPAGES; held++) {
+			pages[held] = alloc_kpages(1);
+			if (pages[held] == 0) {
+				break;
+			}
+		}
+		ops += held;
+		// Prima le pagine pari, poi le dispari: la free list resta frammentata
+		for (i = 0; i < held; i += 2) {
+			free_kpages(pages[i]);
+		}
+		for (i = 1; i < held; i += 2) {
+			free_kpages(pages[i]);
+		}
+		ops += held;
+	}
+	ns = vmtest_elapsed_ns(&before);
+	vmtest_report("single page alloc/free", ns, ops);
+
+	ops = 0;
+	gettime(&before);
+	for (r = 0; r < VM1_ROUNDS; r++) {
+		npages = 2;
+		for (held = 0; held < VM1_NPAGES / 8; held++) {
+			pages[held] = alloc_kpages(npages);
+			if (pages[held] == 0) {
+				break;
+			}
+			npages = npages % 8 + 1 + (npages == 8);
+		}
+		ops += held;
+		for (i = 0; i < held; i++) {
+			free_kpages(pages[i]);
+		}
+		ops += held;
+	}
+	ns = vmtest_elapsed_ns(&before);
+	vmtest_report("multi page alloc/free", ns, ops);
+
+	coremap_frame_cache_set_enabled(cache);
+	coremap_zero_pool_set_enabled(pool);
+	kprintf("Coremap allocator benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm2
+
+#define VM2_NTHREADS 8
+#define VM2_NTRIES   2000
+#define VM2_HELD     4    // Pagine tenute allocate da ogni thread
+
+static
+void
+vmallocthread(void *sm, unsigned long num)
+{
+	struct semaphore *sem = sm;
+	vaddr_t held[VM2_HELD];
+	unsigned i, slot;
+
+	(void)num;
+
+	for (i = 0; i < VM2_HELD; i++) {
+		held[i] = 0;
+	}
+	for (i = 0; i < VM2_NTRIES; i++) {
+		slot = i % VM2_HELD;
+		if (held[slot] != 0) {
+			free_kpages(held[slot]);
+		}
+		held[slot] = alloc_kpages(1);
+	}
+	for (i = 0; i < VM2_HELD; i++) {
+		if (held[i] != 0) {
+			free_kpages(held[i]);
+		}
+	}
+	V(sem);
+}
+
+/*
+ * Benchmark concorrente: VM2_NTHREADS thread allocano e liberano pagine
+ * singole. Le statistiche della coremap stampate prima e dopo mostrano
+ * quante acquisizioni del lock globale sono state evitate dalle cache per
+ * CPU (da eseguire con piu' CPU configurate in sys161.conf).
+ */
+int
+vmallocstress(int nargs, char **args)
+{
+	struct semaphore *sem;
+	struct timespec before;
+	uint64_t ns;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting concurrent coremap allocator benchmark...\n");
+	coremap_print_statistics();
+
+	sem = sem_create("vmallocstress", 0);
+	if (sem == NULL) {
+		panic("vmallocstress: sem_create failed\n");
+	}
+
+	gettime(&before);
+	for (i = 0; i < VM2_NTHREADS; i++) {
+		result = thread_fork("vmallocstress", NULL,
+				     vmallocthread, sem, i);
+		if (result) {
+			panic("vmallocstress: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i = 0; i < VM2_NTHREADS; i++) {
+		P(sem);
+	}
+	ns = vmtest_elapsed_ns(&before);
+	sem_destroy(sem);
+
+	vmtest_report("concurrent alloc/free", ns,
+		      2UL * VM2_NTHREADS * VM2_NTRIES);
+	coremap_print_statistics();
+	kprintf("Concurrent coremap allocator benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm3
+
+#define VM3_BASE     0x60000000  // Indirizzi kuseg usati dal test
+#define VM3_NSLOTS   4           // Pagine virtuali, una per thread evictor
+#define VM3_NREADERS 4
+#define VM3_NREMAPS  2000        // Rimappature eseguite da ogni evictor
+#define VM3_NREADS   20000       // Letture eseguite da ogni reader
+#define VM3_POISON   0xdeadbeef
+#define VM3_TAG(slot, gen) (((uint32_t)(slot) << 16) | (gen))
+
+/*
+ * Address space fittizio: serve solo come chiave delle richieste di
+ * shootdown, il test scrive direttamente nella TLB. Non viene mai attivato:
+ * il suo ASID resta 0, lo stesso con cui i reader scrivono le voci.
+ */
+static struct addrspace vm3_as;
+static volatile paddr_t vm3_pa[VM3_NSLOTS];
+static volatile unsigned vm3_stale;
+
+static
+void
+vm3_fill(paddr_t pa, uint32_t value)
+{
+	uint32_t *words = (uint32_t *)PADDR_TO_KVADDR(pa);
+	unsigned i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+		words[i] = value;
+	}
+}
+
+/*
+ * Evictor: sposta ripetutamente la propria pagina virtuale su un nuovo
+ * frame, esegue lo shootdown e solo dopo avvelena il frame precedente.
+ * Se lo shootdown e' corretto nessuna CPU puo' piu' leggere il veleno.
+ */
+static
+void
+vm3_evictor(void *sm, unsigned long slot)
+{
+	struct semaphore *sem = sm;
+	vaddr_t kva;
+	paddr_t old;
+	unsigned gen;
+
+	for (gen = 1; gen <= VM3_NREMAPS; gen++) {
+		kva = alloc_kpages(1);
+		if (kva == 0) {
+			thread_yield();
+			continue;
+		}
+		vm3_fill((kva - MIPS_KSEG0), VM3_TAG(slot, gen));
+		old = vm3_pa[slot];
+		vm3_pa[slot] = (kva - MIPS_KSEG0);
+		membar_store_store();
+
+		tlb_shootdown_va(&vm3_as, VM3_BASE + slot * PAGE_SIZE);
+
+		vm3_fill(old, VM3_POISON);
+		free_kpages(PADDR_TO_KVADDR(old));
+	}
+	V(sem);
+}
+
+/*
+ * Reader: con le interruzioni disabilitate (quindi senza poter ricevere
+ * shootdown a meta') carica se serve la traduzione corrente nella TLB e
+ * legge la pagina. Una lettura del veleno, di un altro slot o di una
+ * generazione piu' vecchia di una gia' vista indica una traduzione stale.
+ */
+static
+void
+vm3_reader(void *sm, unsigned long num)
+{
+	struct semaphore *sem = sm;
+	unsigned last_gen[VM3_NSLOTS];
+	unsigned i, slot;
+	uint32_t value;
+	vaddr_t va;
+	int spl;
+
+	for (i = 0; i < VM3_NSLOTS; i++) {
+		last_gen[i] = 0;
+	}
+	for (i = 0; i < VM3_NREADS; i++) {
+		slot = (i + num) % VM3_NSLOTS;
+		va = VM3_BASE + slot * PAGE_SIZE;
+
+		spl = splhigh();
+		if (tlb_probe(va, 0) < 0) {
+			tlb_random(va, vm3_pa[slot] | TLBLO_VALID);
+		}
+		value = *(volatile uint32_t *)va;
+		splx(spl);
+
+		if (value == VM3_POISON || (value >> 16) != slot ||
+		    (value & 0xffff) < last_gen[slot]) {
+			vm3_stale++;
+			kprintf("vm3: stale translation for slot %u: "
+				"read 0x%x\n", slot, value);
+			continue;
+		}
+		last_gen[slot] = value & 0xffff;
+
+		if (i % 64 == 0) {
+			thread_yield();
+		}
+	}
+	V(sem);
+}
+
+/*
+ * Stress test dello shootdown: VM3_NSLOTS thread evictor rimappano di
+ * continuo le proprie pagine mentre VM3_NREADERS thread le leggono
+ * tramite la TLB. Va eseguito con almeno 4 CPU in sys161.conf.
+ */
+int
+vmshootdownstress(int nargs, char **args)
+{
+	struct semaphore *sem;
+	struct timespec before;
+	uint64_t ns;
+	vaddr_t kva;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting TLB shootdown stress test...\n");
+
+	vm3_stale = 0;
+	for (i = 0; i < VM3_NSLOTS; i++) {
+		kva = alloc_kpages(1);
+		if (kva == 0) {
+			panic("vmshootdownstress: out of memory\n");
+		}
+		vm3_pa[i] = (kva - MIPS_KSEG0);
+		vm3_fill(vm3_pa[i], VM3_TAG(i, 0));
+	}
+
+	sem = sem_create("vmshootdownstress", 0);
+	if (sem == NULL) {
+		panic("vmshootdownstress: sem_create failed\n");
+	}
+
+	gettime(&before);
+	for (i = 0; i < VM3_NSLOTS + VM3_NREADERS; i++) {
+		if (i < VM3_NSLOTS) {
+			result = thread_fork("vm3 evictor", NULL,
+					     vm3_evictor, sem, i);
+		}
+		else {
+			result = thread_fork("vm3 reader", NULL,
+					     vm3_reader, sem, i);
+		}
+		if (result) {
+			panic("vmshootdownstress: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i = 0; i < VM3_NSLOTS + VM3_NREADERS; i++) {
+		P(sem);
+	}
+	ns = vmtest_elapsed_ns(&before);
+	sem_destroy(sem);
+
+	/* Nessuna CPU deve conservare le traduzioni del test */
+	tlb_shootdown_range(&vm3_as, VM3_BASE, VM3_NSLOTS);
+	for (i = 0; i < VM3_NSLOTS; i++) {
+		free_kpages(PADDR_TO_KVADDR(vm3_pa[i]));
+	}
+
+	vmtest_report("remap + shootdown", ns,
+		      (unsigned long)VM3_NSLOTS * VM3_NREMAPS);
+	if (vm3_stale > 0) {
+		kprintf("vm3: FAILED: %u stale reads\n", vm3_stale);
+		return 1;
+	}
+	kprintf("TLB shootdown stress test done: no stale translations\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm4
+
+#define VM4_NSLOTS  32768  // Slot della bitmap (128 MB di swap)
+#define VM4_NOPS    20000
+
+/*
+ * Crescita dello swapfile senza frame liberi: occupa tutti gli slot della
+ * dimensione corrente, preleva tutti i frame liberi e porta nello swap
+ * un'ultima pagina. La crescita non deve allocare memoria: l'eviction che
+ * ne seguirebbe cercherebbe uno slot nella bitmap ancora piena. La cache
+ * compressa e' disattivata, perche' gli slot si riempiano senza kmalloc.
+ * Ritorna 0 se lo swapfile e' cresciuto (o e' gia' alla dimensione
+ * massima), 1 altrimenti.
+ */
+static
+int
+vm4_grow_exhausted(void)
+{
+	paddr_t pas[SWAP_BATCH_MAX];
+	off_t *offsets;
+	vaddr_t src, kva, held;
+	unsigned used, npages, max, grown, nslots, n, batch, i, nheld, zpercent;
+
+	swap_get_usage(&used, &npages, &max);
+	if (npages >= max) {
+		kprintf("vm4: swap already at its maximum size, growth not tested\n");
+		return 0;
+	}
+	nslots = npages - used + 1;
+	offsets = kmalloc(nslots * sizeof(off_t));
+	src = alloc_kpages(1);
+	if (offsets == NULL || src == 0) {
+		panic("vmswapslotbench: out of memory\n");
+	}
+	((uint32_t *)src)[0] = 0x5a9f0000;
+	for (i = 0; i < SWAP_BATCH_MAX; i++) {
+		pas[i] = src - MIPS_KSEG0;
+	}
+	zpercent = zswap_get_percent();
+	zswap_set_percent(0);
+
+	/* Swap pieno: tutti gli slot della dimensione corrente occupati */
+	n = 0;
+	while (n < nslots - 1) {
+		swap_get_usage(&used, &grown, &max);
+		if (grown != npages || used >= npages) {
+			break;
+		}
+		batch = npages - used;
+		if (batch > SWAP_BATCH_MAX) {
+			batch = SWAP_BATCH_MAX;
+		}
+		if (batch > nslots - 1 - n) {
+			batch = nslots - 1 - n;
+		}
+		for (i = 0; i < batch; i++) {
+			offsets[n + i] = -1;
+		}
+		swap_out_batch(pas, batch, &offsets[n]);
+		n += batch;
+	}
+
+	/* Nessun frame libero: i frame prelevati sono collegati dalla prima parola */
+	held = 0;
+	nheld = 0;
+	while (coremap_free_frames() > 0) {
+		kva = alloc_kpages(1);
+		if (kva == 0) {
+			break;
+		}
+		*(vaddr_t *)kva = held;
+		held = kva;
+		nheld++;
+	}
+
+	offsets[n] = -1;
+	swap_out_batch(pas, 1, &offsets[n]);
+	n++;
+	swap_get_usage(&used, &grown, &max);
+
+	while (held != 0) {
+		kva = held;
+		held = *(vaddr_t *)kva;
+		free_kpages(kva);
+	}
+	for (i = 0; i < n; i++) {
+		swap_free(offsets[i]);
+	}
+	zswap_set_percent(zpercent);
+	kfree(offsets);
+	free_kpages(src);
+
+	if (grown <= npages) {
+		kprintf("vm4: swapfile did not grow (%u slots)\n", grown);
+		return 1;
+	}
+	kprintf("vm4: swapfile grown from %u to %u slots with %u frames held\n",
+		npages, grown, nheld);
+	return 0;
+}
+
+/*
+ * Benchmark dell'allocazione degli slot di swap: con la bitmap quasi piena
+ * si libera e rialloca uno slot alla volta, confrontando la ricerca dal
+ * primo bit (bitmap_alloc) con quella next-fit usata da swapfile.c
+ * (bitmap_alloc_from con il suggerimento subito dopo l'ultimo slot).
+ * Segue la crescita dello swapfile con la memoria esaurita.
+ */
+int
+vmswapslotbench(int nargs, char **args)
+{
+	struct bitmap *b;
+	struct timespec before;
+	uint64_t ns;
+	unsigned i, slot, victim, hint;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting swap slot allocator benchmark...\n");
+
+	b = bitmap_create(VM4_NSLOTS);
+	if (b == NULL) {
+		panic("vmswapslotbench: bitmap_create failed\n");
+	}
+	for (i = 0; i < VM4_NSLOTS; i++) {
+		bitmap_mark(b, i);
+	}
+
+	/* Gli slot liberati avanzano nella bitmap, come gli swap-in nel tempo */
+	gettime(&before);
+	for (i = 0; i < VM4_NOPS; i++) {
+		victim = (i * 7) % VM4_NSLOTS;
+		bitmap_unmark(b, victim);
+		result = bitmap_alloc(b, &slot);
+		KASSERT(result == 0 && slot == victim);
+	}
+	ns = vmtest_elapsed_ns(&before);
+	vmtest_report("first-fit slot alloc", ns, VM4_NOPS);
+
+	hint = 0;
+	gettime(&before);
+	for (i = 0; i < VM4_NOPS; i++) {
+		victim = (i * 7) % VM4_NSLOTS;
+		bitmap_unmark(b, victim);
+		result = bitmap_alloc_from(b, hint, &slot);
+		KASSERT(result == 0 && slot == victim);
+		hint = slot + 1;
+	}
+	ns = vmtest_elapsed_ns(&before);
+	vmtest_report("next-fit slot alloc", ns, VM4_NOPS);
+
+	bitmap_destroy(b);
+
+	if (vm4_grow_exhausted()) {
+		kprintf("vm4: FAILED\n");
+		return 1;
+	}
+	kprintf("Swap slot allocator benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm5
+
+#define VM5_NPAGES  64                // Pagine scritte e rilette per ogni supporto
+#define VM5_CLUSTER SWAP_BATCH_MAX    // Pagine per scrittura nella fase a blocchi
+
+static paddr_t vm5_pa[VM5_CLUSTER];
+static off_t vm5_offsets[VM5_NPAGES];
+
+/*
+ * Misura sul supporto di swap corrente la scrittura di VM5_NPAGES pagine una
+ * alla volta e a blocchi di VM5_CLUSTER slot contigui, poi la rilettura una
+ * alla volta, verificando il contenuto. Gli slot vengono liberati alla fine.
+ */
+static
+int
+vm5_run(const char *dev)
+{
+	struct timespec before;
+	char what[32];
+	uint64_t ns;
+	unsigned i;
+	uint32_t *words;
+	int result;
+
+	/* Scrittura di una pagina per VOP_WRITE */
+	gettime(&before);
+	for (i = 0; i < VM5_NPAGES; i++) {
+		vm5_offsets[i] = -1;
+		swap_out_batch(&vm5_pa[0], 1, &vm5_offsets[i]);
+	}
+	ns = vmtest_elapsed_ns(&before);
+	snprintf(what, sizeof(what), "%s write 1 page", dev);
+	vmtest_report(what, ns, VM5_NPAGES);
+
+	/* Riscrittura sul posto a blocchi: gli slot sono contigui (next-fit) */
+	gettime(&before);
+	for (i = 0; i < VM5_NPAGES; i += VM5_CLUSTER) {
+		swap_out_batch(vm5_pa, VM5_CLUSTER, &vm5_offsets[i]);
+	}
+	ns = vmtest_elapsed_ns(&before);
+	snprintf(what, sizeof(what), "%s write %u pages", dev, VM5_CLUSTER);
+	vmtest_report(what, ns, VM5_NPAGES);
+
+	/* Rilettura: la pagina i contiene il valore scritto da vm5_pa[i % VM5_CLUSTER] */
+	result = 0;
+	gettime(&before);
+	for (i = 0; i < VM5_NPAGES; i++) {
+		result = swap_read(vm5_pa[0], vm5_offsets[i]);
+		if (result) {
+			break;
+		}
+		words = (uint32_t *)PADDR_TO_KVADDR(vm5_pa[0]);
+		if (words[1] != 0xc0ffee00 + i % VM5_CLUSTER) {
+			kprintf("vm5: %s: bad data in slot %u\n", dev, i);
+			result = EIO;
+			break;
+		}
+		/* swap_read ha sovrascritto la sorgente del blocco 0 */
+		words[1] = 0xc0ffee00;
+	}
+	ns = vmtest_elapsed_ns(&before);
+	if (result == 0) {
+		snprintf(what, sizeof(what), "%s read 1 page", dev);
+		vmtest_report(what, ns, VM5_NPAGES);
+	}
+
+	for (i = 0; i < VM5_NPAGES; i++) {
+		swap_free(vm5_offsets[i]);
+	}
+	return result;
+}
+
+/*
+ * Benchmark dei supporti di swap: confronta lo swapfile su emu0 con una
+ * partizione di swap su un disco lhd grezzo (argomento, predefinito lhd1).
+ * Va eseguito all'avvio, prima che una pagina sia stata portata nello swap;
+ * al termine viene ripristinato il supporto precedente. La cache compressa
+ * viene disattivata durante la misura, perche' le pagine arrivino al disco.
+ */
+int
+vmswapdevbench(int nargs, char **args)
+{
+	static const char *fmt = "vm5: %s: %s\n";
+	const char *devs[2];
+	char *saved;
+	vaddr_t kva;
+	unsigned i, d, zpercent;
+	int result;
+
+	if (nargs > 2) {
+		kprintf("Usage: vm5 [lhdN]\n");
+		return EINVAL;
+	}
+	devs[0] = "file";
+	devs[1] = nargs == 2 ? args[1] : "lhd1";
+
+	kprintf("Starting swap backend benchmark...\n");
+
+	for (i = 0; i < VM5_CLUSTER; i++) {
+		kva = alloc_kpages(1);
+		if (kva == 0) {
+			panic("vmswapdevbench: alloc_kpages failed\n");
+		}
+		vm5_pa[i] = kva - MIPS_KSEG0;
+		((uint32_t *)kva)[1] = 0xc0ffee00 + i;
+	}
+
+	saved = kstrdup(swap_device_name());
+	if (saved == NULL) {
+		panic("vmswapdevbench: out of memory\n");
+	}
+
+	zpercent = zswap_get_percent();
+	zswap_set_percent(0);
+
+	result = 0;
+	for (d = 0; d < 2 && result == 0; d++) {
+		result = swap_set_device(devs[d]);
+		if (result) {
+			kprintf(fmt, devs[d], strerror(result));
+			break;
+		}
+		result = vm5_run(devs[d]);
+	}
+
+	if (swap_set_device(saved)) {
+		kprintf(fmt, saved, "cannot restore the swap backend");
+	}
+	kfree(saved);
+	zswap_set_percent(zpercent);
+	for (i = 0; i < VM5_CLUSTER; i++) {
+		free_kpages(PADDR_TO_KVADDR(vm5_pa[i]));
+	}
+
+	if (result) {
+		return result;
+	}
+	kprintf("Swap backend benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm6
+
+#define VM6_NPAGES  VMC1_STACKPAGES  // Pagine dello stack del test ricaricate ad ogni giro
+#define VM6_ROUNDS  2000
+#define VM6_TAG(i)  (0x57ab0000 + (i))
+
+/*
+ * Invalida e ricarica VM6_ROUNDS volte le VM6_NPAGES pagine dello stack
+ * dell'address space corrente tramite vm_fault, verificando ogni volta il
+ * contenuto. Ritorna il tempo impiegato in nanosecondi, 0 in caso di errore.
+ */
+static
+uint64_t
+vm6_reload(vaddr_t base)
+{
+	struct timespec before;
+	uint64_t ns;
+	unsigned i, r;
+	vaddr_t va;
+
+	gettime(&before);
+	for (r = 0; r < VM6_ROUNDS; r++) {
+		for (i = 0; i < VM6_NPAGES; i++) {
+			va = base + i * PAGE_SIZE;
+			tlb_invalidate_va(va);
+			if (vm_fault(VM_FAULT_READ, va)) {
+				kprintf("vm6: fault on 0x%x failed\n", va);
+				return 0;
+			}
+		}
+	}
+	ns = vmtest_elapsed_ns(&before);
+
+	for (i = 0; i < VM6_NPAGES; i++) {
+		if (*(uint32_t *)(base + i * PAGE_SIZE) != VM6_TAG(i)) {
+			kprintf("vm6: bad data in page %u\n", i);
+			return 0;
+		}
+	}
+	return ns == 0 ? 1 : ns;
+}
+
+/*
+ * Benchmark della ricarica della TLB: crea un address space con il solo
+ * stack, ne tocca le pagine e misura il costo di una ricarica (TLB miss su
+ * una pagina residente) con il percorso completo, che cerca il segmento e
+ * percorre la page table, e con la cache software delle traduzioni.
+ */
+int
+vmstlbbench(int nargs, char **args)
+{
+	unsigned int before[N_STATS], after[N_STATS];
+	struct addrspace *as, *old;
+	uint64_t ns_walk, ns_stlb;
+	vaddr_t base;
+	unsigned i;
+	int enabled;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting software TLB benchmark...\n");
+
+	as = as_create();
+	if (as == NULL) {
+		panic("vmstlbbench: as_create failed\n");
+	}
+	seg_define_stack(as->stack);
+	base = as->stack->p_vaddr;
+
+	old = proc_setas(as);
+	as_activate();
+
+	for (i = 0; i < VM6_NPAGES; i++) {
+		if (vm_fault(VM_FAULT_WRITE, base + i * PAGE_SIZE)) {
+			panic("vmstlbbench: cannot touch the test stack\n");
+		}
+		*(uint32_t *)(base + i * PAGE_SIZE) = VM6_TAG(i);
+	}
+
+	enabled = vm_stlb_set_enabled(0);
+	ns_walk = vm6_reload(base);
+	vm_stlb_set_enabled(1);
+	get_statistics(before);
+	ns_stlb = vm6_reload(base);
+	get_statistics(after);
+	vm_stlb_set_enabled(enabled);
+
+	proc_setas(old);
+	as_activate();
+	tlb_invalidate_all();
+	as_destroy(as);
+
+	if (ns_walk == 0 || ns_stlb == 0) {
+		kprintf("vm6: FAILED\n");
+		return 1;
+	}
+	vmtest_report("reload, page table walk", ns_walk,
+		      (unsigned long)VM6_ROUNDS * VM6_NPAGES);
+	vmtest_report("reload, software TLB", ns_stlb,
+		      (unsigned long)VM6_ROUNDS * VM6_NPAGES);
+	kprintf("vm6: %u of %u reloads served by the software TLB\n",
+		after[STATISTICS_STLB_HIT] - before[STATISTICS_STLB_HIT],
+		VM6_ROUNDS * VM6_NPAGES);
+	kprintf("Software TLB benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm7
+
+#define VM7_NAS     2     // Address space che si alternano (ping-pong)
+#define VM7_NPAGES  8     // Pagine dello stack toccate da ogni address space ad ogni turno
+#define VM7_ROUNDS  500
+#define VM7_TAG(a, i) (0xa51d0000 + ((a) << 8) + (i))
+
+static struct addrspace *vm7_as[VM7_NAS];
+
+/*
+ * Alterna VM7_ROUNDS volte gli address space di vm7_as, come farebbe lo
+ * scheduler con processi brevi che si passano il controllo, leggendo ad ogni
+ * turno tutte le loro pagine: i TLB miss sono risolti da vm_fault. Ritorna
+ * il tempo impiegato in nanosecondi, 0 se una pagina non ha il contenuto atteso.
+ */
+static
+uint64_t
+vm7_pingpong(void)
+{
+	struct timespec before;
+	uint64_t ns;
+	unsigned r, a, i;
+	vaddr_t base;
+
+	gettime(&before);
+	for (r = 0; r < VM7_ROUNDS; r++) {
+		for (a = 0; a < VM7_NAS; a++) {
+			proc_setas(vm7_as[a]);
+			as_activate();
+			base = vm7_as[a]->stack->p_vaddr;
+			for (i = 0; i < VM7_NPAGES; i++) {
+				if (*(volatile uint32_t *)(base + i * PAGE_SIZE)
+				    != VM7_TAG(a, i)) {
+					kprintf("vm7: bad data in page %u of "
+						"address space %u\n", i, a);
+					return 0;
+				}
+			}
+		}
+	}
+	ns = vmtest_elapsed_ns(&before);
+	return ns == 0 ? 1 : ns;
+}
+
+/*
+ * Benchmark degli ASID: misura i TLB fault e le invalidazioni della TLB di
+ * VM7_NAS address space che si alternano sulla stessa CPU, prima svuotando
+ * la TLB ad ogni attivazione (comportamento senza ASID) e poi con gli ASID.
+ */
+int
+vmasidbench(int nargs, char **args)
+{
+	static const char *modes[2] = { "flush on switch", "ASID" };
+	unsigned int before[N_STATS], after[N_STATS];
+	struct addrspace *old;
+	uint64_t ns;
+	unsigned a, i, m;
+	vaddr_t base;
+	int enabled, result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting ASID ping-pong benchmark...\n");
+
+	old = proc_getas();
+	for (a = 0; a < VM7_NAS; a++) {
+		vm7_as[a] = as_create();
+		if (vm7_as[a] == NULL) {
+			panic("vmasidbench: as_create failed\n");
+		}
+		seg_define_stack(vm7_as[a]->stack);
+		proc_setas(vm7_as[a]);
+		as_activate();
+		base = vm7_as[a]->stack->p_vaddr;
+		for (i = 0; i < VM7_NPAGES; i++) {
+			*(uint32_t *)(base + i * PAGE_SIZE) = VM7_TAG(a, i);
+		}
+	}
+
+	result = 0;
+	enabled = tlb_asid_set_enabled(0);
+	for (m = 0; m < 2 && result == 0; m++) {
+		tlb_asid_set_enabled(m);
+		get_statistics(before);
+		ns = vm7_pingpong();
+		get_statistics(after);
+		if (ns == 0) {
+			result = 1;
+			break;
+		}
+		vmtest_report(modes[m], ns, (unsigned long)VM7_ROUNDS * VM7_NAS);
+		kprintf("vm7: %-16s %8u TLB faults, %8u TLB invalidations\n",
+			modes[m],
+			after[STATISTICS_TLB_FAULT] - before[STATISTICS_TLB_FAULT],
+			after[STATISTICS_TLB_INVALIDATE] -
+			before[STATISTICS_TLB_INVALIDATE]);
+	}
+	tlb_asid_set_enabled(enabled);
+
+	proc_setas(old);
+	as_activate();
+	for (a = 0; a < VM7_NAS; a++) {
+		as_destroy(vm7_as[a]);
+	}
+
+	if (result) {
+		kprintf("vm7: FAILED\n");
+		return result;
+	}
+	kprintf("ASID ping-pong benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm8
+
+#define VM8_NPAGES  VMC1_STACKPAGES  // Pagine dello stack del test, tutte residenti
+#define VM8_ROUNDS  2000
+
+/*
+ * Legge il registro c0_count, che avanza di uno ad ogni ciclo della CPU e
+ * viene azzerato dal timer: un campione con after < before va scartato.
+ */
+static
+uint32_t
+vm8_cycles(void)
+{
+	uint32_t count;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		"mfc0 %0, $9;"		/* c0_count */
+		".set pop"
+		: "=r" (count));
+	return count;
+}
+
+/*
+ * Esegue VM8_ROUNDS volte, su ogni pagina, la sequenza di accessi alla page
+ * table di un page fault su una pagina residente (lettura del frame e dello
+ * slot dello swap, aggiornamento della PTE), con le visite separate
+ * (fused == 0) o con un solo pt_walk. Ritorna la media in cicli per
+ * sequenza, 0 se una pagina non risulta residente.
+ */
+static
+unsigned
+vm8_walk(struct pt_directory *pt, vaddr_t base, int fused)
+{
+	uint64_t total;
+	uint32_t before, after;
+	unsigned long samples;
+	unsigned i, r;
+	paddr_t pa;
+	off_t offset;
+	pte_t *pte, entry;
+	vaddr_t va;
+	int spl;
+
+	total = 0;
+	samples = 0;
+	spl = splhigh();
+	for (r = 0; r < VM8_ROUNDS; r++) {
+		for (i = 0; i < VM8_NPAGES; i++) {
+			va = base + i * PAGE_SIZE;
+			before = vm8_cycles();
+			if (fused) {
+				pte = pt_walk(pt, va, 1);
+				entry = *pte;
+				pa = PTE_GET_PA(entry);
+				offset = PTE_GET_OFFSET(entry);
+				if (pa != PFN_NOT_USED) {
+					pte_set_pa(pte, pa);
+				}
+			}
+			else {
+				pa = pt_get_pa(pt, va);
+				offset = pt_get_offset(pt, va);
+				if (pa != PFN_NOT_USED) {
+					pt_set_pa(pt, va, pa);
+				}
+			}
+			after = vm8_cycles();
+			if (pa == PFN_NOT_USED || offset != -1) {
+				splx(spl);
+				kprintf("vm8: page 0x%x is not resident\n", va);
+				return 0;
+			}
+			if (after >= before) {
+				total += after - before;
+				samples++;
+			}
+		}
+	}
+	splx(spl);
+
+	if (samples == 0) {
+		return 0;
+	}
+	total /= samples;
+	return total == 0 ? 1 : (unsigned)total;
+}
+
+/*
+ * Microbenchmark della visita della page table nel page fault: misura con il
+ * contatore dei cicli (c0_count) il costo della sequenza lettura-aggiornamento
+ * della PTE con una visita per operazione (pt_get_pa, pt_get_offset,
+ * pt_set_pa) e con un'unica visita (pt_walk e handle), poi il costo di una
+ * ricarica completa della TLB tramite vm_fault.
+ */
+int
+vmptbench(int nargs, char **args)
+{
+	struct addrspace *as, *old;
+	unsigned cyc_split, cyc_fused, cyc_fault;
+	uint32_t before, after;
+	uint64_t total;
+	unsigned long samples;
+	vaddr_t base, va;
+	unsigned i, r;
+	int enabled;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting page table walk benchmark...\n");
+
+	as = as_create();
+	if (as == NULL) {
+		panic("vmptbench: as_create failed\n");
+	}
+	seg_define_stack(as->stack);
+	base = as->stack->p_vaddr;
+
+	old = proc_setas(as);
+	as_activate();
+
+	for (i = 0; i < VM8_NPAGES; i++) {
+		if (vm_fault(VM_FAULT_WRITE, base + i * PAGE_SIZE)) {
+			panic("vmptbench: cannot touch the test stack\n");
+		}
+	}
+
+	cyc_split = vm8_walk(as->pt, base, 0);
+	cyc_fused = vm8_walk(as->pt, base, 1);
+
+	// Ricarica completa, senza la cache software delle traduzioni
+	enabled = vm_stlb_set_enabled(0);
+	total = 0;
+	samples = 0;
+	for (r = 0; r < VM8_ROUNDS / 10; r++) {
+		for (i = 0; i < VM8_NPAGES; i++) {
+			va = base + i * PAGE_SIZE;
+			tlb_invalidate_va(va);
+			before = vm8_cycles();
+			if (vm_fault(VM_FAULT_READ, va)) {
+				panic("vmptbench: fault on 0x%x failed\n", va);
+			}
+			after = vm8_cycles();
+			if (after >= before) {
+				total += after - before;
+				samples++;
+			}
+		}
+	}
+	vm_stlb_set_enabled(enabled);
+	cyc_fault = samples > 0 ? (unsigned)(total / samples) : 0;
+
+	proc_setas(old);
+	as_activate();
+	tlb_invalidate_all();
+	as_destroy(as);
+
+	if (cyc_split == 0 || cyc_fused == 0) {
+		kprintf("vm8: FAILED\n");
+		return 1;
+	}
+	kprintf("vm8: %-28s %8u cycles/op\n", "lookup+update, separate", cyc_split);
+	kprintf("vm8: %-28s %8u cycles/op\n", "lookup+update, pt_walk", cyc_fused);
+	kprintf("vm8: %-28s %8u cycles/op\n", "TLB reload via vm_fault", cyc_fault);
+	kprintf("Page table walk benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm9
+
+#define VM9_PROGRAM  "testbin/matmult"
+
+/*
+ * Carica il programma path in un nuovo address space e ne tocca in ordine
+ * tutte le pagine di codice e dati tramite vm_fault, come all'avvio di un
+ * processo, con la finestra di fault-around window. Riporta il tempo
+ * impiegato e le letture dall'ELF.
+ */
+static
+int
+vm9_startup(const char *path, unsigned window)
+{
+	unsigned int before[N_STATS], after[N_STATS];
+	struct segment *segs[2];
+	struct addrspace *as, *old;
+	struct timespec start;
+	struct vnode *v;
+	char *progname;
+	vaddr_t entrypoint, va, top;
+	unsigned long pages;
+	uint64_t ns;
+	unsigned i;
+	int result;
+
+	progname = kstrdup(path);	/* vfs_open modifica il nome */
+	if (progname == NULL) {
+		return ENOMEM;
+	}
+	result = vfs_open(progname, O_RDONLY, 0, &v);
+	kfree(progname);
+	if (result) {
+		kprintf("vm9: %s: %s\n", path, strerror(result));
+		return result;
+	}
+
+	as = as_create();
+	if (as == NULL) {
+		panic("vmelfbench: as_create failed\n");
+	}
+	old = proc_setas(as);
+	as_activate();
+
+	result = load_elf(v, &entrypoint);
+	if (result) {
+		kprintf("vm9: load_elf: %s\n", strerror(result));
+		proc_setas(old);
+		as_activate();
+		if (as->code->vnode == NULL) {
+			vfs_close(v);
+		}
+		as_destroy(as);
+		return result;
+	}
+
+	seg_set_faultaround(window);
+	segs[0] = as->code;
+	segs[1] = as->data;
+	pages = 0;
+	get_statistics(before);
+	gettime(&start);
+	for (i = 0; i < 2 && result == 0; i++) {
+		top = segs[i]->p_vaddr + segs[i]->p_memsz;
+		for (va = segs[i]->p_vaddr; va < top;
+		     va = (va & PAGE_FRAME) + PAGE_SIZE) {
+			result = vm_fault(VM_FAULT_READ, va);
+			if (result) {
+				kprintf("vm9: fault on 0x%x failed\n", va);
+				break;
+			}
+			pages++;
+		}
+	}
+	ns = vmtest_elapsed_ns(&start);
+	get_statistics(after);
+
+	proc_setas(old);
+	as_activate();
+	as_destroy(as);
+
+	if (result == 0) {
+		kprintf("vm9: fault-around %2u: %4lu pages, %4u ELF reads, "
+			"%4u pages around, %8llu ns\n", window, pages,
+			after[STATISTICS_ELF_FILE_READ] -
+			before[STATISTICS_ELF_FILE_READ],
+			after[STATISTICS_ELF_FAULTAROUND] -
+			before[STATISTICS_ELF_FAULTAROUND],
+			(unsigned long long)ns);
+	}
+	return result;
+}
+
+/*
+ * Benchmark del fault-around: simula l'avvio del programma indicato
+ * (predefinito VM9_PROGRAM) senza fault-around e con finestre crescenti,
+ * confrontando le letture dall'ELF (una VOP_READ ciascuna) e il tempo.
+ */
+int
+vmelfbench(int nargs, char **args)
+{
+	static const unsigned windows[] = { 0, 2, 4, 8, SEG_FAULTAROUND_MAX };
+	const char *path;
+	unsigned saved, i;
+	int result;
+
+	if (nargs > 2) {
+		kprintf("Usage: vm9 [program]\n");
+		return EINVAL;
+	}
+	path = nargs == 2 ? args[1] : VM9_PROGRAM;
+
+	kprintf("Starting ELF fault-around benchmark on %s...\n", path);
+
+	saved = seg_get_faultaround();
+	result = 0;
+	for (i = 0; i < sizeof(windows) / sizeof(windows[0]) && result == 0; i++) {
+		result = vm9_startup(path, windows[i]);
+	}
+	seg_set_faultaround(saved);
+
+	if (result) {
+		kprintf("vm9: FAILED\n");
+		return result;
+	}
+	kprintf("ELF fault-around benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm10
+
+#define VM10_NPAGES  VMC1_STACKPAGES  // Pagine dello stack azzerate ad ogni giro
+#define VM10_ROUNDS  200
+
+/*
+ * Esegue VM10_ROUNDS giri di page fault su pagine da azzerare: ad ogni giro
+ * tocca in scrittura le VM10_NPAGES pagine dello stack di as, verifica che
+ * siano azzerate e le rimuove dalla page table. Con use_pool, prima di ogni
+ * giro la riserva di frame azzerati viene riempita come farebbe il ciclo
+ * idle; solo i fault sono cronometrati. Ritorna il tempo totale dei fault in
+ * nanosecondi, 0 in caso di errore.
+ */
+static
+uint64_t
+vm10_run(struct addrspace *as, int use_pool)
+{
+	struct timespec before;
+	uint64_t ns;
+	unsigned i, r, w;
+	vaddr_t base, va;
+	int enabled;
+
+	base = as->stack->p_vaddr;
+	enabled = coremap_zero_pool_set_enabled(use_pool);
+	ns = 0;
+	for (r = 0; r < VM10_ROUNDS; r++) {
+		while (coremap_zero_pool_fill()) {
+			/* riempie la riserva (nulla se disattivata) */
+		}
+
+		gettime(&before);
+		for (i = 0; i < VM10_NPAGES; i++) {
+			if (vm_fault(VM_FAULT_WRITE, base + i * PAGE_SIZE)) {
+				kprintf("vm10: fault on 0x%x failed\n", base + i * PAGE_SIZE);
+				coremap_zero_pool_set_enabled(enabled);
+				return 0;
+			}
+		}
+		ns += vmtest_elapsed_ns(&before);
+
+		for (i = 0; i < VM10_NPAGES; i++) {
+			va = base + i * PAGE_SIZE;
+			for (w = 0; w < PAGE_SIZE; w += sizeof(uint32_t)) {
+				if (*(uint32_t *)(va + w) != 0) {
+					kprintf("vm10: page 0x%x not zeroed\n", va);
+					coremap_zero_pool_set_enabled(enabled);
+					return 0;
+				}
+			}
+			*(uint32_t *)va = 0xdeadbeef; // Il prossimo frame deve essere azzerato di nuovo
+		}
+
+		// Come la riduzione dell'heap: traduzioni invalidate, poi pagine rimosse
+		tlb_asid_renew(as);
+		as_activate();
+		as->stlb_gen++;
+		pt_unmap(as->pt, base, USERSTACK);
+	}
+	coremap_zero_pool_set_enabled(enabled);
+	return ns == 0 ? 1 : ns;
+}
+
+/*
+ * Benchmark della riserva di frame azzerati: misura la latenza dei page
+ * fault su pagine dello stack (da azzerare) azzerando il frame durante il
+ * fault e prendendolo dalla riserva, e riporta la percentuale di fault
+ * serviti dalla riserva.
+ */
+int
+vmzerobench(int nargs, char **args)
+{
+	struct addrspace *as, *old;
+	uint64_t ns_inline, ns_pool;
+	unsigned hits1, misses1, hits2, misses2, total;
+	unsigned long nfaults;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting zero-page pool benchmark...\n");
+
+	as = as_create();
+	if (as == NULL) {
+		panic("vmzerobench: as_create failed\n");
+	}
+	seg_define_stack(as->stack);
+
+	old = proc_setas(as);
+	as_activate();
+
+	ns_inline = vm10_run(as, 0);
+	coremap_zero_pool_stats(&hits1, &misses1);
+	ns_pool = vm10_run(as, 1);
+	coremap_zero_pool_stats(&hits2, &misses2);
+
+	proc_setas(old);
+	as_activate();
+	tlb_invalidate_all();
+	as_destroy(as);
+
+	if (ns_inline == 0 || ns_pool == 0) {
+		kprintf("vm10: FAILED\n");
+		return 1;
+	}
+	nfaults = (unsigned long)VM10_ROUNDS * VM10_NPAGES;
+	vmtest_report("zero-fill fault, inline", ns_inline, nfaults);
+	vmtest_report("zero-fill fault, pool", ns_pool, nfaults);
+	total = hits2 - hits1 + misses2 - misses1;
+	kprintf("vm10: pool enabled: %u hits, %u misses (%u%% hit rate)\n",
+		hits2 - hits1, misses2 - misses1,
+		total == 0 ? 0 : (hits2 - hits1) * 100 / total);
+	kprintf("Zero-page pool benchmark done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm11
+
+#define VM11_ROUNDS  200
+#define VM11_OFFSET  ((off_t)1 << 40)  // Nessuno slot reale dello swap ha questo offset
+
+static const char *vm11_names[] = { "zero", "small ints", "pointers", "random" };
+
+// Riempie la pagina words con il contenuto di prova numero pattern
+static
+void
+vm11_fill(uint32_t *words, unsigned pattern)
+{
+	uint32_t seed = 12345;
+	unsigned i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+		switch (pattern) {
+		case 0:
+			words[i] = 0;
+			break;
+		case 1:
+			/* Contatori a piccoli valori ripetuti */
+			words[i] = i / 32;
+			break;
+		case 2:
+			/* Strutture di 16 byte con un puntatore e campi nulli */
+			words[i] = i % 4 == 0 ? 0x80041000 + i * 4 : 0;
+			break;
+		default:
+			seed = seed * 1103515245 + 12345;
+			words[i] = seed;
+			break;
+		}
+	}
+}
+
+// Confronta due pagine parola per parola
+static
+int
+vm11_same(const uint32_t *a, const uint32_t *b)
+{
+	unsigned i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+		if (a[i] != b[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Test della cache compressa dello swap: per ogni contenuto di prova
+ * comprime la pagina in uno slot fittizio, la decomprime in un'altra pagina
+ * e verifica che sia identica (le pagine non comprimibili non devono essere
+ * nella cache). Poi confronta il costo di uno swap-out seguito da uno
+ * swap-in tramite la cache e tramite il disco.
+ */
+int
+vmzswaptest(int nargs, char **args)
+{
+	unsigned int before[N_STATS], after[N_STATS];
+	struct timespec start;
+	vaddr_t src, dst;
+	paddr_t pa;
+	uint64_t ns_zswap, ns_disk;
+	unsigned p, r, zpercent;
+	off_t offset;
+	int stored, result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting compressed swap cache test...\n");
+
+	src = alloc_kpages(1);
+	dst = alloc_kpages(1);
+	if (src == 0 || dst == 0) {
+		panic("vmzswaptest: alloc_kpages failed\n");
+	}
+	pa = src - MIPS_KSEG0;
+	zpercent = zswap_get_percent();
+	if (zpercent == 0) {
+		zswap_set_percent(ZSWAP_PERCENT);
+	}
+
+	result = 0;
+	for (p = 0; p < 4 && result == 0; p++) {
+		vm11_fill((uint32_t *)src, p);
+		bzero((void *)dst, PAGE_SIZE);
+		get_statistics(before);
+		stored = zswap_store(pa, VM11_OFFSET);
+		get_statistics(after);
+		if (zswap_load(dst - MIPS_KSEG0, VM11_OFFSET) != stored) {
+			kprintf("vm11: %s: load does not match store\n", vm11_names[p]);
+			result = EIO;
+		}
+		else if (stored && !vm11_same((uint32_t *)src, (uint32_t *)dst)) {
+			kprintf("vm11: %s: bad data after decompression\n", vm11_names[p]);
+			result = EIO;
+		}
+		else if (stored) {
+			kprintf("vm11: %-12s compressed to %u bytes\n", vm11_names[p],
+				after[STATISTICS_ZSWAP_BYTES] - before[STATISTICS_ZSWAP_BYTES]);
+		}
+		else {
+			kprintf("vm11: %-12s not compressible, sent to disk\n", vm11_names[p]);
+		}
+		zswap_invalidate(VM11_OFFSET);
+		if (zswap_load(dst - MIPS_KSEG0, VM11_OFFSET)) {
+			kprintf("vm11: %s: slot still cached after invalidate\n", vm11_names[p]);
+			result = EIO;
+		}
+	}
+
+	if (result == 0) {
+		/* Swap-out e swap-in di una pagina tipica, dalla cache e dal disco */
+		vm11_fill((uint32_t *)src, 2);
+		gettime(&start);
+		for (r = 0; r < VM11_ROUNDS; r++) {
+			zswap_store(pa, VM11_OFFSET);
+			zswap_load(dst - MIPS_KSEG0, VM11_OFFSET);
+		}
+		ns_zswap = vmtest_elapsed_ns(&start);
+		zswap_invalidate(VM11_OFFSET);
+
+		zswap_set_percent(0);
+		offset = -1;
+		gettime(&start);
+		for (r = 0; r < VM11_ROUNDS; r++) {
+			swap_out_batch(&pa, 1, &offset);
+			result = swap_read(dst - MIPS_KSEG0, offset);
+			if (result) {
+				break;
+			}
+		}
+		ns_disk = vmtest_elapsed_ns(&start);
+		if (offset >= 0) {
+			swap_free(offset);
+		}
+		if (result == 0) {
+			vmtest_report("swap out+in, compressed", ns_zswap, VM11_ROUNDS);
+			vmtest_report("swap out+in, disk", ns_disk, VM11_ROUNDS);
+		}
+	}
+
+	zswap_set_percent(zpercent);
+	free_kpages(src);
+	free_kpages(dst);
+
+	if (result) {
+		kprintf("vm11: FAILED\n");
+		return 1;
+	}
+	kprintf("Compressed swap cache test done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm12
+
+#define VM12_NPAGES  VMC1_STACKPAGES  // Pagine dello stack del padre, condivise con il figlio
+#define VM12_TAG(a, i)  (0xf0c40000 + ((a) << 8) + (i))
+
+/*
+ * Tocca in scrittura, dall'alto, fino a npages pagine dello stack
+ * dell'address space corrente, scrivendo VM12_TAG(a, i) nella pagina i.
+ * Ritorna il numero di pagine toccate: lo stack smette di crescere al
+ * limite impostato con stackmax.
+ */
+static
+unsigned
+vm12_touch(unsigned npages, unsigned a)
+{
+	unsigned i;
+	vaddr_t va;
+
+	for (i = 0; i < npages; i++) {
+		va = USERSTACK - (i + 1) * PAGE_SIZE;
+		if (vm_fault(VM_FAULT_WRITE, va)) {
+			break;
+		}
+		*(uint32_t *)va = VM12_TAG(a, i);
+	}
+	return i;
+}
+
+// Verifica il contenuto delle VM12_NPAGES pagine di as, che diventa l'address space corrente
+static
+int
+vm12_check(struct addrspace *as, unsigned a)
+{
+	unsigned i;
+	vaddr_t va;
+
+	proc_setas(as);
+	as_activate();
+	for (i = 0; i < VM12_NPAGES; i++) {
+		va = USERSTACK - (i + 1) * PAGE_SIZE;
+		if (*(volatile uint32_t *)va != VM12_TAG(a, i)) {
+			kprintf("vm12: bad data in page %u of address space %u\n", i, a);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Pagine delle VM12_NPAGES di as ancora residenti
+static
+unsigned
+vm12_resident(struct addrspace *as)
+{
+	unsigned i, n;
+	pte_t *pte;
+
+	n = 0;
+	for (i = 0; i < VM12_NPAGES; i++) {
+		pte = pt_walk(as->pt, USERSTACK - (i + 1) * PAGE_SIZE, 0);
+		if (pte != NULL && PTE_GET_PA(*pte) != PFN_NOT_USED) {
+			n++;
+		}
+	}
+	return n;
+}
+
+/*
+ * Sovraccarica la memoria: crea address space il cui stack, nel complesso,
+ * occupa piu' pagine di quanti sono i frame della RAM, poi li distrugge.
+ * Restituisce 1 se non e' stato possibile toccare abbastanza pagine.
+ */
+static
+int
+vm12_overcommit(void)
+{
+	struct addrspace **pressure;
+	unsigned total, touched, n, max, i;
+
+	total = coremap_total_frames() + VM12_NPAGES;
+	max = total / VMC1_STACKPAGES + 1;
+	pressure = kmalloc(max * sizeof(struct addrspace *));
+	if (pressure == NULL) {
+		return 1;
+	}
+
+	touched = 0;
+	for (n = 0; n < max && touched < total; n++) {
+		pressure[n] = as_create();
+		if (pressure[n] == NULL) {
+			break;
+		}
+		seg_define_stack(pressure[n]->stack);
+		proc_setas(pressure[n]);
+		as_activate();
+		touched += vm12_touch(VMC1_STACKMAXPAGES, VM12_NPAGES);
+	}
+
+	proc_setas(NULL);
+	as_activate();
+	for (i = 0; i < n; i++) {
+		as_destroy(pressure[i]);
+	}
+	kfree(pressure);
+	return touched < total;
+}
+
+/*
+ * Test della paginazione dei frame condivisi: un address space con
+ * VM12_NPAGES pagine dello stack viene duplicato come in una fork, poi la
+ * memoria viene sovraccaricata. Le pagine condivise devono poter essere
+ * portate nello swap (aggiornando entrambe le page table tramite la mappa
+ * inversa) e rilette con il contenuto giusto da entrambi; il figlio le
+ * riscrive in copy-on-write. Dopo l'uscita del figlio le pagine rimaste al
+ * solo padre devono tornare sostituibili.
+ */
+int
+vmforktest(int nargs, char **args)
+{
+	struct addrspace *parent, *child, *old;
+	unsigned i, shared, evicted_shared, evicted_exited;
+	vaddr_t va;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting fork under memory pressure test...\n");
+
+	old = proc_getas();
+	parent = as_create();
+	if (parent == NULL) {
+		panic("vmforktest: as_create failed\n");
+	}
+	seg_define_stack(parent->stack);
+	proc_setas(parent);
+	as_activate();
+	if (vm12_touch(VM12_NPAGES, 0) != VM12_NPAGES) {
+		panic("vmforktest: cannot touch the test stack\n");
+	}
+
+	child = NULL;
+	result = as_copy(parent, &child);
+	if (result) {
+		kprintf("vm12: as_copy failed: %s\n", strerror(result));
+		goto out;
+	}
+	shared = 0;
+	for (i = 0; i < VM12_NPAGES; i++) {
+		va = USERSTACK - (i + 1) * PAGE_SIZE;
+		if (pt_get_pa(parent->pt, va) != PFN_NOT_USED &&
+		    pt_get_pa(parent->pt, va) == pt_get_pa(child->pt, va)) {
+			shared++;
+		}
+	}
+	kprintf("vm12: %u of %u pages shared after the copy\n", shared, VM12_NPAGES);
+
+	// Fork seguita da un sovraccarico della memoria, con il figlio ancora vivo
+	result = vm12_overcommit();
+	evicted_shared = VM12_NPAGES - vm12_resident(parent);
+	if (result == 0 && evicted_shared == 0) {
+		kprintf("vm12: no shared page was evicted\n");
+		result = 1;
+	}
+	if (result == 0) {
+		result = vm12_check(parent, 0) || vm12_check(child, 0);
+	}
+	if (result == 0) {
+		// Il figlio riscrive le sue pagine: il padre deve continuare a vedere le proprie
+		for (i = 0; i < VM12_NPAGES; i++) {
+			*(uint32_t *)(USERSTACK - (i + 1) * PAGE_SIZE) = VM12_TAG(1, i);
+		}
+		result = vm12_check(parent, 0) || vm12_check(child, 1);
+	}
+
+	// Uscita del figlio: le pagine rimaste al solo padre devono poter uscire dalla RAM
+	proc_setas(parent);
+	as_activate();
+	as_destroy(child);
+	child = NULL;
+	if (result == 0) {
+		result = vm12_overcommit();
+		evicted_exited = VM12_NPAGES - vm12_resident(parent);
+		if (result == 0 && evicted_exited == 0) {
+			kprintf("vm12: no page was evicted after the child exited\n");
+			result = 1;
+		}
+		if (result == 0) {
+			result = vm12_check(parent, 0);
+		}
+		if (result == 0) {
+			kprintf("vm12: %u of %u shared pages evicted, %u after the child exited\n",
+				evicted_shared, VM12_NPAGES, evicted_exited);
+		}
+	}
+
+out:
+	proc_setas(old);
+	as_activate();
+	tlb_invalidate_all();
+	if (child != NULL) {
+		as_destroy(child);
+	}
+	as_destroy(parent);
+
+	if (result) {
+		kprintf("vm12: FAILED\n");
+		return 1;
+	}
+	kprintf("Fork under memory pressure test done\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vm13
+
+#define VM13_NAS 3  // Address space che condividono la pagina di codice
+
+static char vm13_file;  // Chiave della pagina nella cache, al posto del vnode dell'eseguibile
+
+/*
+ * Test della sostituzione delle pagine di codice condivise: una pagina
+ * pulita entra nella cache delle pagine come se fosse stata letta dall'ELF
+ * e viene mappata da VM13_NAS address space, i successivi tramite
+ * pagecache_lookup come in vm_fault. Dopo un sovraccarico della memoria il
+ * frame deve essere stato sostituito: tutte le PTE a 0 (pagina da rileggere
+ * dall'ELF) e la pagina non piu' presente nella cache.
+ */
+int
+vmtextevicttest(int nargs, char **args)
+{
+	struct addrspace *as[VM13_NAS], *old;
+	struct vnode *vn;
+	pte_t *pte;
+	paddr_t pa;
+	vaddr_t va;
+	unsigned i, evicted;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting shared text eviction test...\n");
+
+	old = proc_getas();
+	vn = (struct vnode *)&vm13_file;
+	va = USERSTACK - PAGE_SIZE;
+	for (i = 0; i < VM13_NAS; i++) {
+		as[i] = as_create();
+		if (as[i] == NULL) {
+			panic("vmtextevicttest: as_create failed\n");
+		}
+		seg_define_stack(as[i]->stack);
+	}
+
+	// Primo address space: la pagina viene "letta" e inserita nella cache
+	proc_setas(as[0]);
+	as_activate();
+	pa = page_alloc_as(as[0], va);
+	if (pa == 0) {
+		panic("vmtextevicttest: page_alloc_as failed\n");
+	}
+	for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+		((uint32_t *)PADDR_TO_KVADDR(pa))[i] = 0xc0de0000 + i;
+	}
+	result = pagecache_insert(vn, 0, pa) == 0;
+	pt_set_pa(as[0]->pt, va, pa);
+	coremap_publish(pa, 0, -1);
+
+	// Gli altri la trovano nella cache
+	for (i = 1; i < VM13_NAS && result == 0; i++) {
+		pte = pt_walk(as[i]->pt, va, 1);
+		if (pte == NULL || pagecache_lookup(vn, 0, as[i], va, pte) != pa) {
+			kprintf("vm13: page not shared with address space %u\n", i);
+			result = 1;
+		}
+	}
+
+	if (result == 0) {
+		result = vm12_overcommit();
+	}
+	if (result == 0) {
+		evicted = 0;
+		for (i = 0; i < VM13_NAS; i++) {
+			pte = pt_walk(as[i]->pt, va, 0);
+			if (pte != NULL && *pte == 0) {
+				evicted++;
+			}
+		}
+		if (evicted != VM13_NAS) {
+			kprintf("vm13: %u of %u mappings cleared\n", evicted, VM13_NAS);
+			result = 1;
+		}
+	}
+	if (result == 0) {
+		// Le PTE sono a 0, quindi il frame e' stato liberato: la ricerca non deve trovarlo
+		pte = pt_walk(as[0]->pt, va, 1);
+		if (pagecache_lookup(vn, 0, as[0], va, pte) != 0) {
+			kprintf("vm13: evicted page still in the page cache\n");
+			result = 1;
+		}
+	}
+
+	proc_setas(old);
+	as_activate();
+	tlb_invalidate_all();
+	for (i = 0; i < VM13_NAS; i++) {
+		as_destroy(as[i]);
+	}
+
+	if (result) {
+		kprintf("vm13: FAILED\n");
+		return 1;
+	}
+	kprintf("Shared text eviction test done\n");
+	return 0;
+}
@@ -47,8 +47,11 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <membar.h>
 #include <addrspace.h>
+#include <vm.h>
 #include <mainbus.h>
+#include <platform/maxcpus.h>
 #include <vnode.h>
 #include "opt-dumbvm.h"
 
@@ -190,6 +193,8 @@ cpu_create(unsigned hardware_number)
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_shootdown_req = 0;
+	c->c_shootdown_done = 0;
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
@@ -567,6 +572,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
 	int spl;
+#if !OPT_DUMBVM
+	int zspl, zeroed;
+#endif
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
 	DEBUGASSERT(curthread->t_cpu == curcpu->c_self);
@@ -648,7 +656,22 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+#if !OPT_DUMBVM
+			/*
+			 * Use the idle time to zero one free frame for the
+			 * VM system, with interrupts enabled as in
+			 * cpu_idle, then look at the runqueue again. Only
+			 * idle once there is nothing left to zero.
+			 */
+			zspl = spl0();
+			zeroed = coremap_zero_pool_fill();
+			splx(zspl);
+			if (!zeroed) {
+				cpu_idle();
+			}
+#else
 			cpu_idle();
+#endif
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -1136,36 +1159,95 @@ ipi_broadcast(int code)
 
 /*
  * Send a TLB shootdown IPI to the specified CPU.
+ *
+ * The request is first merged into an already queued one if the VM
+ * system says they can be coalesced. If the queue is full, the whole
+ * TLB of the target is flushed instead. Returns a ticket for
+ * ipi_tlbshootdown_wait.
  */
-void
+unsigned
 ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 {
-	unsigned n;
+	unsigned i, n, ticket;
 
 	spinlock_acquire(&target->c_ipi_lock);
 
 	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
-		/*
-		 * If you have problems with this panic going off,
-		 * consider: (1) increasing the maximum, (2) putting
-		 * logic here to sleep until space appears (may
-		 * interact awkwardly with VM system locking), (3)
-		 * putting logic here to coalesce requests together,
-		 * and/or (4) improving VM system state tracking to
-		 * reduce the number of unnecessary shootdowns.
-		 */
-		panic("ipi_tlbshootdown: Too many shootdowns queued\n");
+	if (n == TLBSHOOTDOWN_ALL) {
+		/* Already flushing everything; nothing to add. */
 	}
 	else {
-		target->c_shootdown[n] = *mapping;
-		target->c_numshootdown = n+1;
+		for (i=0; i<n; i++) {
+			if (vm_tlbshootdown_merge(&target->c_shootdown[i],
+						  mapping)) {
+				break;
+			}
+		}
+		if (i < n) {
+			/* coalesced */
+		}
+		else if (n == TLBSHOOTDOWN_MAX) {
+			target->c_numshootdown = TLBSHOOTDOWN_ALL;
+		}
+		else {
+			target->c_shootdown[n] = *mapping;
+			target->c_numshootdown = n+1;
+		}
 	}
+	ticket = ++target->c_shootdown_req;
 
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
 	mainbus_send_ipi(target);
 
 	spinlock_release(&target->c_ipi_lock);
+	return ticket;
+}
+
+/*
+ * Wait until TARGET has carried out the shootdown identified by
+ * TICKET. Interrupts must be enabled, so that shootdowns sent to us
+ * by a CPU that is in turn waiting for us can still be handled.
+ */
+void
+ipi_tlbshootdown_wait(struct cpu *target, unsigned ticket)
+{
+	KASSERT(curthread->t_curspl == 0);
+	KASSERT(curcpu->c_spinlocks == 0);
+
+	while ((int)(target->c_shootdown_done - ticket) < 0) {
+		/* spin; the target acknowledges from its IPI handler */
+		membar_any_any();
+	}
+}
+
+/*
+ * Send a batch of TLB shootdowns to all CPUs except the current one,
+ * then wait until every one of them has completed the whole batch.
+ */
+void
+ipi_tlbshootdown_broadcast(const struct tlbshootdown *mappings, unsigned n)
+{
+	unsigned i, j;
+	unsigned tickets[MAXCPUS];
+	struct cpu *c;
+
+	KASSERT(cpuarray_num(&allcpus) <= MAXCPUS);
+
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		tickets[i] = 0;
+		if (c != curcpu->c_self) {
+			for (j=0; j<n; j++) {
+				tickets[i] = ipi_tlbshootdown(c, &mappings[j]);
+			}
+		}
+	}
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != curcpu->c_self && n > 0) {
+			ipi_tlbshootdown_wait(c, tickets[i]);
+		}
+	}
 }
 
 /*
@@ -1209,10 +1291,16 @@ interprocessor_interrupt(void)
 		 * need to release the ipi lock while calling
 		 * vm_tlbshootdown.
 		 */
-		for (i=0; i<curcpu->c_numshootdown; i++) {
-			vm_tlbshootdown(&curcpu->c_shootdown[i]);
+		if (curcpu->c_numshootdown == TLBSHOOTDOWN_ALL) {
+			vm_tlbshootdown_all();
+		}
+		else {
+			for (i=0; i<curcpu->c_numshootdown; i++) {
+				vm_tlbshootdown(&curcpu->c_shootdown[i]);
+			}
 		}
 		curcpu->c_numshootdown = 0;
+		curcpu->c_shootdown_done = curcpu->c_shootdown_req;
 	}
 
 	curcpu->c_ipi_pending = 0;
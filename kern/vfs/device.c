@@ -242,9 +242,12 @@ null_fsync(struct vnode *v)
  */
 static
 int
-dev_mmap(struct vnode *v  /* add stuff as needed */)
+dev_mmap(struct vnode *v, off_t offset, size_t len, int prot)
 {
 	(void)v;
+	(void)offset;
+	(void)len;
+	(void)prot;
 	return ENOSYS;
 }
 
@@ -36,6 +36,10 @@
 #include <proc.h>
 #include <elf.h>
 #include <vfs.h>
+#include <vnode.h>
+#include <uio.h>
+#include <kern/stat.h>
+#include <kern/mman.h>
 #include <mips/tlb.h>
 #include <swapfile.h>
 #include <segments.h>
@@ -56,18 +60,35 @@
  * used. The cheesy hack versions in dumbvm.c are used instead.
  */
 
+// Pagine che lo stack puo' raggiungere crescendo (comando stackmax del menu)
+static unsigned int as_stack_maxpages = VMC1_STACKMAXPAGES;
+
 struct addrspace* as_create(void) {
+    int i;
     struct addrspace* as = kmalloc(sizeof(struct addrspace));
     if (as == NULL) {
         return NULL;
     }
 
+    // Cache software delle traduzioni vuota
+    for (i = 0; i < STLB_SIZE; i++) {
+        as->stlb[i].vpn = STLB_NO_VPN;
+        as->stlb[i].elo = 0;
+        as->stlb[i].gen = 0;
+    }
+    as->stlb_gen = 1;
+    as->asid = 0; // L'ASID viene assegnato alla prima attivazione
+
     // creazione segmenti per le tre parti dell'addrspace
 	as->code = seg_create();
 	as->data = seg_create();
 	as->stack = seg_create();
-	as->pt = pt_create(); // Creazione della page table
-	swapfile_init();
+	as->heap = seg_create(); // Definito da as_complete_load, dopo i segmenti dell'ELF
+	for (i = 0; i < AS_MAXMMAP; i++) {
+		as->mmaps[i] = NULL;
+	}
+	as->pt = pt_create(as); // Creazione della page table
+	// Lo swap e' condiviso da tutti i processi ed e' gia' aperto da vm_bootstrap
     return as;
 }
 
@@ -76,37 +97,123 @@ int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *newas;
-	int result;
+	struct segment *heap;
+	int result, i;
 
 	newas = as_create();
 	if (newas==NULL) {
 		return ENOMEM;
 	}
 
+	// In caso di errore as_destroy rilascia quanto gia' copiato: ogni vnode
+	// riceve il suo riferimento subito dopo la copia del segmento
 	result = seg_copy(old->code, &newas->code);
-	KASSERT(result == 0);
+	if (result) {
+		goto fail;
+	}
+	if (newas->code->vnode != NULL) {
+		// as_destroy chiude il vnode dell'eseguibile: il figlio ne tiene un riferimento proprio
+		VOP_INCREF(newas->code->vnode);
+	}
 	result = seg_copy(old->data, &newas->data);
-	KASSERT(result == 0);
+	if (result) {
+		goto fail;
+	}
 	result = seg_copy(old->stack, &newas->stack);
-	KASSERT(result == 0);
-	newas->pt = old->pt; // Copia della page table
+	if (result) {
+		goto fail;
+	}
+	result = seg_copy(old->heap, &heap);
+	if (result) {
+		goto fail;
+	}
+	seg_destroy(newas->heap); // Sostituito dalla copia di quello del padre
+	newas->heap = heap;
+	// Le regioni di mmap restano al loro indirizzo; anche quelle condivise
+	// diventano copy-on-write, come il resto dell'address space
+	for (i = 0; i < AS_MAXMMAP; i++) {
+		if (old->mmaps[i] != NULL) {
+			result = seg_copy(old->mmaps[i], &newas->mmaps[i]);
+			if (result) {
+				goto fail;
+			}
+			VOP_INCREF(newas->mmaps[i]->vnode);
+		}
+	}
+
+	// Copy-on-write: le pagine residenti sono condivise, non copiate, e
+	// quelle nello swap condividono lo slot
+	result = pt_copy(old->pt, newas->pt, newas);
+	if (result) {
+		goto fail;
+	}
+
+	/*
+	 * Le voci TLB del padre possono ancora permettere la scrittura sulle
+	 * pagine ora condivise, anche sulle CPU dove ha girato in precedenza:
+	 * il padre riceve un nuovo ASID, cosi' che nessuna di quelle voci venga
+	 * piu' usata, e alla prossima ricarica vm_fault le mappera' in sola lettura.
+	 */
+	tlb_asid_renew(old);
+	if (old == proc_getas()) {
+		as_activate();
+	}
+	// Lo stesso vale per le traduzioni scrivibili nella cache software del padre
+	old->stlb_gen++;
 
 	*ret = newas;
 	return 0;
+
+fail:
+	// as_destroy rilascia i riferimenti del figlio a frame e slot: le pagine
+	// tornano al solo padre, le cui voci TLB scrivibili restano valide
+	as_destroy(newas);
+	return result;
+}
+
+/*
+ * Rilascia le pagine del segmento: lo stesso intervallo, estremo superiore
+ * compreso, accettato da as_get_segment.
+ */
+static void as_destroy_segment(struct addrspace *as, struct segment *seg, vaddr_t top) {
+	pt_destroy_range(as->pt, seg->p_vaddr & PAGE_FRAME, (top & PAGE_FRAME) + PAGE_SIZE);
 }
 
 void as_destroy(struct addrspace* as) {
 
 
 	struct vnode *v;
+	int i;
 	KASSERT(as != NULL);
 	kprintf("Total SWAPOUT: %d -- Total SWAPIN: %d\n", getOut(), getIn());
 	v = as->code->vnode;
+	// Rilascia i frame e gli slot dello swap posseduti dal processo visitando
+	// solo le pagine dei segmenti, poi le inner table allocate
+	as_destroy_segment(as, as->code, as->code->p_vaddr + as->code->p_memsz);
+	as_destroy_segment(as, as->data, as->data->p_vaddr + as->data->p_memsz);
+	as_destroy_segment(as, as->stack, USERSTACK);
+	as_destroy_segment(as, as->heap, as->heap->p_vaddr + as->heap->p_memsz);
+	for (i = 0; i < AS_MAXMMAP; i++) {
+		if (as->mmaps[i] != NULL) {
+			as_destroy_segment(as, as->mmaps[i], as->mmaps[i]->p_vaddr + as->mmaps[i]->p_memsz);
+		}
+	}
+	pt_destroy(as->pt);
 	seg_destroy(as->code);
 	seg_destroy(as->data);
 	seg_destroy(as->stack);
-	pt_destroy(as->pt);
-	vfs_close(v); 
+	seg_destroy(as->heap);
+	if (v != NULL) {
+		vfs_close(v);
+	}
+	// Regioni non rimosse con as_munmap_all: le modifiche non vengono scritte nel file
+	for (i = 0; i < AS_MAXMMAP; i++) {
+		if (as->mmaps[i] != NULL) {
+			v = as->mmaps[i]->vnode;
+			seg_destroy(as->mmaps[i]);
+			vfs_close(v);
+		}
+	}
 	kfree(as);
 
 }
@@ -121,7 +228,6 @@ void as_destroy(struct addrspace* as) {
  */
 void as_activate(void)
 {
-    int i, spl;
     struct addrspace *as;
 
     // Ottieni l'address space del processo corrente.
@@ -132,60 +238,23 @@ void as_activate(void)
         return;
     }
 
-    // Disabilita le interruzioni per evitare che la TLB venga modificata durante l'operazione.
-    spl = splhigh();
-
-    // Invalida tutte le voci nella TLB per il nuovo address space.
-    for (i = 0; i < NUM_TLB; i++) {
-        tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
-    }
-	// Incrementa il contatore delle statistiche per le TLB invalidate
-	increment_statistics(STATISTICS_TLB_INVALIDATE);
-    // Ripristina le interruzioni al livello precedente.
-    splx(spl);
+    // Carica l'ASID dell'address space: le voci degli altri processi restano
+    // nella TLB ma non corrispondono. La TLB viene svuotata (e l'invalidazione
+    // contata nelle statistiche) solo quando gli ASID si esauriscono.
+    tlb_asid_activate(as);
 }
 
 /*
  * Funzione: as_deactivate
  * Scopo: Disattiva l'address space associato al processo corrente.
- * Questa operazione svuota la TLB (Translation Lookaside Buffer) per assicurare
- * che le traduzioni delle vecchie pagine virtuali non siano più valide.
+ * Con gli ASID non serve svuotare la TLB: le voci del processo sono
+ * etichettate con il suo ASID e non corrispondono a quello del prossimo
+ * address space attivato. Un address space distrutto non restituisce il suo
+ * ASID, che non viene riassegnato prima che ogni CPU abbia svuotato la TLB.
  */
 void
 as_deactivate(void)
 {
-    int i, spl;
-    struct addrspace *as;
-
-    /* Recupera l'address space del processo corrente */
-    as = proc_getas();
-    
-    if (as == NULL) {
-        /*
-         * Se il processo corrente non ha un address space (ad esempio, 
-         * un kernel thread), non è necessario fare nulla. 
-         * L'address space precedente rimane attivo.
-         */
-        return;
-    }
-
-    /*
-     * Disabilita gli interrupt su questa CPU per garantire la consistenza
-     * mentre si manipola la TLB. Questo previene condizioni di race
-     * durante la modifica delle entry nella TLB.
-     */
-    spl = splhigh();
-
-    /* Itera su tutte le entry della TLB e le invalida una per una */
-    for (i = 0; i < NUM_TLB; i++) {
-        tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
-    }
-
-    /* Incrementa una statistica che traccia quante volte la TLB è stata invalidata */
-    increment_statistics(STATISTICS_TLB_INVALIDATE);
-
-    /* Ripristina il livello degli interrupt al valore precedente */
-    splx(spl);
 }
 
 
@@ -234,11 +303,27 @@ as_prepare_load(struct addrspace *as)
 	return 0;
 }
 
+/*
+ * Definisce l'heap, inizialmente vuoto, nella prima pagina libera dopo il
+ * codice e i dati: il break iniziale e' l'inizio dell'heap.
+ */
 int
 as_complete_load(struct addrspace *as)
 {
-	(void)as;
-	return 0;
+	vaddr_t base, top;
+	int res;
+
+	base = as->code->p_vaddr + as->code->p_memsz;
+	top = as->data->p_vaddr + as->data->p_memsz;
+	if (top > base) {
+		base = top;
+	}
+	// Una pagina di distanza: as_get_segment accetta anche l'indirizzo di fine dei segmenti
+	base = ROUNDUP(base, PAGE_SIZE) + PAGE_SIZE;
+
+	res = seg_define(as->heap, PT_LOAD, 0, base, 0, 0, PF_R | PF_W, NULL);
+	KASSERT(res == 0);
+	return res;
 }
 
 int
@@ -264,12 +349,23 @@ struct segment* as_get_segment(struct addrspace *as, vaddr_t va) {
 	uint32_t base_seg1, top_seg1;
 	uint32_t base_seg2, top_seg2;
 	uint32_t base_seg3, top_seg3;
+	int i;
 	base_seg1 = as->code->p_vaddr;
 	top_seg1 = (as->code->p_vaddr + as->code->p_memsz);
 	base_seg2 = as->data->p_vaddr;
 	top_seg2 = (as->data->p_vaddr + as->data->p_memsz);
 	base_seg3 = as->stack->p_vaddr;
 	top_seg3 = USERSTACK;
+	// L'heap e' vuoto finche' non viene chiamata sbrk: l'estremo superiore e' escluso
+	if (va >= as->heap->p_vaddr && va < as->heap->p_vaddr + as->heap->p_memsz) {
+		return as->heap;
+	}
+	for (i = 0; i < AS_MAXMMAP; i++) {
+		if (as->mmaps[i] != NULL && va >= as->mmaps[i]->p_vaddr &&
+		    va < as->mmaps[i]->p_vaddr + as->mmaps[i]->p_memsz) {
+			return as->mmaps[i];
+		}
+	}
 	if(va >= base_seg1 && va <= top_seg1) {
 		return as->code;
 	}
@@ -280,4 +376,324 @@ struct segment* as_get_segment(struct addrspace *as, vaddr_t va) {
 		return as->stack;
 	}
 	return NULL;
-}
\ No newline at end of file
+}
+
+/*
+ * Inizio dell'area riservata alla crescita dello stack: as_stack_maxpages
+ * pagine sotto USERSTACK, o lo stack stesso se e' cresciuto oltre prima di
+ * una riduzione del limite.
+ */
+static vaddr_t as_stack_floor(struct addrspace *as) {
+	vaddr_t limit;
+
+	limit = USERSTACK - as_stack_maxpages * PAGE_SIZE;
+	if (as->stack->p_memsz > 0 && as->stack->p_vaddr < limit) {
+		limit = as->stack->p_vaddr;
+	}
+	return limit;
+}
+
+/*
+ * Fa crescere lo stack fino alla pagina di va, se va e' sotto lo stack ma
+ * entro il limite (as_stack_maxpages pagine sotto USERSTACK) e sopra l'heap
+ * e le regioni di mmap, lasciando una pagina di separazione. Le nuove pagine vengono caricate su
+ * richiesta, azzerate, come quelle iniziali dello stack.
+ *
+ * @return Lo stack, o NULL se va non appartiene all'area riservata allo stack.
+ */
+struct segment* as_grow_stack(struct addrspace *as, vaddr_t va) {
+	struct segment *stack = as->stack;
+	vaddr_t heap_top;
+	int i;
+
+	va &= PAGE_FRAME;
+	if (stack->p_memsz == 0 || va >= stack->p_vaddr ||
+	    va < USERSTACK - as_stack_maxpages * PAGE_SIZE) {
+		return NULL;
+	}
+	heap_top = ROUNDUP(as->heap->p_vaddr + as->heap->p_memsz, PAGE_SIZE);
+	if (va < heap_top + PAGE_SIZE) {
+		return NULL;
+	}
+	// Le regioni di mmap sono sotto lo stack (as_mmap), ma il limite puo' essere stato alzato
+	for (i = 0; i < AS_MAXMMAP; i++) {
+		if (as->mmaps[i] != NULL &&
+		    va < as->mmaps[i]->p_vaddr + as->mmaps[i]->p_memsz + PAGE_SIZE) {
+			return NULL;
+		}
+	}
+
+	stack->p_memsz += stack->p_vaddr - va;
+	stack->p_vaddr = va;
+	return stack;
+}
+
+/*
+ * Sposta il break dell'heap di amount byte e ne restituisce in oldbreak il
+ * valore precedente. L'heap cresce fino all'area riservata allo stack o alla
+ * regione di mmap piu' bassa (meno una pagina di separazione); le pagine aggiunte vengono caricate al primo
+ * accesso. Quando l'heap si riduce le pagine intere oltre il nuovo break
+ * vengono rimosse dalla page table, dopo aver reso inutilizzabili le loro
+ * traduzioni: un nuovo ASID per la TLB di ogni CPU, una nuova generazione
+ * per la cache software.
+ *
+ * @return 0, EINVAL se l'heap non e' definito o si riduce sotto l'inizio,
+ *         ENOMEM se supera il limite.
+ */
+int as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbreak) {
+	struct segment *heap = as->heap;
+	vaddr_t brk, newbrk, limit, start, end;
+	int i;
+
+	if (heap->p_permission == 0) {
+		return EINVAL; // Nessun programma caricato
+	}
+	brk = heap->p_vaddr + heap->p_memsz;
+
+	if (amount < 0) {
+		if ((vaddr_t)-amount > heap->p_memsz) {
+			return EINVAL;
+		}
+		newbrk = brk - (vaddr_t)-amount;
+	}
+	else {
+		newbrk = brk + amount;
+		limit = as_stack_floor(as);
+		for (i = 0; i < AS_MAXMMAP; i++) {
+			if (as->mmaps[i] != NULL && as->mmaps[i]->p_vaddr < limit) {
+				limit = as->mmaps[i]->p_vaddr;
+			}
+		}
+		if (newbrk < brk || newbrk > limit - PAGE_SIZE) {
+			return ENOMEM;
+		}
+	}
+
+	heap->p_memsz = newbrk - heap->p_vaddr;
+
+	start = ROUNDUP(newbrk, PAGE_SIZE);
+	end = ROUNDUP(brk, PAGE_SIZE);
+	if (start < end) {
+		tlb_asid_renew(as);
+		if (as == proc_getas()) {
+			as_activate();
+		}
+		as->stlb_gen++;
+		pt_unmap(as->pt, start, end);
+	}
+
+	*oldbreak = brk;
+	return 0;
+}
+
+/*
+ * Imposta la dimensione massima dello stack, in pagine, per le crescite
+ * successive.
+ */
+int as_set_stack_limit(unsigned int npages) {
+	if (npages < VMC1_STACKPAGES || npages > USERSTACK / 2 / PAGE_SIZE) {
+		return EINVAL;
+	}
+	as_stack_maxpages = npages;
+	return 0;
+}
+
+/*
+ * Mappa len byte del file v, da offset (allineato alla pagina), nella parte
+ * libera piu' alta sotto l'area dello stack, con una pagina di separazione
+ * da stack, heap e altre regioni. Le pagine vengono lette dal file al primo
+ * accesso, come quelle dell'ELF; la parte oltre la fine del file e' azzerata.
+ * PROT_EXEC non ha effetto (la TLB non lo distingue) e una regione e' sempre
+ * leggibile.
+ *
+ * @return 0 e in addr l'inizio della regione, EINVAL per argomenti non
+ *         validi, ENOMEM se non c'e' spazio o posto per una nuova regione.
+ */
+int as_mmap(struct addrspace *as, struct vnode *v, size_t len, int prot,
+            int flags, off_t offset, vaddr_t *addr) {
+	struct segment *seg;
+	struct stat st;
+	vaddr_t top, base, heap_top, mtop;
+	size_t size, filesz;
+	int slot, i, moved, result;
+	uint32_t perm;
+
+	if (len == 0 || offset < 0 || offset % PAGE_SIZE != 0 ||
+	    (flags != MAP_SHARED && flags != MAP_PRIVATE) ||
+	    (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) != 0) {
+		return EINVAL;
+	}
+	if (len > USERSTACK) {
+		return ENOMEM;
+	}
+	size = ROUNDUP(len, PAGE_SIZE);
+	if (offset + (off_t)size > (off_t)0xffffffff) {
+		return EINVAL; // Gli offset dei segmenti sono a 32 bit
+	}
+	if (as->heap->p_permission == 0) {
+		return EINVAL; // Nessun programma caricato
+	}
+
+	slot = -1;
+	for (i = 0; i < AS_MAXMMAP && slot < 0; i++) {
+		if (as->mmaps[i] == NULL) {
+			slot = i;
+		}
+	}
+	if (slot < 0) {
+		return ENOMEM;
+	}
+
+	// Si scende dall'area dello stack finche' la regione non trova posto
+	heap_top = ROUNDUP(as->heap->p_vaddr + as->heap->p_memsz, PAGE_SIZE);
+	top = as_stack_floor(as) - PAGE_SIZE;
+	do {
+		if (top < size || top - size < heap_top + PAGE_SIZE) {
+			return ENOMEM;
+		}
+		base = top - size;
+		moved = 0;
+		for (i = 0; i < AS_MAXMMAP; i++) {
+			if (as->mmaps[i] == NULL) {
+				continue;
+			}
+			mtop = as->mmaps[i]->p_vaddr + as->mmaps[i]->p_memsz;
+			if (top + PAGE_SIZE > as->mmaps[i]->p_vaddr && mtop + PAGE_SIZE > base) {
+				top = as->mmaps[i]->p_vaddr - PAGE_SIZE;
+				moved = 1;
+				break;
+			}
+		}
+	} while (moved);
+
+	// Solo la parte della regione coperta dal file viene letta
+	result = VOP_STAT(v, &st);
+	if (result) {
+		return result;
+	}
+	filesz = 0;
+	if (st.st_size > offset) {
+		filesz = (st.st_size - offset > (off_t)len) ? len : (size_t)(st.st_size - offset);
+	}
+
+	perm = PF_R;
+	if (prot & PROT_WRITE) {
+		perm |= PF_W;
+	}
+	seg = seg_create();
+	result = seg_define(seg, PT_LOAD, (uint32_t)offset, base, filesz, size, perm, v);
+	KASSERT(result == 0);
+	seg->p_mapflags = flags;
+	VOP_INCREF(v);
+	as->mmaps[slot] = seg;
+
+	*addr = base;
+	return 0;
+}
+
+/*
+ * Scrive nel file le pagine di una regione condivisa che possono differire
+ * da esso: quelle modificate o con una copia nello swap (da cui sono state
+ * rilette). Le pagine mai caricate o scartate pulite sono uguali al file.
+ * La scrittura avviene dagli indirizzi utente, che riportano in memoria le
+ * pagine nello swap: as deve essere l'address space corrente.
+ */
+static int as_mmap_writeback(struct addrspace *as, struct segment *seg) {
+	struct iovec iov;
+	struct uio u;
+	size_t off, n;
+	pte_t *pte;
+	paddr_t pa;
+	int result;
+
+	KASSERT(as == proc_getas());
+
+	for (off = 0; off < seg->p_filesz; off += PAGE_SIZE) {
+		pte = pt_walk(as->pt, seg->p_vaddr + off, 0);
+		if (pte == NULL || *pte == 0) {
+			continue;
+		}
+		pa = PTE_GET_PA(*pte);
+		if (pa != PFN_NOT_USED && !coremap_is_modified(pa) && coremap_get_swap_offset(pa) == -1) {
+			continue;
+		}
+
+		// Il file non viene esteso oltre la parte mappata all'inizio
+		n = seg->p_filesz - off;
+		if (n > PAGE_SIZE) {
+			n = PAGE_SIZE;
+		}
+		iov.iov_ubase = (userptr_t)(seg->p_vaddr + off);
+		iov.iov_len = n;
+		u.uio_iov = &iov;
+		u.uio_iovcnt = 1;
+		u.uio_offset = seg->p_offset + off;
+		u.uio_resid = n;
+		u.uio_segflg = UIO_USERSPACE;
+		u.uio_rw = UIO_WRITE;
+		u.uio_space = as;
+		result = VOP_WRITE(seg->vnode, &u);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Rimuove la regione creata da as_mmap che inizia in addr; len deve coprirla
+ * per intero. Le modifiche a una regione MAP_SHARED scrivibile vengono prima
+ * scritte nel file, se as e' l'address space corrente. La regione viene
+ * rimossa anche se la scrittura fallisce.
+ *
+ * @return 0, EINVAL se addr e len non corrispondono a una regione, o
+ *         l'errore della scrittura nel file.
+ */
+int as_munmap(struct addrspace *as, vaddr_t addr, size_t len) {
+	struct segment *seg;
+	struct vnode *v;
+	int i, result;
+
+	for (i = 0; i < AS_MAXMMAP; i++) {
+		if (as->mmaps[i] != NULL && as->mmaps[i]->p_vaddr == addr) {
+			break;
+		}
+	}
+	if (i == AS_MAXMMAP) {
+		return EINVAL;
+	}
+	seg = as->mmaps[i];
+	if (len == 0 || len > seg->p_memsz || ROUNDUP(len, PAGE_SIZE) != seg->p_memsz) {
+		return EINVAL;
+	}
+
+	result = 0;
+	if (seg->p_mapflags == MAP_SHARED && (seg->p_permission & PF_W) && as == proc_getas()) {
+		result = as_mmap_writeback(as, seg);
+	}
+
+	// Come per la riduzione dell'heap: traduzioni invalidate, poi pagine rimosse
+	tlb_asid_renew(as);
+	if (as == proc_getas()) {
+		as_activate();
+	}
+	as->stlb_gen++;
+	pt_unmap(as->pt, seg->p_vaddr, seg->p_vaddr + seg->p_memsz);
+
+	as->mmaps[i] = NULL;
+	v = seg->vnode;
+	seg_destroy(seg);
+	vfs_close(v);
+	return result;
+}
+
+// Rimuove tutte le regioni di mmap, scrivendo nel file quelle condivise (exit)
+void as_munmap_all(struct addrspace *as) {
+	int i;
+
+	for (i = 0; i < AS_MAXMMAP; i++) {
+		if (as->mmaps[i] != NULL) {
+			as_munmap(as, as->mmaps[i]->p_vaddr, as->mmaps[i]->p_memsz);
+		}
+	}
+}
@@ -4,9 +4,12 @@
 #include <spl.h>
 #include <cpu.h>
 #include <spinlock.h>
+#include <wchan.h>
 #include <proc.h>
 #include <current.h>
 #include <mips/tlb.h>
+#include <membar.h>
+#include <platform/maxcpus.h>
 #include <addrspace.h>
 #include <vm.h>
 
@@ -14,39 +17,373 @@
 #include <vmc1.h>
 #include <swapfile.h>
 #include <vm_tlb.h>
+#include <pageout.h>
+#include <pagecache.h>
+#include <statistics.h>
+#include "opt-c1_clock.h"
+#include "opt-c1_wsclock.h"
 
 // Modulo Coremap per la gestione e il tracking della memoria fisica
 static struct coremap_entry *coremap = NULL; // Puntatore alla coremap
 static int nRamFrames = 0;                   // Numero di entry nella memoria fisica, aggiornato a runtime dalla funzione ram_getsize()
 static int coremapActive = 0;                // Flag per tenere traccia dell'attivazione della coremap
-static unsigned int current_victim;          // Victim scelta quando la corememory e' piena
+static unsigned int current_victim;          // Victim scelta quando la corememory e' piena (lancetta del Clock)
+static volatile unsigned int vm_vtime = 0;   // Tempo virtuale: numero di ricariche TLB osservate
+
+// Free list dei frame liberi, organizzata in run contigui suddivisi per dimensione
+static int freerun_heads[COREMAP_FREE_BUCKETS]; // Testa di ogni bucket (-1 se vuoto)
+static unsigned int nFreeFrames = 0;             // Numero totale di frame liberi
+
+/*
+ * Cache per CPU (magazine) di frame liberi gia' prelevati dalla free list.
+ * page_alloc()/page_free() e le allocazioni kernel di una sola pagina vengono
+ * servite dalla cache della CPU corrente, protetta da un proprio spinlock non
+ * conteso; il lock globale viene preso solo per riempire o svuotare la cache a
+ * blocchi di FRAME_CACHE_BATCH frame. I frame in cache sono marcati fixed.
+ * Ordine dei lock: prima il lock della cache, poi freemem_lock.
+ */
+struct frame_cache {
+    struct spinlock lock;                 // Protegge la singola cache
+    int frames[FRAME_CACHE_SIZE];         // Indici dei frame disponibili
+    unsigned int count;                   // Numero di frame presenti
+    unsigned int hits;                    // Richieste servite senza lock globale
+    unsigned int misses;                  // Richieste che hanno richiesto un refill
+};
+static struct frame_cache frame_caches[MAXCPUS];
+static volatile int frame_cache_enabled = 1;  // 0: i frame passano direttamente dalla free list
+
+// Contatori di traffico sul lock globale (aggiornati con freemem_lock acquisito)
+static unsigned int freemem_lock_acquires = 0;   // Acquisizioni totali
+static unsigned int freemem_lock_contended = 0;  // Acquisizioni trovate gia' occupate
 
 // Lock per la gestione della concorrenza nella coremap
 static struct spinlock freemem_lock = SPINLOCK_INITIALIZER;   
 static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
 
+/*
+ * Frame in corso di swap-out (stato busy): i thread che li trovano nella
+ * propria page table attendono su busy_wchan che l'eviction termini.
+ */
+static struct spinlock busy_lock = SPINLOCK_INITIALIZER;
+static struct wchan *busy_wchan = NULL;
+
+/*
+ * Riserva di frame gia' azzerati (pila di indici), riempita dai CPU inattivi
+ * con coremap_zero_pool_fill e svuotata da page_alloc_zeroed. I frame nella
+ * riserva sono fixed ma contano come liberi: un'allocazione che non trova
+ * altri frame liberi li usa prima di scegliere una vittima.
+ */
+static struct spinlock zero_pool_lock = SPINLOCK_INITIALIZER;
+static int zero_pool[ZERO_POOL_SIZE];
+static volatile unsigned int zero_pool_count = 0;
+static volatile int zero_pool_enabled = 1;
+static unsigned int zero_pool_hits = 0;     // Pagine azzerate servite dalla riserva
+static unsigned int zero_pool_misses = 0;   // Pagine azzerate sul momento
+
+// Evict eseguite dal demone di pageout e quelle sincrone durante un'allocazione
+static unsigned int pageout_evictions = 0;
+static unsigned int direct_evictions = 0;
+
+/*
+ * Mappa inversa dei frame utente: il primo processo che mappa un frame e'
+ * registrato nella sua entry (as, vaddr), gli altri (fork, cache delle
+ * pagine di codice) in una lista di voci prese da un pool preallocato di
+ * COREMAP_RMAP_PER_FRAME voci per frame. refcount conta tutte le mappature,
+ * cosi' che l'eviction di un frame condiviso possa aggiornare ogni page
+ * table che lo mappa. Protetta da freemem_lock; la lista di un frame busy
+ * non cambia, e l'eviction la scorre senza lock.
+ */
+struct rmap_entry {
+    struct addrspace *as;    // Address space che mappa il frame
+    vaddr_t vaddr;           // Indirizzo virtuale della mappatura
+    int next;                // Voce successiva dello stesso frame (o del pool libero), -1 se assente
+};
+static struct rmap_entry *rmap_pool = NULL;
+static int rmap_free = -1;                  // Prima voce libera del pool
+static unsigned int rmap_exhausted = 0;     // Condivisioni rifiutate per pool esaurito
+
 // Funzioni di utilità e helper per la gestione della coremap
+static void freemem_lock_acquire(void);
 static int isCoremapActive(void);
 static int getfreeppages(unsigned long npages);
 static int freeppages(paddr_t addr, unsigned long npages);
 static paddr_t getppages(unsigned long npages);
-static paddr_t getppage_user(vaddr_t va, struct addrspace *as);
+static paddr_t getppage_user(vaddr_t va, struct addrspace *as, int evict);
 
 // Sezione 1: Funzioni di inizializzazione e gestione della coremap
 
-// Verifica se la coremap è attiva, utilizzando un lock per evitare problemi di concorrenza
+// Acquisisce freemem_lock registrando se era gia' occupato (contesa)
+static void freemem_lock_acquire(void) {
+    int busy;
+
+    busy = spinlock_data_get(&freemem_lock.splk_lock) != 0;
+    spinlock_acquire(&freemem_lock);
+    freemem_lock_acquires++;
+    if (busy) {
+        freemem_lock_contended++;
+    }
+}
+
+// Verifica se la coremap è attiva. Il flag cambia solo all'avvio e allo spegnimento,
+// quindi la lettura non richiede il lock globale (che resterebbe sul percorso veloce)
 static int isCoremapActive() {
     int active;
-    spinlock_acquire(&freemem_lock);
     active = coremapActive;
-    spinlock_release(&freemem_lock);
+    membar_any_any();
     return active;
 }
 
+/*
+ * Gestione della free list.
+ *
+ * I frame liberi sono raggruppati in run contigui. Ogni run ha un boundary tag
+ * (free_len) sul primo e sull'ultimo frame, cosi' che al rilascio i run vicini
+ * possano essere fusi in O(1), ed e' collegato nel bucket corrispondente alla
+ * sua lunghezza. L'allocazione di un singolo frame preleva dal bucket 0 in O(1),
+ * quella di piu' frame contigui esamina al massimo COREMAP_FREE_BUCKETS bucket.
+ * Tutte le funzioni vanno chiamate con freemem_lock acquisito.
+ */
+
+// Restituisce il bucket di un run di lunghezza len (floor(log2(len)), saturato)
+static unsigned int freerun_bucket(unsigned long len) {
+    unsigned int b = 0;
+
+    KASSERT(len > 0);
+    while (len > 1 && b < COREMAP_FREE_BUCKETS - 1) {
+        len >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// Inserisce in testa al suo bucket il run [first, first + len)
+static void freerun_insert(int first, unsigned long len) {
+    unsigned int b = freerun_bucket(len);
+
+    coremap[first].free_len = len;
+    coremap[first + len - 1].free_len = len;
+    coremap[first].prev_free = -1;
+    coremap[first].next_free = freerun_heads[b];
+    if (freerun_heads[b] >= 0) {
+        coremap[freerun_heads[b]].prev_free = first;
+    }
+    freerun_heads[b] = first;
+}
+
+// Scollega dal suo bucket il run che inizia al frame first
+static void freerun_remove(int first) {
+    unsigned int b = freerun_bucket(coremap[first].free_len);
+    int prev = coremap[first].prev_free;
+    int next = coremap[first].next_free;
+
+    if (prev >= 0) {
+        coremap[prev].next_free = next;
+    } else {
+        KASSERT(freerun_heads[b] == first);
+        freerun_heads[b] = next;
+    }
+    if (next >= 0) {
+        coremap[next].prev_free = prev;
+    }
+    coremap[first].next_free = -1;
+    coremap[first].prev_free = -1;
+}
+
+/**
+ * Preleva npages frame contigui dalla free list.
+ * Cerca prima nei bucket i cui run sono sicuramente abbastanza lunghi; solo se
+ * sono tutti vuoti scorre il bucket di npages (first-fit). L'eventuale parte
+ * eccedente del run viene reinserita nella free list. I frame prelevati sono
+ * marcati fixed: sara' il chiamante ad aggiornarne lo stato.
+ *
+ * @param npages Numero di frame contigui richiesti.
+ * @return L'indice del primo frame prelevato, o -1 se non esiste un run adatto.
+ */
+static int freerun_take(unsigned long npages) {
+    unsigned int b, sure;
+    unsigned long len;
+    int first = -1, cand;
+
+    b = freerun_bucket(npages);
+    // Se npages non e' una potenza di 2 il bucket b puo' contenere run troppo corti
+    sure = (npages == (1UL << b)) ? b : b + 1;
+    for (; sure < COREMAP_FREE_BUCKETS && first < 0; sure++) {
+        first = freerun_heads[sure];
+    }
+    for (cand = freerun_heads[b]; first < 0 && cand >= 0; cand = coremap[cand].next_free) {
+        if (coremap[cand].free_len >= npages) {
+            first = cand;
+        }
+    }
+    if (first < 0) {
+        return -1;
+    }
+
+    len = coremap[first].free_len;
+    freerun_remove(first);
+    if (len > npages) {
+        freerun_insert(first + npages, len - npages);
+    }
+    // I frame prelevati non devono piu' risultare liberi per la fusione dei run vicini
+    for (cand = first; cand < first + (int)npages; cand++) {
+        coremap[cand].status = fixed;
+    }
+    KASSERT(nFreeFrames >= npages);
+    nFreeFrames -= npages;
+    return first;
+}
+
+/**
+ * Restituisce alla free list i frame [first, first + npages), fondendoli con
+ * gli eventuali run liberi adiacenti.
+ */
+static void freerun_release(int first, unsigned long npages) {
+    unsigned long i;
+    int left, right;
+
+    for (i = 0; i < npages; i++) {
+        KASSERT(coremap[first + i].status != free);
+        coremap[first + i].status = free;
+        coremap[first + i].as = NULL;
+        coremap[first + i].alloc_size = 0;
+        coremap[first + i].vaddr = 0;
+        coremap[first + i].referenced = 0;
+        coremap[first + i].refcount = 0;
+        coremap[first + i].modified = 0;
+    }
+    nFreeFrames += npages;
+
+    // Fusione con il run precedente: first - 1 e' l'ultimo frame di quel run
+    if (first > 0 && coremap[first - 1].status == free) {
+        left = first - coremap[first - 1].free_len;
+        freerun_remove(left);
+        npages += first - left;
+        first = left;
+    }
+    // Fusione con il run successivo: right e' il primo frame di quel run
+    right = first + npages;
+    if (right < nRamFrames && coremap[right].status == free) {
+        npages += coremap[right].free_len;
+        freerun_remove(right);
+    }
+    freerun_insert(first, npages);
+}
+
+/*
+ * Gestione delle cache di frame per CPU.
+ */
+
+// Restituisce la cache della CPU corrente
+static struct frame_cache *frame_cache_cur(void) {
+    KASSERT(CURCPU_EXISTS());
+    return &frame_caches[curcpu->c_number];
+}
+
+/**
+ * Preleva un frame dalla cache della CPU corrente. Se la cache e' vuota la
+ * riempie con un blocco di frame presi dalla free list globale.
+ *
+ * @return L'indice del frame, o -1 se non ci sono frame liberi.
+ */
+static int frame_cache_get(void) {
+    struct frame_cache *fc;
+    int frame = -1, f;
+
+    if (!frame_cache_enabled) {
+        freemem_lock_acquire();
+        frame = freerun_take(1);
+        spinlock_release(&freemem_lock);
+        return frame;
+    }
+
+    fc = frame_cache_cur();
+    spinlock_acquire(&fc->lock);
+    if (fc->count == 0) {
+        fc->misses++;
+        freemem_lock_acquire();
+        while (fc->count < FRAME_CACHE_BATCH) {
+            f = freerun_take(1);
+            if (f < 0) {
+                break;
+            }
+            fc->frames[fc->count++] = f;
+        }
+        spinlock_release(&freemem_lock);
+    } else {
+        fc->hits++;
+    }
+    if (fc->count > 0) {
+        frame = fc->frames[--fc->count];
+    }
+    spinlock_release(&fc->lock);
+    return frame;
+}
+
+// Riporta nella free list globale i primi n frame della cache (cache lock acquisito)
+static void frame_cache_drain(struct frame_cache *fc, unsigned int n) {
+    unsigned int i;
+
+    KASSERT(n <= fc->count);
+    freemem_lock_acquire();
+    for (i = 0; i < n; i++) {
+        freerun_release(fc->frames[i], 1);
+    }
+    spinlock_release(&freemem_lock);
+    for (i = n; i < fc->count; i++) {
+        fc->frames[i - n] = fc->frames[i];
+    }
+    fc->count -= n;
+}
+
+/**
+ * Inserisce un frame appena liberato nella cache della CPU corrente; se la
+ * cache e' piena ne restituisce prima un blocco alla free list globale.
+ */
+static void frame_cache_put(int frame) {
+    struct frame_cache *fc;
+
+    coremap[frame].status = fixed;
+    coremap[frame].as = NULL;
+    coremap[frame].vaddr = 0;
+    coremap[frame].alloc_size = 0;
+    coremap[frame].referenced = 0;
+    coremap[frame].refcount = 0;
+    coremap[frame].modified = 0;
+
+    if (!frame_cache_enabled) {
+        freemem_lock_acquire();
+        freerun_release(frame, 1);
+        spinlock_release(&freemem_lock);
+        return;
+    }
+
+    fc = frame_cache_cur();
+    spinlock_acquire(&fc->lock);
+    if (fc->count == FRAME_CACHE_SIZE) {
+        frame_cache_drain(fc, FRAME_CACHE_BATCH);
+    }
+    fc->frames[fc->count++] = frame;
+    spinlock_release(&fc->lock);
+}
+
+// Svuota le cache di tutte le CPU, per ricompattare la free list prima di un'eviction
+static void frame_cache_drain_all(void) {
+    unsigned int i;
+
+    for (i = 0; i < MAXCPUS; i++) {
+        spinlock_acquire(&frame_caches[i].lock);
+        if (frame_caches[i].count > 0) {
+            frame_cache_drain(&frame_caches[i], frame_caches[i].count);
+        }
+        spinlock_release(&frame_caches[i].lock);
+    }
+}
+
 // Inizializza la coremap con informazioni di base su ogni frame di memoria fisica e la attiva
 void coremap_init() {
     int i;
     int coremap_size = 0;
+    int first_free;
     nRamFrames = ((int)ram_getsize()) / PAGE_SIZE;  // Calcola il numero di frame in RAM
     KASSERT(nRamFrames > 0);
 
@@ -54,46 +391,235 @@ void coremap_init() {
     coremap = kmalloc(coremap_size);  // Alloca la memoria per la coremap, nel kernel space
     KASSERT(coremap != NULL);
 
-    // Inizializza ciascun entry della coremap con valori di default
+    // Inizializza ciascun entry della coremap con valori di default.
+    // I frame gia' "rubati" dal kernel prima dell'attivazione restano fixed per sempre.
     for(i = 0; i < nRamFrames; i++) {
-        coremap[i].status = clean;
+        coremap[i].status = fixed;
         coremap[i].as = NULL;
         coremap[i].alloc_size = 0;
         coremap[i].vaddr = 0;
+        coremap[i].next_free = -1;
+        coremap[i].prev_free = -1;
+        coremap[i].free_len = 0;
+        coremap[i].referenced = 0;
+        coremap[i].last_use = 0;
+        coremap[i].refcount = 0;
+        coremap[i].modified = 0;
+        coremap[i].swap_offset = -1;
+        coremap[i].rmap = -1;
+    }
+    rmap_pool = kmalloc(sizeof(struct rmap_entry) * nRamFrames * COREMAP_RMAP_PER_FRAME);
+    KASSERT(rmap_pool != NULL);
+    for (i = 0; i < nRamFrames * COREMAP_RMAP_PER_FRAME; i++) {
+        rmap_pool[i].as = NULL;
+        rmap_pool[i].vaddr = 0;
+        rmap_pool[i].next = i + 1 < nRamFrames * COREMAP_RMAP_PER_FRAME ? i + 1 : -1;
     }
+    rmap_free = 0;
+    for (i = 0; i < COREMAP_FREE_BUCKETS; i++) {
+        freerun_heads[i] = -1;
+    }
+    for (i = 0; i < MAXCPUS; i++) {
+        spinlock_init(&frame_caches[i].lock);
+        frame_caches[i].count = 0;
+        frame_caches[i].hits = 0;
+        frame_caches[i].misses = 0;
+    }
+
+    busy_wchan = wchan_create("coremap busy");
+    KASSERT(busy_wchan != NULL);
+
+    // Da qui in poi tutta la RAM rimanente e' gestita dalla coremap e non piu' da ram_stealmem
+    spinlock_acquire(&stealmem_lock);
+    first_free = (ram_getfirstfree() + PAGE_SIZE - 1) / PAGE_SIZE;
+    spinlock_release(&stealmem_lock);
 
     // Attiva la coremap
-    spinlock_acquire(&freemem_lock);
+    freemem_lock_acquire();
+    if (first_free < nRamFrames) {
+        freerun_release(first_free, nRamFrames - first_free);
+    }
     coremapActive = 1;
     spinlock_release(&freemem_lock);
 }
 
 // Rilascia la memoria utilizzata dalla coremap e la disattiva
 void coremap_shutdown() {
-    spinlock_acquire(&freemem_lock);
+    freemem_lock_acquire();
     coremapActive = 0;  // Disattiva la coremap
     spinlock_release(&freemem_lock);
+    kfree(rmap_pool);
     kfree(coremap);  // Libera la memoria della coremap dal kernel space
 }
  
 
 
+/*
+ * Gestione della mappa inversa (con freemem_lock acquisito).
+ */
+
+// Indica se (as, va) e' una delle mappature del frame pos
+static int rmap_contains(int pos, struct addrspace *as, vaddr_t va) {
+    int r;
+
+    if (coremap[pos].as == as && coremap[pos].vaddr == va) {
+        return 1;
+    }
+    for (r = coremap[pos].rmap; r >= 0; r = rmap_pool[r].next) {
+        if (rmap_pool[r].as == as && rmap_pool[r].vaddr == va) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Aggiunge la mappatura (as, va) al frame pos; 0 se il pool e' esaurito
+static int rmap_add(int pos, struct addrspace *as, vaddr_t va) {
+    int r;
+
+    r = rmap_free;
+    if (r < 0) {
+        rmap_exhausted++;
+        return 0;
+    }
+    rmap_free = rmap_pool[r].next;
+    rmap_pool[r].as = as;
+    rmap_pool[r].vaddr = va;
+    rmap_pool[r].next = coremap[pos].rmap;
+    coremap[pos].rmap = r;
+    coremap[pos].refcount++;
+    return 1;
+}
+
+// Toglie la mappatura (as, va) dal frame pos, che resta mappato da altri
+static void rmap_remove(int pos, struct addrspace *as, vaddr_t va) {
+    int *link, r;
+
+    KASSERT(coremap[pos].refcount > 1 && coremap[pos].rmap >= 0);
+    if (coremap[pos].as == as && coremap[pos].vaddr == va) {
+        // Se esce il proprietario, la prima mappatura della lista ne prende il posto
+        r = coremap[pos].rmap;
+        coremap[pos].as = rmap_pool[r].as;
+        coremap[pos].vaddr = rmap_pool[r].vaddr;
+        coremap[pos].rmap = rmap_pool[r].next;
+    }
+    else {
+        link = &coremap[pos].rmap;
+        while (rmap_pool[*link].as != as || rmap_pool[*link].vaddr != va) {
+            link = &rmap_pool[*link].next;
+            KASSERT(*link >= 0);
+        }
+        r = *link;
+        *link = rmap_pool[r].next;
+    }
+    rmap_pool[r].as = NULL;
+    rmap_pool[r].next = rmap_free;
+    rmap_free = r;
+    coremap[pos].refcount--;
+}
+
+// Restituisce al pool la lista del frame pos, appena liberato da un'eviction
+static void rmap_clear(int pos) {
+    int r, next;
+
+    for (r = coremap[pos].rmap; r >= 0; r = next) {
+        next = rmap_pool[r].next;
+        rmap_pool[r].as = NULL;
+        rmap_pool[r].next = rmap_free;
+        rmap_free = r;
+    }
+    coremap[pos].rmap = -1;
+}
+
+/*
+ * Un frame puo' essere scelto come vittima se appartiene ad un processo utente
+ * ed e' gia' pubblicato: anche se e' condiviso, la mappa inversa indica tutte
+ * le page table da aggiornare.
+ */
+static int frame_evictable(int pos) {
+    return coremap[pos].status == dirty && coremap[pos].refcount > 0;
+}
+
+#if OPT_C1_CLOCK || OPT_C1_WSCLOCK
+/**
+ * Seleziona un singolo frame utente da utilizzare come vittima con la politica
+ * Clock (second chance): la lancetta current_victim scorre la coremap e, se il
+ * frame ha il reference bit impostato, lo azzera e gli concede una seconda
+ * possibilita'. Con WSClock un frame non riferito viene scelto solo se e' fuori
+ * dal working set (ultimo riferimento piu' vecchio di WSCLOCK_TAU); se nessun
+ * frame lo e', si sceglie il meno recente tra quelli non riferiti.
+ * Va chiamata con freemem_lock acquisito.
+ *
+ * @return L'indice del frame selezionato come vittima, -1 se nessun frame e' idoneo.
+ */
+static int get_victim_clock(void) {
+    int victim;
+    int oldest = -1;           // Frame non riferito con l'ultimo uso piu' vecchio (WSClock)
+    unsigned int steps;
+    unsigned int now = vm_vtime;
+
+    // Due giri completi bastano: nel primo si azzerano i reference bit
+    for (steps = 0; steps < 2 * (unsigned int)nRamFrames; steps++) {
+        if (current_victim == 0 || current_victim >= (unsigned int)nRamFrames) {
+            current_victim = 1; // Evita di utilizzare il frame 0 (spesso riservato)
+        }
+        victim = current_victim;
+        current_victim = (current_victim + 1) % nRamFrames;
+
+        if (!frame_evictable(victim)) {
+            continue;
+        }
+        if (coremap[victim].referenced) {
+            // Seconda possibilita': la pagina e' stata usata dall'ultimo passaggio
+            coremap[victim].referenced = 0;
+            coremap[victim].last_use = now;
+            continue;
+        }
+#if OPT_C1_WSCLOCK
+        if (now - coremap[victim].last_use <= WSCLOCK_TAU) {
+            // Ancora nel working set: la si tiene come ripiego se e' la meno recente
+            if (oldest < 0 || coremap[victim].last_use < coremap[oldest].last_use) {
+                oldest = victim;
+            }
+            continue;
+        }
+#endif
+        return victim;
+    }
+
+    return oldest;
+}
+#endif
+
 /**
  * Seleziona un frame (o una sequenza di frame contigui) della coremap da utilizzare come vittima
  * per l'allocazione di nuova memoria. Utilizza un algoritmo di selezione Round Robin per garantire
  * che le vittime siano distribuite equamente tra tutti i frame disponibili.
  * 
+ * Va chiamata con freemem_lock acquisito.
+ *
  * @param size Numero di frame contigui richiesti.
- * @return L'indice del primo frame contiguo selezionato come vittima.
+ * @return L'indice del primo frame contiguo selezionato come vittima, -1 se non esiste.
  */
 static int get_victim_coremap(int size) {
     int victim = -1;      // Indice del frame selezionato come potenziale vittima
     int len = 0;          // Contatore per il numero di frame contigui trovati finora
+    unsigned int steps = 0;
 
     KASSERT(size != 0);   // Verifica che venga richiesto almeno un frame
 
-    // Cerca una sequenza di "size" frame contigui idonei nella coremap
+#if OPT_C1_CLOCK || OPT_C1_WSCLOCK
+    // Le sequenze contigue (richieste del kernel) restano in Round Robin
+    if (size == 1) {
+        return get_victim_clock();
+    }
+#endif
+
+    // Cerca una sequenza di "size" frame contigui idonei nella coremap (al massimo due giri)
     while (len < size) {
+        if (steps++ >= 2 * (unsigned int)nRamFrames) {
+            return -1;
+        }
         // Se si supera il limite della coremap, torna all'inizio (Round Robin)
         if (current_victim + (size - len) >= (unsigned int)nRamFrames) {
             current_victim = 1; // Evita di utilizzare il frame 0 (spesso riservato)
@@ -106,7 +632,7 @@ static int get_victim_coremap(int size) {
         current_victim = (current_victim + 1) % nRamFrames;
 
         // Verifica se il frame corrente può essere utilizzato come vittima
-        if (coremap[victim].status != fixed && coremap[victim].status != clean) {
+        if (frame_evictable(victim)) {
             len += 1; // Incrementa il contatore se il frame è idoneo
         } else {
             len = 0; // Reset del contatore se il frame corrente non è idoneo
@@ -117,6 +643,167 @@ static int get_victim_coremap(int size) {
     return victim - (len - 1);
 }
 
+/**
+ * Sceglie size frame contigui da liberare e li marca busy, in modo atomico
+ * rispetto alle altre eviction (che non possono scegliere gli stessi frame)
+ * e a coremap_share.
+ *
+ * @return L'indice del primo frame, -1 se nessun frame utente e' idoneo.
+ */
+static int coremap_claim_victims(int size) {
+    int victim, i, r;
+
+    freemem_lock_acquire();
+    victim = get_victim_coremap(size);
+    if (victim >= 0) {
+        for (i = victim; i < victim + size; i++) {
+            KASSERT(frame_evictable(i));
+            coremap[i].status = busy;
+            // Le traduzioni nella cache software di chi mappa il frame non sono piu' valide
+            coremap[i].as->stlb_gen++;
+            for (r = coremap[i].rmap; r >= 0; r = rmap_pool[r].next) {
+                rmap_pool[r].as->stlb_gen++;
+            }
+        }
+    }
+    spinlock_release(&freemem_lock);
+    return victim;
+}
+
+// Risveglia i thread in attesa della fine di uno swap-out (lo stato busy e' gia' cambiato)
+static void coremap_busy_done(void) {
+    membar_store_store();
+    spinlock_acquire(&busy_lock);
+    wchan_wakeall(busy_wchan, &busy_lock);
+    spinlock_release(&busy_lock);
+}
+
+// Accoda lo shootdown di tutte le mappature della vittima pos
+static void frame_tlb_batch_add(struct tlb_batch *tb, int pos) {
+    int r;
+
+    tlb_batch_add(tb, coremap[pos].as, coremap[pos].vaddr);
+    for (r = coremap[pos].rmap; r >= 0; r = rmap_pool[r].next) {
+        tlb_batch_add(tb, rmap_pool[r].as, rmap_pool[r].vaddr);
+    }
+}
+
+// Aggiorna la PTE di una mappatura della vittima: pagina di soli zeri o nello slot swap_offset
+static void frame_set_pte(struct addrspace *as, vaddr_t va, int zero, off_t swap_offset) {
+    if (zero) {
+        pt_set_zero(as->pt, va);
+    }
+    else {
+        pt_set_offset(as->pt, va, swap_offset);
+    }
+}
+
+/*
+ * Aggiorna le PTE di tutte le page table che mappano la vittima pos, gia'
+ * invalidata nelle TLB, e svuota la sua mappa inversa. Ogni PTE riceve un
+ * proprio riferimento allo slot swap_offset (quello del frame passa alla
+ * prima): i riferimenti vengono aggiunti prima di scrivere le PTE, perche'
+ * un processo che esce puo' liberare il suo appena vede lo slot.
+ */
+static void frame_unmap_all(int pos, int zero, off_t swap_offset) {
+    int r;
+
+    if (!zero && swap_offset >= 0) {
+        for (r = coremap[pos].rmap; r >= 0; r = rmap_pool[r].next) {
+            swap_share(swap_offset);
+        }
+    }
+    frame_set_pte(coremap[pos].as, coremap[pos].vaddr, zero, swap_offset);
+    for (r = coremap[pos].rmap; r >= 0; r = rmap_pool[r].next) {
+        frame_set_pte(rmap_pool[r].as, rmap_pool[r].vaddr, zero, swap_offset);
+    }
+
+    freemem_lock_acquire();
+    rmap_clear(pos);
+    spinlock_release(&freemem_lock);
+}
+
+/*
+ * Decide se la vittima pos, gia' invalidata nelle TLB, puo' essere scartata
+ * come pagina di soli zeri: il contenuto viene controllato solo se la pagina
+ * occuperebbe uno slot dello swap (modificata, o pulita con uno slot), e lo
+ * slot eventualmente gia' assegnato viene rilasciato. Le page table vanno
+ * poi aggiornate con frame_unmap_all.
+ */
+static int coremap_drop_zero(int pos) {
+    const uint32_t *words;
+    off_t swap_offset;
+    unsigned int i;
+
+    swap_offset = coremap[pos].swap_offset;
+    if (!coremap[pos].modified && swap_offset < 0) {
+        return 0; // Pagina pulita dell'ELF: scartarla non costa nulla
+    }
+    words = (const uint32_t *)PADDR_TO_KVADDR(pos * PAGE_SIZE);
+    for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); i++) {
+        if (words[i] != 0) {
+            return 0;
+        }
+    }
+    if (swap_offset >= 0) {
+        swap_free(swap_offset);
+        coremap[pos].swap_offset = -1;
+    }
+    increment_statistics(STATISTICS_ZERO_EVICT);
+    return 1;
+}
+
+/**
+ * Esegue lo swap-out del frame utente pos, gia' marcato busy. Le page table
+ * aggiornate sono quelle registrate nella mappa inversa del frame (non quella
+ * del processo che ha causato il fault), e le traduzioni vengono invalidate
+ * sulle TLB di tutte le CPU prima di scrivere la pagina, cosi' che nessuno
+ * possa piu' modificarla tramite una voce rimasta in TLB. Finche' il frame
+ * e' busy vm_fault non lo rimappa. Una pagina non modificata viene scartata
+ * senza scriverla: la sua copia nello swap o nell'ELF e' ancora valida.
+ * Una pagina di soli zeri non viene scritta e non occupa uno slot.
+ *
+ * @param pos Indice del frame da liberare; al ritorno il frame e' riutilizzabile.
+ */
+// Se tb != NULL lo shootdown e' gia' stato accodato e inviato dal chiamante
+static void coremap_evict(int pos, struct tlb_batch *tb) {
+    struct tlb_batch own;
+    paddr_t victim_pa;
+    off_t swap_offset;
+
+    KASSERT(coremap[pos].status == busy);
+    KASSERT(coremap[pos].as != NULL);
+    victim_pa = pos * PAGE_SIZE;
+
+    // Rimozione delle traduzioni dalla TLB di ogni CPU su cui chi mappa il frame puo' essere in esecuzione
+    if (tb == NULL) {
+        tlb_batch_init(&own);
+        frame_tlb_batch_add(&own, pos);
+        tlb_batch_flush(&own);
+    }
+
+    if (coremap_drop_zero(pos)) {
+        frame_unmap_all(pos, 1, -1);
+        pagecache_remove(victim_pa);
+        return;
+    }
+
+    // Lo slot gia' assegnato alla pagina, se c'e', viene riusato
+    swap_offset = coremap[pos].swap_offset;
+    coremap[pos].swap_offset = -1;
+    if (coremap[pos].modified) {
+        // Swap-out della pagina
+        swap_out_batch(&victim_pa, 1, &swap_offset);
+    }
+    else {
+        increment_statistics(STATISTICS_CLEAN_EVICT); // Pagina pulita: nessuna scrittura
+    }
+    // Aggiorniamo le page table per segnare la vittima come "swapped out"
+    // (o, senza slot, da rileggere dall'ELF)
+    frame_unmap_all(pos, 0, swap_offset);
+    pagecache_remove(victim_pa);
+}
+
 // Sezione 2: Funzioni di allocazione per il kernel e utente
 
 // Alloca npages pagine contigue per il kernel e restituisce l'indirizzo virtuale
@@ -132,158 +819,273 @@ vaddr_t alloc_kpages(unsigned long npages) {
 
 // Alloca una pagina di memoria per l'indirizzo virtuale dato (per user )
 paddr_t page_alloc(vaddr_t vaddr/*, int state*/) {
+    return page_alloc_as(proc_getas(), vaddr);
+}
+
+// Alloca una pagina di memoria per l'indirizzo virtuale dato dell'address space as
+paddr_t page_alloc_as(struct addrspace *as_cur, vaddr_t vaddr) {
     paddr_t pa;
-    struct addrspace *as_cur;
 
     if (!isCoremapActive()) return 0;
     vm_can_sleep();
 
-    as_cur = proc_getas();
     KASSERT(as_cur != NULL);
 
-    pa = getppage_user(vaddr, as_cur/*, state*/);  // Richiede una pagina fisica
+    pa = getppage_user(vaddr, as_cur, 1);  // Richiede una pagina fisica
     return pa;
 }
 
-// Funzione helper per assegnare pagina utente ad un frame della coremap
-static paddr_t getppage_user(vaddr_t va, struct addrspace *as/*, int state*/) {
+// Come page_alloc_as, ma senza eviction: restituisce 0 se non ci sono frame liberi (read-ahead)
+paddr_t page_alloc_noevict(struct addrspace *as_cur, vaddr_t vaddr) {
+    if (!isCoremapActive()) return 0;
+    vm_can_sleep();
+
+    KASSERT(as_cur != NULL);
+
+    return getppage_user(vaddr, as_cur, 0);
+}
+
+// Intesta alla pagina va di as il frame pos, appena prelevato e non ancora pubblicato
+static void coremap_assign_user(int pos, struct addrspace *as, vaddr_t va) {
+    // Il frame e' ormai di nostra esclusiva proprieta': non serve il lock globale,
+    // basta rendere visibile lo stato dirty dopo gli altri campi
+    coremap[pos].as = as;
+    coremap[pos].vaddr = va;
+    coremap[pos].alloc_size = 1;
+    coremap[pos].referenced = 1; // La pagina sta per essere usata dal processo che ha fatto fault
+    coremap[pos].last_use = vm_vtime;
+    coremap[pos].refcount = 0; // Non sostituibile finche' non viene pubblicato
+    coremap[pos].modified = 0;
+    coremap[pos].swap_offset = -1;
+    membar_store_store();
+    coremap[pos].status = dirty;
+}
+
+/*
+ * Preleva un frame dalla riserva di frame azzerati, -1 se e' vuota. Con
+ * from_fault la richiesta viene da page_alloc_zeroed e conta come hit o miss.
+ */
+static int zero_pool_take(int from_fault) {
+    int frame = -1;
+
+    spinlock_acquire(&zero_pool_lock);
+    if (zero_pool_count > 0) {
+        frame = zero_pool[--zero_pool_count];
+        if (from_fault) {
+            zero_pool_hits++;
+        }
+    }
+    else if (from_fault) {
+        zero_pool_misses++;
+    }
+    spinlock_release(&zero_pool_lock);
+    return frame;
+}
+
+// Funzione helper per assegnare pagina utente ad un frame della coremap.
+// Se evict e' 0 e non ci sono frame liberi restituisce 0 invece di scegliere una vittima
+static paddr_t getppage_user(vaddr_t va, struct addrspace *as, int evict) {
     volatile int found = 0, pos;
-    int i;
-    unsigned int victim;
+    int i, victim;
     paddr_t pa;
-    vaddr_t victim_va; // Indirizzo virtuale della vittima
-    paddr_t victim_pa; // Indirizzo fisico della vittima
-    int result_swap_out; // Risultato della funzione swap_out
-    int result;
     
-    // Per proteggere l'accesso alla coremap
-    spinlock_acquire(&freemem_lock);
-    // Cerca una pagina precedentemente liberata, usando una ricerca lineare
-    for(i = 1; i < nRamFrames && !found; i++) {
-        if(coremap[i].status == free) {
-            found = 1;
-            break;
-        }
+    // Preleva un frame dalla cache della CPU corrente, senza prendere il lock globale
+    i = frame_cache_get();
+    if (i < 0) {
+        // Le cache delle altre CPU potrebbero trattenere gli ultimi frame liberi
+        frame_cache_drain_all();
+        freemem_lock_acquire();
+        i = freerun_take(1);
+        spinlock_release(&freemem_lock);
+    }
+    if (i < 0) {
+        // Gli ultimi frame liberi possono essere nella riserva di frame azzerati
+        i = zero_pool_take(0);
+    }
+    if (i >= 0) {
+        found = 1;
     }
-    // Rilascio del lock precedentemente acquisito
-    spinlock_release(&freemem_lock);
 
     if(found) {
         pos = i;
         pa = i * PAGE_SIZE;
     }
+    else if (!evict) {
+        pageout_notify(0);
+        return 0;
+    }
     else {
-        // Se non ci sono pagine libere, chiede una pagina 'clean' alla RAM
-        spinlock_acquire(&stealmem_lock);
-        pa = ram_stealmem(1);
-        spinlock_release(&stealmem_lock);
-
-        // Se non c'è memoria fisica disponibile dobbiamo scegliere una victim tramite Round Robin
-        if(pa == 0) {
-            victim = get_victim_coremap(1);
-            pos = victim;
-            // Qui dovremmo chiamare la funzione swap_out per scrivere la pagina vittima su swap
-            victim_pa = pos * PAGE_SIZE; // Calcoliamo l'indirizzo fisico della vittima
-            victim_va = coremap[pos].vaddr; // Recuperiamo l'indirizzo virtuale della vittima
-            result_swap_out = swap_out(victim_pa, victim_va); // Swap-out della pagina
-            // Aggiorniamo lo stato della pagina nel page table per segnare la vittima come "swapped out"
-            pt_set_offset(as->pt, victim_va, result_swap_out);
-            pt_set_pa(as->pt, victim_va, 0);
-            pa = victim_pa; // Impostiamo l'indirizzo fisico della vittima come la pagina da restituire
-            pos = victim_pa / PAGE_SIZE; // Impostiamo la posizione della vittima
-            result = tlb_remove_by_va(victim_va); //Rimozione dalla TLB dell'entry associata all'indirizzo virtuale della vittima (victim_va)
-            KASSERT(result == 0);
-        } else {  
-            pos = pa / PAGE_SIZE;
+        // Se non c'è memoria fisica disponibile dobbiamo scegliere una victim secondo la politica di rimpiazzo.
+        // Succede solo se il demone di pageout non ha tenuto il passo con le allocazioni
+        victim = coremap_claim_victims(1);
+        if (victim < 0) {
+            panic("coremap.c: no user frame can be selected as victim\n");
         }
+        pos = victim;
+        coremap_evict(pos, NULL); // Swap-out della pagina, aggiornando la page table del suo proprietario
+        direct_evictions++;
+        pa = pos * PAGE_SIZE; // Impostiamo l'indirizzo fisico della vittima come la pagina da restituire
     }
 
-    // Per proteggere l'accesso alla coremap
-    spinlock_acquire(&freemem_lock);
-    coremap[pos].as = as;
-    coremap[pos].status = dirty;
-    coremap[pos].vaddr = va;
-    coremap[pos].alloc_size = 1;
-    // Rilascio del lock precedentemente acquisito
-    spinlock_release(&freemem_lock);
+    coremap_assign_user(pos, as, va);
+
+    if (!found) {
+        coremap_busy_done();
+    }
+    pageout_notify(coremap_free_frames());
 
     return pa;
 }
 
+// Alloca una pagina azzerata per l'indirizzo virtuale dato, dalla riserva se possibile
+paddr_t page_alloc_zeroed(vaddr_t vaddr) {
+    paddr_t pa;
+    int pos = -1;
+
+    if (!isCoremapActive()) return 0;
+    vm_can_sleep();
+
+    if (zero_pool_enabled) {
+        pos = zero_pool_take(1);
+    }
+    if (pos < 0) {
+        pa = page_alloc(vaddr);
+        bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+        return pa;
+    }
+
+    coremap_assign_user(pos, proc_getas(), vaddr);
+    pageout_notify(coremap_free_frames());
+    return pos * PAGE_SIZE;
+}
+
+// Azzera un frame libero e lo aggiunge alla riserva (ciclo idle di thread_switch)
+int coremap_zero_pool_fill(void) {
+    int frame;
+
+    // Prima i controlli senza lock: il ciclo idle chiama questa funzione ad ogni risveglio
+    if (!zero_pool_enabled || zero_pool_count >= ZERO_POOL_SIZE || !isCoremapActive()) {
+        return 0;
+    }
+    // Solo frame gia' liberi: riempire la riserva non deve provocare eviction
+    frame = frame_cache_get();
+    if (frame < 0) {
+        return 0;
+    }
+    bzero((void *)PADDR_TO_KVADDR(frame * PAGE_SIZE), PAGE_SIZE);
+
+    spinlock_acquire(&zero_pool_lock);
+    if (zero_pool_count < ZERO_POOL_SIZE) {
+        zero_pool[zero_pool_count++] = frame;
+        frame = -1;
+    }
+    spinlock_release(&zero_pool_lock);
+    if (frame >= 0) {
+        // Un altro CPU ha occupato l'ultimo posto nel frattempo
+        frame_cache_put(frame);
+    }
+    return 1;
+}
+
+int coremap_frame_cache_set_enabled(int enabled) {
+    int old;
+
+    old = frame_cache_enabled;
+    frame_cache_enabled = enabled;
+    if (!enabled) {
+        frame_cache_drain_all();
+    }
+    return old;
+}
+
+int coremap_zero_pool_set_enabled(int enabled) {
+    int old;
+
+    old = zero_pool_enabled;
+    zero_pool_enabled = enabled;
+    return old;
+}
+
+void coremap_zero_pool_stats(unsigned int *hits, unsigned int *misses) {
+    spinlock_acquire(&zero_pool_lock);
+    *hits = zero_pool_hits;
+    *misses = zero_pool_misses;
+    spinlock_release(&zero_pool_lock);
+}
+
 // Ottiene npages pagine fisiche libere e le imposta come "fixed" nella coremap ( per il kernel )
 static paddr_t getppages(unsigned long npages) {
-    unsigned long i, pos;
+    unsigned long i;
     paddr_t addr;
-    unsigned int victim;
-    volatile paddr_t victim_pa;
-    vaddr_t victim_va;
-    int result_swap_out;
-    struct addrspace* as;
-    int result;
-    addr = getfreeppages(npages);
-    // Viene ritornato 0 se non sono disponibili pagine liberate in precedenza, quindi si "rubano" dalla RAM
-    if (addr == 0) {
+    int victim = -1;
+    struct tlb_batch tb;
+    // Prima dell'attivazione della coremap le pagine si "rubano" direttamente dalla RAM
+    if (!isCoremapActive()) {
         spinlock_acquire(&stealmem_lock);
         addr = ram_stealmem(npages);
         spinlock_release(&stealmem_lock);
+        return addr;
     }
+    addr = getfreeppages(npages);
     if(addr == 0) {
-        // Se addr è ancora 0, scegliamo una vittima da svuotare tramite Round Robin
-        victim = get_victim_coremap(npages);
-        
-        // Otteniamo l'address space del processo
-        as = proc_getas();
-        if (as == NULL) return 0;  // Se è un thread del kernel, lasciamo invariato l'address space
-
-        // Eseguiamo lo swap-out delle pagine per liberare spazio
+        // Se addr è ancora 0, scegliamo una sequenza di vittime da svuotare tramite Round Robin.
+        // Ogni frame viene restituito al proprio address space, anche quando a chiedere
+        // memoria e' un thread del kernel
+        victim = coremap_claim_victims(npages);
+        if (victim < 0) {
+            return 0;
+        }
+        // Un solo giro di IPI per tutte le vittime, prima di copiarle nello swap
+        tlb_batch_init(&tb);
+        for(i = 0; i < npages; i++) {
+            frame_tlb_batch_add(&tb, victim + i);
+        }
+        tlb_batch_flush(&tb);
         for(i = 0; i < npages; i++) {
-            pos = victim + i;  
-            victim_pa = pos * PAGE_SIZE;  // Indirizzo fisico della vittima
-            victim_va = coremap[pos].vaddr;  
-            result_swap_out = swap_out(victim_pa, victim_va);  // Swap-out della pagina
-
-            // Aggiorniamo la tabella delle pagine
-            pt_set_offset(as->pt, victim_va, result_swap_out);
-            pt_set_pa(as->pt, victim_va, 0);
-
-            // Rimuoviamo l'entrata dalla TLB
-            result = tlb_remove_by_va(victim_va);
-            KASSERT(result != -1);  // Verifica della rimozione dalla TLB
+            coremap_evict(victim + i, &tb);
         }
+        direct_evictions += npages;
         addr = victim * PAGE_SIZE;  // Impostiamo addr all'indirizzo della vittima
     }
-    if (addr != 0 && isCoremapActive()) {
-        spinlock_acquire(&freemem_lock);
-        //Vengono aggiornate le ritornate da getfreeppages nella coremap, cambiando lo stato da "clean" a "fixed" , cioè assegnate al kernel
+    if (addr != 0) {
+        // Vengono aggiornate le pagine ritornate nella coremap, cambiando lo stato in "fixed" , cioè assegnate al kernel.
+        // Le pagine sono gia' state rimosse dalla free list, per cui non serve il lock globale
         coremap[addr / PAGE_SIZE].alloc_size = npages;
         coremap[addr / PAGE_SIZE].status = fixed;
 
         for(i = 1; i < npages; i++) {
             coremap[(addr / PAGE_SIZE) + i].status = fixed;
         }
-        spinlock_release(&freemem_lock);
+        if (victim >= 0) {
+            coremap_busy_done();
+        }
+        pageout_notify(coremap_free_frames());
     } 
     return addr;
 }
 
-// Cerca npages pagine contigue libere nella coremap
+// Preleva npages pagine contigue libere: la singola pagina dalla cache della CPU, i blocchi dalla free list
 static int getfreeppages(unsigned long npages) {                
     int addr;    
-    volatile long i, first, found;
+    long i, found;
 
     if (!isCoremapActive()) return 0; 
-    spinlock_acquire(&freemem_lock);
-    first = -1;
-    found = -1;
-    for (i = 1; i < nRamFrames; i++) {
-        if (coremap[i].status == free) {
-            if (i == 0 || coremap[i-1].status != free) 
-                first = i;
-            if (i - first + 1 >= (long) npages) {
-                found = first;
-                break;
-            }
-        }
+    found = (npages == 1) ? frame_cache_get() : -1;
+    if (found < 0) {
+        freemem_lock_acquire();
+        found = freerun_take(npages);
+        spinlock_release(&freemem_lock);
+    }
+    if (found < 0) {
+        // Riprova dopo aver restituito alla free list i frame trattenuti nelle cache
+        frame_cache_drain_all();
+        freemem_lock_acquire();
+        found = freerun_take(npages);
+        spinlock_release(&freemem_lock);
+    }
+    if (found < 0 && npages == 1) {
+        // Una pagina della riserva di frame azzerati prima di ricorrere all'eviction
+        found = zero_pool_take(0);
     }
         
     if (found >= 0) {
@@ -297,27 +1099,139 @@ static int getfreeppages(unsigned long npages) {
         addr = 0;
     }
 
-    spinlock_release(&freemem_lock);
     return addr;
 }
 
 // Sezione 3: Funzioni di rilascio per il kernel e utente
 
-// Libera una pagina fisica specificata dall'indirizzo fisico passato come argomento ( per utente )
-void page_free(paddr_t addr) {
+/*
+ * Toglie la mappatura (as, va) dal frame pos, con freemem_lock acquisito, e
+ * rilascia il lock. Con l'ultima mappatura il frame viene sottratto alla
+ * scelta delle vittime sotto il lock, poi torna nella cache della CPU
+ * corrente insieme al suo slot.
+ */
+static void frame_unmap_locked(int pos, struct addrspace *as, vaddr_t va) {
+    off_t swap_offset;
+
+    KASSERT(coremap[pos].refcount > 0);
+    if (coremap[pos].refcount > 1) {
+        rmap_remove(pos, as, va);
+        spinlock_release(&freemem_lock);
+        return;
+    }
+
+    KASSERT(coremap[pos].as == as && coremap[pos].vaddr == va);
+    coremap[pos].status = fixed;
+    swap_offset = coremap[pos].swap_offset;
+    coremap[pos].swap_offset = -1;
+    spinlock_release(&freemem_lock);
+    pagecache_remove(pos * PAGE_SIZE);
+    frame_cache_put(pos);
+    if (swap_offset >= 0) {
+        swap_free(swap_offset);
+    }
+}
+
+// Rilascia la mappatura (as, va) della pagina fisica addr ( per utente )
+void page_free(paddr_t addr, struct addrspace *as, vaddr_t va) {
     int pos;
     pos = addr / PAGE_SIZE;
 
     KASSERT(coremap[pos].status != fixed);
 
-    // Per proteggere l'accesso alla coremap
-    spinlock_acquire(&freemem_lock);
-    coremap[pos].status = free;
-    coremap[pos].as = NULL;
-    coremap[pos].alloc_size = 0;
-    coremap[pos].vaddr = 0;
-    // Rilascio del lock precedentemente acquisito
+    freemem_lock_acquire();
+    // Un'eviction in corso si e' gia' appropriata del frame: basta attenderne la fine
+    if (coremap[pos].status == busy) {
+        spinlock_release(&freemem_lock);
+        coremap_wait_busy(addr);
+        return;
+    }
+    frame_unmap_locked(pos, as, va & PAGE_FRAME);
+}
+
+// Restituisce un frame utente mai pubblicato: nessuno puo' sceglierlo come vittima ne' condividerlo
+void page_discard(paddr_t addr) {
+    int pos;
+    pos = addr / PAGE_SIZE;
+
+    KASSERT(coremap[pos].status == dirty && coremap[pos].refcount == 0);
+    frame_cache_put(pos);
+}
+
+// Rilascia la mappatura (as, va) del frame addr solo se esiste ancora e il frame non e' busy
+int coremap_unshare(paddr_t addr, struct addrspace *as, vaddr_t va) {
+    int pos;
+    pos = addr / PAGE_SIZE;
+
+    va &= PAGE_FRAME;
+    freemem_lock_acquire();
+    if (coremap[pos].status != dirty || coremap[pos].refcount == 0 || !rmap_contains(pos, as, va)) {
+        spinlock_release(&freemem_lock);
+        return 0;
+    }
+    frame_unmap_locked(pos, as, va);
+    return 1;
+}
+
+// Aggiunge la mappatura (as, va) al frame utente addr, condiviso in copy-on-write
+int coremap_share(paddr_t addr, struct addrspace *from, struct addrspace *as, vaddr_t va) {
+    int pos, shared;
+    pos = addr / PAGE_SIZE;
+
+    // Il controllo avviene sotto freemem_lock, come la scelta delle vittime.
+    // Un frame trovato nella cache delle pagine puo' non essere ancora pubblicato
+    va &= PAGE_FRAME;
+    freemem_lock_acquire();
+    if (coremap[pos].status != dirty || coremap[pos].refcount == 0 ||
+        (from != NULL && !rmap_contains(pos, from, va))) {
+        shared = COREMAP_SHARE_BUSY;
+    }
+    else if (rmap_add(pos, as, va)) {
+        shared = COREMAP_SHARE_OK;
+    }
+    else {
+        shared = COREMAP_SHARE_NOMEM;
+    }
     spinlock_release(&freemem_lock);
+    return shared;
+}
+
+// Rende as proprietario esclusivo del frame addr, se non e' piu' condiviso, e lo marca modificato
+int coremap_cow_claim(paddr_t addr, struct addrspace *as, vaddr_t va) {
+    int pos, claim;
+    pos = addr / PAGE_SIZE;
+
+    va &= PAGE_FRAME;
+    // Un frame in corso di swap-out (o gia' liberato da un'eviction appena
+    // conclusa) non va reso scrivibile: il chiamante ripete l'accesso
+    if (coremap[pos].status != dirty) {
+        return COREMAP_COW_BUSY;
+    }
+
+    // Caso comune: pagina privata gia' intestata ad as e gia' modificata, nessun lock
+    if (coremap[pos].refcount == 1 && coremap[pos].as == as && coremap[pos].vaddr == va &&
+        coremap[pos].modified) {
+        return COREMAP_COW_OWNED;
+    }
+
+    // Il bit modified va impostato sotto il lock: un'eviction che sceglie il
+    // frame dopo di noi deve vederlo, una che lo ha gia' scelto va segnalata
+    // come tale, perche' la copia del chiamante correrebbe con la sua pt_set_offset.
+    // Un frame che non ha piu' la mappatura (as, va) e' stato liberato da
+    // un'eviction dopo la lettura della PTE, e va trattato allo stesso modo
+    freemem_lock_acquire();
+    if (coremap[pos].status != dirty || coremap[pos].refcount == 0 || !rmap_contains(pos, as, va)) {
+        claim = COREMAP_COW_BUSY;
+    }
+    else if (coremap[pos].refcount == 1) {
+        coremap[pos].modified = 1;
+        claim = COREMAP_COW_OWNED;
+    }
+    else {
+        claim = COREMAP_COW_SHARED;
+    }
+    spinlock_release(&freemem_lock);
+    return claim;
 }
 
 // Libera le pagine kernel contigue specificate dall'indirizzo virtuale iniziale ( per kernel )
@@ -332,20 +1246,231 @@ void free_kpages(vaddr_t addr) {
 
 // Libera npages pagine fisiche contigue a partire dall'indirizzo fisico specificato ( per kernel )
 static int freeppages(paddr_t addr, unsigned long npages) {
-    long i, first;    
+    long first;    
 
     if (!isCoremapActive()) return 0; 
     first = addr / PAGE_SIZE;
     KASSERT(nRamFrames > first);
 
-    spinlock_acquire(&freemem_lock);
-    for (i = first; i < first + (long) npages; i++) {
-        coremap[i].status = free;
-        coremap[i].as = NULL;
-        coremap[i].alloc_size = 0;
+    // Le pagine rubate prima dell'attivazione della coremap hanno alloc_size 0 e non vengono mai liberate
+    if (npages == 0) return 0;
+
+    if (npages == 1) {
+        frame_cache_put(first);
+        return 1;
     }
+    freemem_lock_acquire();
+    freerun_release(first, npages);
     spinlock_release(&freemem_lock);
 
     return 1;
 }
 
+// Rende sostituibile il frame appena allocato addr, ormai presente nella page table
+void coremap_publish(paddr_t addr, int modified, off_t swap_offset) {
+    int pos;
+    pos = addr / PAGE_SIZE;
+
+    KASSERT(coremap[pos].status == dirty);
+    KASSERT(coremap[pos].refcount == 0);
+    coremap[pos].modified = modified;
+    coremap[pos].swap_offset = swap_offset;
+    // Il frame e' ancora di nostra esclusiva proprieta': basta rendere visibile
+    // il riferimento dopo gli altri campi, come in getppage_user
+    membar_store_store();
+    coremap[pos].refcount = 1;
+}
+
+// Indica se la pagina nel frame addr e' stata modificata rispetto alla sua copia
+int coremap_is_modified(paddr_t addr) {
+    return coremap[addr / PAGE_SIZE].modified;
+}
+
+// Slot dello swap con una copia della pagina nel frame addr (-1 se assente)
+off_t coremap_get_swap_offset(paddr_t addr) {
+    return coremap[addr / PAGE_SIZE].swap_offset;
+}
+
+// Indica se il frame addr e' in corso di swap-out
+int coremap_is_busy(paddr_t addr) {
+    int busy_now;
+
+    busy_now = coremap[addr / PAGE_SIZE].status == busy;
+    membar_any_any();
+    return busy_now;
+}
+
+// Attende che termini lo swap-out del frame addr, se in corso
+void coremap_wait_busy(paddr_t addr) {
+    int pos;
+    pos = addr / PAGE_SIZE;
+
+    spinlock_acquire(&busy_lock);
+    while (coremap[pos].status == busy) {
+        wchan_sleep(busy_wchan, &busy_lock);
+    }
+    spinlock_release(&busy_lock);
+}
+
+// Numero di frame liberi, compresi quelli nelle cache per CPU e nella riserva
+// di frame azzerati (letto senza lock: e' una stima)
+unsigned int coremap_free_frames(void) {
+    unsigned int i, n;
+
+    n = nFreeFrames + zero_pool_count;
+    for (i = 0; i < MAXCPUS; i++) {
+        n += frame_caches[i].count;
+    }
+    return n;
+}
+
+// Numero totale di frame della RAM
+unsigned int coremap_total_frames(void) {
+    return nRamFrames;
+}
+
+// Ordine delle vittime di un blocco di pageout: per proprietario, poi per indirizzo virtuale
+static int frame_cluster_before(int a, int b) {
+    if (coremap[a].as != coremap[b].as) {
+        return (uintptr_t)coremap[a].as < (uintptr_t)coremap[b].as;
+    }
+    return coremap[a].vaddr < coremap[b].vaddr;
+}
+
+/**
+ * Libera fino a max frame utente per conto del demone di pageout: sceglie le
+ * vittime con la politica di rimpiazzo, le invalida nelle TLB con un solo giro
+ * di IPI, scrive nello swap quelle modificate con swap_out_batch (un'unica
+ * scrittura per ogni gruppo di slot consecutivi), scarta quelle pulite e
+ * quelle di soli zeri e
+ * restituisce i frame alla free list.
+ *
+ * @return Il numero di frame liberati (0 se non ci sono frame utente idonei).
+ */
+unsigned int coremap_pageout(unsigned int max) {
+    int frames[PAGEOUT_BATCH];
+    int written[PAGEOUT_BATCH];  // Indici in frames delle pagine da scrivere
+    int zero[PAGEOUT_BATCH];     // 1 per le pagine di soli zeri, scartate senza slot
+    paddr_t pas[PAGEOUT_BATCH];
+    off_t offsets[PAGEOUT_BATCH];
+    struct tlb_batch tb;
+    unsigned int n, nwrite, i, j;
+    int victim;
+
+    if (max > PAGEOUT_BATCH) {
+        max = PAGEOUT_BATCH;
+    }
+
+    for (n = 0; n < max; n++) {
+        victim = coremap_claim_victims(1);
+        if (victim < 0) {
+            break;
+        }
+        frames[n] = victim;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    tlb_batch_init(&tb);
+    for (i = 0; i < n; i++) {
+        frame_tlb_batch_add(&tb, frames[i]);
+    }
+    tlb_batch_flush(&tb);
+
+    // Le vittime vengono ordinate per address space e indirizzo virtuale: le
+    // pagine virtualmente contigue ricevono slot contigui (next-fit), vengono
+    // scritte insieme e potranno essere rilette insieme dal read-ahead
+    for (i = 1; i < n; i++) {
+        victim = frames[i];
+        for (j = i; j > 0 && frame_cluster_before(victim, frames[j - 1]); j--) {
+            frames[j] = frames[j - 1];
+        }
+        frames[j] = victim;
+    }
+
+    // Solo le pagine modificate vengono scritte, nello slot gia' assegnato se
+    // c'e'; quelle di soli zeri non vengono scritte e non occupano slot
+    nwrite = 0;
+    for (i = 0; i < n; i++) {
+        zero[i] = coremap_drop_zero(frames[i]);
+        if (zero[i]) {
+            continue;
+        }
+        if (coremap[frames[i]].modified) {
+            written[nwrite] = frames[i];
+            pas[nwrite] = frames[i] * PAGE_SIZE;
+            offsets[nwrite] = coremap[frames[i]].swap_offset;
+            nwrite++;
+        }
+        else {
+            // Pagina pulita: la page table ricevera' il suo slot (o nessuno, per l'ELF)
+            increment_statistics(STATISTICS_CLEAN_EVICT);
+        }
+    }
+    swap_out_batch(pas, nwrite, offsets);
+
+    for (i = 0; i < nwrite; i++) {
+        coremap[written[i]].swap_offset = offsets[i];
+    }
+    for (i = 0; i < n; i++) {
+        frame_unmap_all(frames[i], zero[i], coremap[frames[i]].swap_offset);
+        coremap[frames[i]].swap_offset = -1;
+        pagecache_remove(frames[i] * PAGE_SIZE);
+    }
+
+    freemem_lock_acquire();
+    for (i = 0; i < n; i++) {
+        freerun_release(frames[i], 1);
+    }
+    pageout_evictions += n;
+    spinlock_release(&freemem_lock);
+    coremap_busy_done();
+
+    return n;
+}
+
+// Sezione 4: Informazioni di recency e statistiche
+
+// Imposta il reference bit della pagina fisica paddr e avanza il tempo virtuale
+void coremap_set_referenced(paddr_t paddr) {
+    int pos = paddr / PAGE_SIZE;
+
+    if (!isCoremapActive()) return;
+    KASSERT(pos > 0 && pos < nRamFrames);
+    vm_vtime++;
+    coremap[pos].referenced = 1;
+    coremap[pos].last_use = vm_vtime;
+}
+
+// Nome della politica di rimpiazzo selezionata con le opzioni c1_clock/c1_wsclock
+const char *coremap_policy_name(void) {
+#if OPT_C1_WSCLOCK
+    return "WSClock";
+#elif OPT_C1_CLOCK
+    return "Clock";
+#else
+    return "Round Robin";
+#endif
+}
+
+// Stampa il traffico sul lock globale della coremap e l'efficacia delle cache per CPU
+void coremap_print_statistics(void) {
+    unsigned int i, hits = 0, misses = 0;
+
+    for (i = 0; i < MAXCPUS; i++) {
+        hits += frame_caches[i].hits;
+        misses += frame_caches[i].misses;
+    }
+    kprintf("COREMAP STATISTICS (%s):\n", coremap_policy_name());
+    kprintf("%25s = %10u\n", "Free List Frames", nFreeFrames);
+    kprintf("%25s = %10u\n", "Freemem Lock Acquires", freemem_lock_acquires);
+    kprintf("%25s = %10u\n", "Freemem Lock Contended", freemem_lock_contended);
+    kprintf("%25s = %10u\n", "Frame Cache Hits", hits);
+    kprintf("%25s = %10u\n", "Frame Cache Misses", misses);
+    kprintf("%25s = %10u\n", "Zero Pool Hits", zero_pool_hits);
+    kprintf("%25s = %10u\n", "Zero Pool Misses", zero_pool_misses);
+    kprintf("%25s = %10u\n", "Pageout Daemon Evictions", pageout_evictions);
+    kprintf("%25s = %10u\n", "Direct Evictions", direct_evictions);
+    kprintf("%25s = %10u\n", "Rmap Pool Exhausted", rmap_exhausted);
+}
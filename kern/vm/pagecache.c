@@ -0,0 +1,129 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vm.h>
+
+#include <coremap.h>
+#include <pagecache.h>
+
+// Voce della cache per un frame della RAM (indicizzata dal numero di frame)
+struct pagecache_entry {
+    struct vnode *vn;   // File della pagina (NULL: frame non presente nella cache)
+    off_t offset;       // Offset nel file dell'inizio della pagina
+    int next;           // Frame successivo nello stesso bucket (-1 se assente)
+};
+
+static struct spinlock pagecache_lock = SPINLOCK_INITIALIZER;
+static struct pagecache_entry *pagecache_entries = NULL;
+static int pagecache_heads[PAGECACHE_BUCKETS];  // Primo frame di ogni bucket (-1 se vuoto)
+
+static unsigned int pagecache_bucket(struct vnode *vn, off_t offset) {
+    uint32_t h;
+
+    h = (uint32_t)(uintptr_t)vn / sizeof(void *);
+    h ^= (uint32_t)(offset / PAGE_SIZE) * 2654435761U;
+    return h & (PAGECACHE_BUCKETS - 1);
+}
+
+void pagecache_init(void) {
+    unsigned int i, nframes;
+
+    nframes = coremap_total_frames();
+    pagecache_entries = kmalloc(nframes * sizeof(struct pagecache_entry));
+    KASSERT(pagecache_entries != NULL);
+    for (i = 0; i < nframes; i++) {
+        pagecache_entries[i].vn = NULL;
+        pagecache_entries[i].offset = 0;
+        pagecache_entries[i].next = -1;
+    }
+    for (i = 0; i < PAGECACHE_BUCKETS; i++) {
+        pagecache_heads[i] = -1;
+    }
+}
+
+// Frame con la pagina offset di vn nel bucket b, -1 se assente (con pagecache_lock)
+static int pagecache_find(unsigned int b, struct vnode *vn, off_t offset) {
+    int pos;
+
+    for (pos = pagecache_heads[b]; pos >= 0; pos = pagecache_entries[pos].next) {
+        if (pagecache_entries[pos].vn == vn && pagecache_entries[pos].offset == offset) {
+            return pos;
+        }
+    }
+    return -1;
+}
+
+paddr_t pagecache_lookup(struct vnode *vn, off_t offset, struct addrspace *as, vaddr_t va, pte_t *pte) {
+    paddr_t pa;
+    int pos;
+
+    if (pagecache_entries == NULL) {
+        return 0;
+    }
+
+    // Il riferimento viene aggiunto sotto il lock: il frame non puo' uscire
+    // dalla cache, ed essere riusato, tra la ricerca e coremap_share. Con la
+    // mappa inversa esaurita la pagina viene riletta dall'ELF
+    spinlock_acquire(&pagecache_lock);
+    pos = pagecache_find(pagecache_bucket(vn, offset), vn, offset);
+    pa = 0;
+    if (pos >= 0) {
+        pte_set_pa(pte, pos * PAGE_SIZE);
+        if (coremap_share(pos * PAGE_SIZE, NULL, as, va) == COREMAP_SHARE_OK) {
+            pa = pos * PAGE_SIZE;
+        }
+        else {
+            *pte = 0;
+        }
+    }
+    spinlock_release(&pagecache_lock);
+    return pa;
+}
+
+int pagecache_insert(struct vnode *vn, off_t offset, paddr_t pa) {
+    unsigned int b;
+    int pos;
+
+    if (pagecache_entries == NULL) {
+        return 0;
+    }
+    pos = pa / PAGE_SIZE;
+    KASSERT(pagecache_entries[pos].vn == NULL);
+
+    b = pagecache_bucket(vn, offset);
+    spinlock_acquire(&pagecache_lock);
+    // Un altro processo puo' aver letto la stessa pagina nel frattempo: la
+    // nostra copia resta privata
+    if (pagecache_find(b, vn, offset) >= 0) {
+        spinlock_release(&pagecache_lock);
+        return 0;
+    }
+    pagecache_entries[pos].vn = vn;
+    pagecache_entries[pos].offset = offset;
+    pagecache_entries[pos].next = pagecache_heads[b];
+    pagecache_heads[b] = pos;
+    spinlock_release(&pagecache_lock);
+    return 1;
+}
+
+void pagecache_remove(paddr_t pa) {
+    int pos, *link;
+
+    pos = pa / PAGE_SIZE;
+    // Senza lock: la voce cambia solo per mano di chi possiede il frame
+    // (pagecache_insert prima della pubblicazione, poi chi lo libera)
+    if (pagecache_entries == NULL || pagecache_entries[pos].vn == NULL) {
+        return;
+    }
+
+    spinlock_acquire(&pagecache_lock);
+    link = &pagecache_heads[pagecache_bucket(pagecache_entries[pos].vn, pagecache_entries[pos].offset)];
+    while (*link != pos) {
+        KASSERT(*link >= 0);
+        link = &pagecache_entries[*link].next;
+    }
+    *link = pagecache_entries[pos].next;
+    pagecache_entries[pos].vn = NULL;
+    pagecache_entries[pos].next = -1;
+    spinlock_release(&pagecache_lock);
+}
@@ -0,0 +1,88 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <membar.h>
+#include <vm.h>
+
+#include <coremap.h>
+#include <pageout.h>
+
+// Modulo per il demone di pageout
+static struct spinlock pageout_lock = SPINLOCK_INITIALIZER;
+static struct wchan *pageout_wchan = NULL;   // Il demone dorme qui quando c'e' abbastanza memoria libera
+static volatile int pageout_running = 0;     // 1 mentre il demone sta liberando frame
+static unsigned int pageout_low = 0;         // Sotto questa soglia il demone si risveglia
+static unsigned int pageout_high = 0;        // Il demone libera frame fino a questa soglia
+
+/*
+ * Corpo del demone: dorme finche' i frame liberi non scendono sotto la soglia
+ * bassa, poi esegue swap-out a blocchi fino alla soglia alta. Se non ci sono
+ * frame utente da liberare (es. memoria occupata dal kernel) torna a dormire
+ * fino alla prossima segnalazione, invece di riprovare a vuoto.
+ */
+static void pageout_thread(void *data1, unsigned long data2) {
+    unsigned int freed;
+    int stuck = 0;
+
+    (void)data1;
+    (void)data2;
+
+    while (1) {
+        spinlock_acquire(&pageout_lock);
+        pageout_running = 0;
+        while (stuck || coremap_free_frames() >= pageout_low) {
+            wchan_sleep(pageout_wchan, &pageout_lock);
+            stuck = 0;
+        }
+        pageout_running = 1;
+        spinlock_release(&pageout_lock);
+
+        while (coremap_free_frames() < pageout_high) {
+            freed = coremap_pageout(PAGEOUT_BATCH);
+            if (freed == 0) {
+                stuck = 1;
+                break;
+            }
+        }
+
+        // Lascia spazio agli altri thread prima di ricontrollare le soglie
+        thread_yield();
+    }
+}
+
+// Calcola le soglie e avvia il thread del demone
+void pageout_bootstrap(void) {
+    int result;
+
+    pageout_low = coremap_total_frames() / PAGEOUT_LOW_DIV;
+    if (pageout_low < PAGEOUT_LOW_MIN) {
+        pageout_low = PAGEOUT_LOW_MIN;
+    }
+    pageout_high = 2 * pageout_low;
+
+    pageout_wchan = wchan_create("pageout");
+    KASSERT(pageout_wchan != NULL);
+
+    result = thread_fork("pageout", NULL, pageout_thread, NULL, 0);
+    if (result) {
+        panic("pageout: thread_fork failed: %s\n", strerror(result));
+    }
+    kprintf("pageout: low watermark %u frames, high watermark %u frames\n",
+            pageout_low, pageout_high);
+}
+
+// Risveglia il demone se i frame liberi sono sotto la soglia bassa
+void pageout_notify(unsigned int nfree) {
+    // Percorso veloce, senza lock: il demone non e' ancora avviato, e' gia'
+    // al lavoro oppure c'e' ancora abbastanza memoria libera
+    if (pageout_wchan == NULL || pageout_running || nfree >= pageout_low) {
+        return;
+    }
+
+    spinlock_acquire(&pageout_lock);
+    wchan_wakeone(pageout_wchan, &pageout_lock);
+    spinlock_release(&pageout_lock);
+}
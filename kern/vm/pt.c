@@ -7,11 +7,13 @@
 #include <proc.h>
 #include <current.h>
 #include <mips/tlb.h>
+#include <membar.h>
 #include <vm.h>
 #include <coremap.h> // include header per modulo Coremap
 
 #include <pt.h>
 #include <vmc1.h>
+#include <swapfile.h>
 
 /* Funzioni di utilità per l'estrazione di indici e offset dall'indirizzo virtuale */
 
@@ -44,134 +46,373 @@ static int get_page_offset(vaddr_t va) {
     return va & D_MASK; // Usa i bit meno significativi (offset)
 }
 
+/**
+ * Percorre la page table una sola volta e restituisce il puntatore alla PTE
+ * di va (handle), su cui il page fault legge lo stato della pagina e la
+ * aggiorna (pte_set_pa, pte_set_offset) senza ricalcolare gli indici.
+ * Con create la inner table viene allocata se manca, altrimenti in quel caso
+ * si restituisce NULL. L'handle resta valido finche' esiste la inner table,
+ * cioe' fino alla distruzione della page table.
+ * @param pt: puntatore alla directory di pagine
+ * @param va: indirizzo virtuale
+ * @param create: alloca la inner table se non esiste
+ * @return puntatore alla PTE, NULL se la inner table non esiste e !create
+ */
+pte_t *pt_walk(struct pt_directory* pt, vaddr_t va, int create) {
+    unsigned int outer, inner;
+    pte_t *table;
+
+    outer = get_outer_index(va);
+    KASSERT(outer < SIZE_PT_OUTER);
+
+    inner = get_inner_index(va);
+    KASSERT(inner < SIZE_PT_INNER);
+    KASSERT(get_page_offset(va) < PAGE_SIZE);
+
+    table = pt->tables[outer];
+    if (table == NULL) {
+        if (!create) {
+            return NULL;
+        }
+        if (pt_define_inner(pt, va)) {
+            panic("pt.c: out of memory for an inner page table\n");
+        }
+        table = pt->tables[outer];
+    }
+    return &table[inner];
+}
+
+/**
+ * Registra nella PTE che la pagina e' residente nel frame pa, con un'unica
+ * scrittura. L'eventuale slot dello swap della pagina passa al frame
+ * (coremap_publish).
+ * @param pte: handle restituito da pt_walk
+ * @param pa: indirizzo fisico del frame
+ */
+void pte_set_pa(pte_t *pte, paddr_t pa) {
+    KASSERT(pa != PFN_NOT_USED && (pa & PAGE_FRAME) == pa);
+    *pte = pa | PTE_PRESENT;
+}
+
+/**
+ * Registra nella PTE che la pagina e' nello slot offset dello swap, oppure
+ * (offset -1) che non ha copia nello swap, con un'unica scrittura.
+ * @param pte: handle restituito da pt_walk
+ * @param offset: offset dello slot nello swap, -1 se assente
+ */
+void pte_set_offset(pte_t *pte, off_t offset) {
+    if (offset < 0) {
+        *pte = 0;
+    } else {
+        KASSERT(offset % PAGE_SIZE == 0 && offset <= (off_t)PTE_NUMBER);
+        *pte = (pte_t)offset | PTE_SWAPPED;
+    }
+}
+
+/**
+ * Registra nella PTE che la pagina contiene solo zeri, senza frame ne' slot.
+ * @param pte: handle restituito da pt_walk
+ */
+void pte_set_zero(pte_t *pte) {
+    *pte = PTE_ZERO;
+}
+
 /* Gestione della struttura della page table */
 
 /**
  * Crea una nuova directory di pagine (outer table).
- * Alloca memoria per la struttura e inizializza tutte le entries come non valide.
+ * I puntatori alle inner table occupano una pagina, allocata dalla coremap;
+ * inizialmente non c'e' alcuna inner table.
+ * @param as: address space a cui appartiene la page table
  * @return puntatore alla nuova directory di pagine
  */
-struct pt_directory* pt_create(void) {
-    unsigned int i;
+struct pt_directory* pt_create(struct addrspace *as) {
     struct pt_directory *pt;
 
     pt = kmalloc(sizeof(struct pt_directory));
     KASSERT(pt != NULL); // Assicura che la memoria sia stata allocata
+    pt->as = as;
 
-    pt->size = SIZE_PT_OUTER;
-    pt->pages = kmalloc(sizeof(struct pt_outer_entry) * SIZE_PT_OUTER);
-    KASSERT(pt->pages != NULL); // Assicura che la memoria sia stata allocata
+    KASSERT(SIZE_PT_OUTER * sizeof(pte_t *) == PAGE_SIZE);
+    pt->tables = (pte_t **)alloc_kpages(1);
+    KASSERT(pt->tables != NULL);
 
-    // Inizializza tutte le entries della outer table come non valide
-    for (i = 0; i < pt->size; i++) {
-        pt->pages[i].pages = NULL;
-        pt->pages[i].valid = 0;
-    }
+    // Nessuna inner table allocata
+    bzero(pt->tables, PAGE_SIZE);
+    bzero(pt->populated, sizeof(pt->populated));
 
     return pt;
 }
 
 /**
- * Libera la memoria associata a una tabella interna (inner table) della paginazione.
- * 
- * @param pt_inner Una struttura rappresentante una entry di livello superiore che punta
- *                 a una inner table.
+ * Rilascia la pagina descritta da una PTE: il riferimento al frame (liberato,
+ * insieme al suo slot dello swap, se non e' condiviso con altri processi)
+ * oppure lo slot dello swap, e azzera la PTE. Una pagina di soli zeri
+ * (PTE_ZERO) non ha nulla da rilasciare.
+ * @param pt: page table della PTE
+ * @param pte: handle della PTE
+ * @param va: indirizzo virtuale della pagina
  */
-void pt_destroy_inner(struct pt_outer_entry pt_inner) {
+static void pte_release(struct pt_directory *pt, pte_t *pte, vaddr_t va) {
+    if (*pte & PTE_PRESENT) {
+        // Se il frame e' in corso di swap-out si attende che l'eviction aggiorni la voce
+        page_free(*pte & PTE_NUMBER, pt->as, va);
+        if (*pte & PTE_SWAPPED) {
+            // L'eviction si e' conclusa mentre si attendeva: lo slot ora e' nella PTE
+            swap_free(*pte & PTE_NUMBER);
+        }
+    }
+    else if (*pte & PTE_SWAPPED) {
+        // Riferimento allo slot: viene liberato solo se nessun altro processo lo condivide
+        swap_free(*pte & PTE_NUMBER);
+    }
+    *pte = 0;
+}
 
-    unsigned int i; // Variabile per l'indice del ciclo for
+/**
+ * Rilascia le pagine dell'intervallo [start, end), saltando le inner table
+ * non allocate senza visitarne le PTE. Con reclaim restituisce alla coremap
+ * le inner table rimaste vuote.
+ */
+static void pt_release_range(struct pt_directory* pt, vaddr_t start, vaddr_t end, int reclaim) {
+    unsigned int outer, inner, last, i;
+    pte_t *table;
+    vaddr_t va, next;
+
+    KASSERT((start & PAGE_FRAME) == start && (end & PAGE_FRAME) == end);
+
+    for (va = start; va < end; va = next) {
+        outer = get_outer_index(va);
+        // Fine dell'intervallo coperto da questa inner table
+        next = (va & P_OUT_MASK) + SIZE_PT_INNER * PAGE_SIZE;
+        if (next == 0 || next > end) {
+            next = end;
+        }
+        table = pt->tables[outer];
+        if (table == NULL) {
+            continue; // Nessuna pagina mai toccata nei 4 MB di questa inner table
+        }
 
-    KASSERT(pt_inner.pages != NULL);
-    KASSERT(pt_inner.size != 0);
-    KASSERT(pt_inner.valid != 0);
+        last = get_inner_index(next - PAGE_SIZE);
+        for (inner = get_inner_index(va); inner <= last; inner++) {
+            if (table[inner] != 0) {
+                pte_release(pt, &table[inner], (va & P_OUT_MASK) | (inner << 12));
+            }
+        }
 
-    // Itera su tutte le pagine della tabella interna
-    for (i = 0; i < pt_inner.size; i++) {
-        // Verifica se l'entry corrente è valida e che la pagina non sia stata "swappata"
-        if (pt_inner.pages[i].valid && pt_inner.pages[i].swap_offset != 1) {
-            // Libera il frame fisico associato all'indice di pagina (PFN - Page Frame Number)
-            page_free(pt_inner.pages[i].pfn);
+        if (!reclaim) {
+            continue;
+        }
+        for (i = 0; i < SIZE_PT_INNER && table[i] == 0; i++);
+        if (i == SIZE_PT_INNER) {
+            // Ultima pagina della inner table rimossa: la tabella torna alla coremap
+            pt->tables[outer] = NULL;
+            pt->populated[outer / 32] &= ~(1U << (outer % 32));
+            free_kpages((vaddr_t)table);
         }
     }
+}
 
-    // Libera la memoria allocata per l'array delle pagine nella tabella interna
-    kfree(pt_inner.pages);
+/**
+ * Rilascia i frame e gli slot dello swap delle pagine in [start, end),
+ * visitando solo le inner table allocate. Le inner table restano allocate:
+ * vengono liberate tutte insieme da pt_destroy.
+ * @param pt: puntatore alla directory di pagine
+ * @param start: primo indirizzo (allineato alla pagina)
+ * @param end: fine dell'intervallo, esclusa (allineata alla pagina)
+ */
+void pt_destroy_range(struct pt_directory* pt, vaddr_t start, vaddr_t end) {
+    pt_release_range(pt, start, end, 0);
 }
 
+/**
+ * Rimuove le pagine in [start, end) come pt_destroy_range e restituisce alla
+ * coremap le inner table rimaste senza pagine. Le voci della TLB e della
+ * cache software vanno invalidate dal chiamante.
+ * @param pt: puntatore alla directory di pagine
+ * @param start: primo indirizzo (allineato alla pagina)
+ * @param end: fine dell'intervallo, esclusa (allineata alla pagina)
+ */
+void pt_unmap(struct pt_directory* pt, vaddr_t start, vaddr_t end) {
+    pt_release_range(pt, start, end, 1);
+}
 
 /**
- * Libera tutta la memoria associata a una directory di pagine (outer table e inner tables).
+ * Libera la directory di pagine e le inner table allocate, trovate con la
+ * bitmap populated senza scorrere la outer table. Le pagine devono essere
+ * gia' state rilasciate con pt_destroy_range (as_destroy lo fa per ogni
+ * segmento).
  * @param pt: puntatore alla directory di pagine
  */
 void pt_destroy(struct pt_directory* pt) {
-    unsigned int i;
+    unsigned int i, bit, outer;
+    uint32_t word;
 
     KASSERT(pt != NULL); // Assicura che il puntatore sia valido
 
-    // Itera su tutte le entries della outer table
-    for (i = 0; i < pt->size; i++) {
-        if (pt->pages[i].pages != NULL && pt->pages[i].valid) {
-            pt_destroy_inner(pt->pages[i]); // Libera la inner table se valida
+    for (i = 0; i < SIZE_PT_OUTER / 32; i++) {
+        for (word = pt->populated[i]; word != 0; word &= ~(1U << bit)) {
+            for (bit = 0; !(word & (1U << bit)); bit++);
+            outer = i * 32 + bit;
+            KASSERT(pt->tables[outer] != NULL);
+            free_kpages((vaddr_t)pt->tables[outer]);
         }
     }
 
-    // Libera la memoria della outer table e della struttura
-    kfree(pt->pages);
+    // Libera la pagina della outer table
+    free_kpages((vaddr_t)pt->tables);
     kfree(pt);
 }
 
+/**
+ * Duplica la page table src in dst (vuota) per una fork in copy-on-write,
+ * con un costo proporzionale alle PTE usate e senza accessi al disco.
+ * Le pagine residenti non vengono copiate: il frame viene condiviso
+ * (coremap_share), insieme al suo eventuale slot nello swap, e resterà in sola
+ * lettura nella TLB di entrambi i processi finché uno dei due non ci scrive.
+ * Solo se la mappa inversa della coremap e' esaurita la pagina viene copiata
+ * in un frame privato di dst_as.
+ * Anche le pagine nello swap vengono condivise: il figlio riceve un
+ * riferimento allo stesso slot (swap_share) e le leggera' solo al primo
+ * accesso. Le pagine di soli zeri restano tali anche nel figlio.
+ * @param src: page table del processo padre
+ * @param dst: page table del figlio, appena creata
+ * @param dst_as: address space del figlio
+ * @return 0, ENOMEM se manca la memoria per una inner table o per la copia
+ *         di una pagina del figlio (le voci gia' copiate vanno rilasciate
+ *         distruggendo dst)
+ */
+int pt_copy(struct pt_directory *src, struct pt_directory *dst, struct addrspace *dst_as) {
+    unsigned int i, j;
+    pte_t *from, *to;
+    pte_t pte;
+    vaddr_t va;
+    paddr_t pa;
+    int result;
+
+    KASSERT(src != NULL && dst != NULL);
+
+    for (i = 0; i < SIZE_PT_OUTER; i++) {
+        if (src->populated[i / 32] == 0) {
+            i += 31; // Nessuna inner table in questo gruppo di 32
+            continue;
+        }
+        if (src->tables[i] == NULL) {
+            continue;
+        }
+        for (j = 0; j < SIZE_PT_INNER; j++) {
+            from = &src->tables[i][j];
+            if (*from == 0) {
+                continue;
+            }
+            va = (i << 22) | (j << 12);
+            if (dst->tables[i] == NULL) {
+                result = pt_define_inner(dst, va);
+                if (result) {
+                    return result;
+                }
+            }
+            to = &dst->tables[i][j];
+
+            // La voce del figlio e' scritta prima di condividere il frame, e
+            // azzerata se la condivisione fallisce. Se il frame e' in corso di
+            // swap-out si attende e si rilegge la voce, che a quel punto
+            // indichera' lo slot dello swap
+        retry:
+            pte = *from;
+            result = COREMAP_SHARE_OK;
+            while (pte & PTE_PRESENT) {
+                *to = pte;
+                result = coremap_share(pte & PTE_NUMBER, src->as, dst_as, va);
+                if (result == COREMAP_SHARE_OK) {
+                    break;
+                }
+                *to = 0;
+                if (result == COREMAP_SHARE_NOMEM) {
+                    break;
+                }
+                coremap_wait_busy(pte & PTE_NUMBER);
+                pte = *from;
+            }
+
+            if ((pte & PTE_PRESENT) && result == COREMAP_SHARE_NOMEM) {
+                // Mappa inversa esaurita: il figlio riceve una copia privata
+                pa = page_alloc_as(dst_as, va);
+                if (pa == 0) {
+                    return ENOMEM;
+                }
+                memmove((void *)PADDR_TO_KVADDR(pa), (const void *)PADDR_TO_KVADDR(pte & PTE_NUMBER), PAGE_SIZE);
+                membar_any_any();
+                if (*from != pte) {
+                    // Frame del padre liberato da un'eviction durante la copia,
+                    // che puo' non essere valida: si riparte dalla nuova voce
+                    page_discard(pa);
+                    goto retry;
+                }
+                pte_set_pa(to, pa);
+                coremap_publish(pa, 1, -1);
+            }
+            else if (pte & PTE_PRESENT) {
+                // Pagina residente: il frame e' condiviso e la voce gia' scritta
+            }
+            else if (pte & PTE_SWAPPED) {
+                // Pagina nello swap: lo slot viene condiviso e letto al primo fault
+                swap_share(pte & PTE_NUMBER);
+                *to = pte;
+            }
+            else if (PTE_IS_ZERO(pte)) {
+                pte_set_zero(to);
+            }
+        }
+    }
+    return 0;
+}
+
 /**
  * Definisce una nuova inner table per una specifica entry della outer table.
- * Alloca memoria per la inner table e inizializza le sue entries come non valide.
+ * La inner table occupa esattamente una pagina, allocata dalla coremap, con
+ * tutte le PTE a 0 (pagine mai caricate).
  * @param pt: puntatore alla outer table
  * @param va: indirizzo virtuale che richiede la nuova inner table
+ * @return 0, ENOMEM se la coremap non ha una pagina per la tabella
  */
-void pt_define_inner(struct pt_directory* pt, vaddr_t va) {
-    unsigned int index, i;
+int pt_define_inner(struct pt_directory* pt, vaddr_t va) {
+    unsigned int index;
+    pte_t *table;
 
     index = get_outer_index(va); // Ottiene l'indice della outer table
-    KASSERT(pt->pages[index].valid == 0); // Assicura che l'entry non sia già valida
-
-    // Alloca memoria per la nuova inner table
-    pt->pages[index].size = SIZE_PT_INNER;
-    pt->pages[index].pages = kmalloc(sizeof(struct pt_inner_entry) * SIZE_PT_INNER);
-    KASSERT(pt->pages[index].pages != NULL);
-    pt->pages[index].valid = 1;
-
-    // Inizializza tutte le entries della inner table come non valide
-    for (i = 0; i < pt->pages[index].size; i++) {
-        pt->pages[index].pages[i].valid = 0;
-        pt->pages[index].pages[i].pfn = PFN_NOT_USED;
-        pt->pages[index].pages[i].swap_offset = -1;
+    KASSERT(pt->tables[index] == NULL); // Assicura che l'entry non sia già valida
+
+    // Alloca la pagina della nuova inner table
+    KASSERT(SIZE_PT_INNER * sizeof(pte_t) == PAGE_SIZE);
+    table = (pte_t *)alloc_kpages(1);
+    if (table == NULL) {
+        return ENOMEM;
     }
+    bzero(table, PAGE_SIZE);
+
+    // La tabella e' visibile solo dopo essere stata azzerata
+    membar_store_store();
+    pt->tables[index] = table;
+    pt->populated[index / 32] |= 1U << (index % 32);
+    return 0;
 }
 
 /**
  * Recupera l'indirizzo fisico associato a un indirizzo virtuale.
- * Restituisce PFN_NOT_USED se non esiste una mappatura valida.
+ * Restituisce PFN_NOT_USED se la pagina non e' residente.
  * @param pt: puntatore alla directory di pagine
  * @param va: indirizzo virtuale da tradurre
  * @return indirizzo fisico corrispondente o PFN_NOT_USED
  */
 int pt_get_pa(struct pt_directory* pt, vaddr_t va) {
-    unsigned int outer, inner, d;
-
-    outer = get_outer_index(va);
-    KASSERT(outer < SIZE_PT_OUTER);
+    pte_t *pte;
 
-    inner = get_inner_index(va);
-    KASSERT(inner < SIZE_PT_INNER);
-
-    d = get_page_offset(va);
-    KASSERT(d < PAGE_SIZE);
-
-    if (pt->pages[outer].valid) {
-        if (pt->pages[outer].pages[inner].valid) {
-            return pt->pages[outer].pages[inner].pfn;
-        }
+    pte = pt_walk(pt, va, 0);
+    if (pte == NULL) {
+        return PFN_NOT_USED;
     }
-
-    return PFN_NOT_USED;
+    return PTE_GET_PA(*pte);
 }
 
 /**
@@ -182,103 +423,47 @@ int pt_get_pa(struct pt_directory* pt, vaddr_t va) {
  * @param pa: indirizzo fisico
  */
 void pt_set_pa(struct pt_directory* pt, vaddr_t va, paddr_t pa) {
-    unsigned int outer, inner, d;
-
-    outer = get_outer_index(va);
-    KASSERT(outer < SIZE_PT_OUTER);
-
-    inner = get_inner_index(va);
-    KASSERT(inner < SIZE_PT_INNER);
-
-    d = get_page_offset(va);
-    KASSERT(d < PAGE_SIZE);
-
-    // Alloca una nuova inner table se necessario
-    if (!pt->pages[outer].valid) {
-        pt_define_inner(pt, va);
-    }
-
-    // Imposta la mappatura nella inner table
-    KASSERT(pt->pages[outer].valid == 1);
-    pt->pages[outer].pages[inner].valid = 1;
-    pt->pages[outer].pages[inner].pfn = pa;
+    pte_set_pa(pt_walk(pt, va, 1), pa);
 }
 
 /**
- * Recupera lo stato di una pagina in una page table.
- * Controlla se la pagina è swappata su disco, valida o non valida.
+ * Recupera l'offset nello swap di una pagina non residente.
  *
  * @param pt La page table in cui cercare.
  * @param va L'indirizzo virtuale della pagina.
- * @return 0 se la pagina è in memoria, 1 se è swappata, 2 se non è valida.
+ * @return Offset dello slot, -1 se la pagina e' residente o non ha copia nello swap.
  */
 off_t pt_get_offset(struct pt_directory* pt, vaddr_t va) {
-    unsigned int outer, inner, d;
-    off_t flag;
+    pte_t *pte;
 
-    // Estrai l'indice della outer table
-    outer = get_outer_index(va);
-    KASSERT(outer < SIZE_PT_OUTER); // Verifica che l'indice sia valido
-
-    // Estrai l'indice della inner table
-    inner = get_inner_index(va);
-    KASSERT(inner < SIZE_PT_INNER); // Verifica che l'indice sia valido
-
-    // Estrai l'offset nella pagina
-    d = get_page_offset(va);
-    KASSERT(d < PAGE_SIZE); // Verifica che l'offset sia valido
-
-    // Controlla se la outer table è valida
-    if (pt->pages[outer].valid) {
-        // Controlla se la inner table è valida
-        if (pt->pages[outer].pages[inner].valid) {
-            // Recupera il valore del campo swapped_out
-            flag = pt->pages[outer].pages[inner].swap_offset;
-        } else {
-            return -1; // Pagina non valida
-        }
-    } else {
-        return -1; // Outer table non valida
+    pte = pt_walk(pt, va, 0);
+    if (pte == NULL) {
+        return -1; // Inner table non presente
     }
-
-    return flag; // Restituisci lo stato della pagina
+    return PTE_GET_OFFSET(*pte);
 }
 
 /**
- * Imposta lo stato di una pagina in una page table.
- * Permette di aggiornare il campo swapped_out per indicare se la pagina è swappata o meno.
+ * Segna la pagina come non piu' residente: la sua copia si trova nello swap
+ * all'offset indicato, oppure (offset -1) non ha copia nello swap.
+ * L'aggiornamento e' un'unica scrittura: un fault concorrente vede la pagina
+ * o nel frame o nello swap, mai a meta'.
  *
  * @param pt La page table in cui aggiornare lo stato.
  * @param va L'indirizzo virtuale della pagina.
- * @param state Il nuovo stato: 0 per in memoria, 1 per swappata.
+ * @param offset Offset dello slot nello swap, -1 se assente.
  */
 void pt_set_offset(struct pt_directory* pt, vaddr_t va, off_t offset) {
-    volatile unsigned int outer, inner, d;
-
-    // Estrai l'indice della outer table
-    outer = get_outer_index(va);
-    KASSERT(outer < SIZE_PT_OUTER); // Verifica che l'indice sia valido
-
-    // Estrai l'indice della inner table
-    inner = get_inner_index(va);
-    KASSERT(inner < SIZE_PT_INNER); // Verifica che l'indice sia valido
-
-    // Estrai l'offset nella pagina
-    d = get_page_offset(va);
-    KASSERT(d < PAGE_SIZE); // Verifica che l'offset sia valido
-
-    // Alloca una nuova inner table se necessario
-    if(!pt->pages[outer].valid) {
-        pt_define_inner(pt, va);
-    }
-
-    // Assicurati che la outer table sia valida
-    KASSERT(pt->pages[outer].valid == 1);
-
-    // Marca la pagina come valida
-    pt->pages[outer].pages[inner].valid = 1;
-
-    // Aggiorna il campo swapped_out con il nuovo offset
-    pt->pages[outer].pages[inner].swap_offset = offset;
+    pte_set_offset(pt_walk(pt, va, 1), offset);
+}
 
+/**
+ * Segna la pagina come non piu' residente e piena di zeri, senza slot nello
+ * swap: il prossimo fault la mappa sul frame di zeri o la azzera.
+ *
+ * @param pt La page table in cui aggiornare lo stato.
+ * @param va L'indirizzo virtuale della pagina.
+ */
+void pt_set_zero(struct pt_directory* pt, vaddr_t va) {
+    pte_set_zero(pt_walk(pt, va, 1));
 }
@@ -35,6 +35,7 @@ struct segment* seg_create(void) {
     seg->p_memsz = 0;
     seg->p_permission = 0;
     seg->vnode = NULL;
+    seg->p_mapflags = 0;
 
     return seg;
 }
@@ -88,99 +89,190 @@ int seg_define_stack(struct segment* seg) {
 }
 
 
-int seg_load_page(struct segment* seg, vaddr_t va, paddr_t pa) {
-    struct iovec iov;
-    struct uio u;
-    vaddr_t vbaseoffset, voffset;
-    paddr_t dest_paddr;
-    size_t read_len, npages;
-    off_t file_offset;
-    int result;
-    unsigned long page_index;
+// Pagine lette dall'ELF insieme a quella del fault (comando elfra del menu)
+static unsigned int seg_faultaround = SEG_FAULTAROUND;
 
-    KASSERT(seg != NULL);
-    KASSERT(seg->vnode != NULL);
-
-    npages = seg->p_memsz + (va & ~(vaddr_t)PAGE_FRAME);
-	npages = (npages + PAGE_SIZE - 1) & PAGE_FRAME;
-	npages = npages / PAGE_SIZE;
+/*
+ * Calcola quale parte del file va letta nella pagina page_index del
+ * segmento, caricata nel frame pa: indirizzo fisico di destinazione,
+ * lunghezza (0 per le pagine oltre p_filesz, solo da azzerare) e offset
+ * nel file. Le parti di pagine consecutive sono contigue nel file.
+ */
+static void seg_page_extent(struct segment *seg, unsigned long page_index, paddr_t pa,
+                            paddr_t *dest_paddr, size_t *read_len, off_t *file_offset) {
+    vaddr_t vbaseoffset, voffset;
+    size_t npages;
 
+    vbaseoffset = seg->p_vaddr & ~(PAGE_FRAME);
+    npages = seg->p_memsz + vbaseoffset;
+    npages = (npages + PAGE_SIZE - 1) & PAGE_FRAME;
+    npages = npages / PAGE_SIZE;
 
     if (seg->p_filesz > npages * PAGE_SIZE) {
         kprintf("segments.c: warning: segment filesize > segment memsize\n");
         seg->p_filesz = npages * PAGE_SIZE;
     }
-    page_index = (va - (seg->p_vaddr & PAGE_FRAME)) / PAGE_SIZE;
     KASSERT(page_index < npages);
-    vbaseoffset = seg->p_vaddr & ~(PAGE_FRAME);
+
     if (page_index == 0)
     {
-        dest_paddr = pa + vbaseoffset;
-        read_len = (PAGE_SIZE - vbaseoffset > seg->p_filesz) ? seg->p_filesz : PAGE_SIZE - vbaseoffset;
-        file_offset = seg->p_offset;
+        *dest_paddr = pa + vbaseoffset;
+        *read_len = (PAGE_SIZE - vbaseoffset > seg->p_filesz) ? seg->p_filesz : PAGE_SIZE - vbaseoffset;
+        *file_offset = seg->p_offset;
+        return;
     }
-    else if (page_index == (npages) - 1)
-    {
-        voffset = (npages - 1) * PAGE_SIZE - vbaseoffset;
-        dest_paddr = pa;
-        file_offset = seg->p_offset + voffset;
-        if (seg->p_filesz > voffset)
-        {
-            read_len = seg->p_filesz - voffset;
-        }
-        else
-        {
-            read_len = 0;
-            file_offset = seg->p_filesz;
-        }
+
+    voffset = page_index * PAGE_SIZE - vbaseoffset;
+    *dest_paddr = pa;
+    *file_offset = seg->p_offset + voffset;
+    if (seg->p_filesz <= voffset) {
+        *read_len = 0; // Pagina interamente oltre la parte nel file (bss)
     }
-    else
-    {
-        dest_paddr = pa;
-        file_offset = seg->p_offset + (page_index * PAGE_SIZE) - vbaseoffset;
-        if (seg->p_filesz > ((page_index + 1) * PAGE_SIZE) - vbaseoffset)
-        {
-            read_len = PAGE_SIZE;
-        }
-        else if (seg->p_filesz < (page_index * PAGE_SIZE) - vbaseoffset)
-        {
-            read_len = 0;
-            file_offset = seg->p_filesz;
-        }
-        else
-        {
-            read_len = seg->p_filesz - ((page_index * PAGE_SIZE) - vbaseoffset);
-        }
+    else if (seg->p_filesz - voffset > PAGE_SIZE) {
+        *read_len = PAGE_SIZE;
     }
+    else {
+        *read_len = seg->p_filesz - voffset;
+    }
+}
+
+int seg_load_page(struct segment* seg, vaddr_t va, paddr_t pa) {
+    return seg_load_pages(seg, va & PAGE_FRAME, &pa, 1);
+}
+
+/*
+ * Carica dall'ELF n pagine consecutive del segmento, a partire da va, nei
+ * frame pas, con una sola VOP_READ: le parti del file delle pagine sono
+ * contigue e ognuna ha il suo iovec. Solo la prima pagina e' contata come
+ * page fault; le altre, lette in anticipo (fault-around), sono contate in
+ * STATISTICS_ELF_FAULTAROUND.
+ */
+int seg_load_pages(struct segment* seg, vaddr_t va, const paddr_t *pas, unsigned int n) {
+    struct iovec iov[SEG_FAULTAROUND_MAX + 1];
+    struct uio u;
+    paddr_t dest_paddr;
+    size_t read_len, total;
+    off_t file_offset, start;
+    unsigned long page_index;
+    unsigned int i, niov;
+    int result;
+
+    KASSERT(seg != NULL);
+    KASSERT(seg->vnode != NULL);
+    KASSERT(n >= 1 && n <= SEG_FAULTAROUND_MAX + 1);
+    KASSERT((va & PAGE_FRAME) == va);
 
-    KASSERT(pa > 0); // Verifica che l'indirizzo fisico sia valido
-    zero(pa, PAGE_SIZE); // Azzeriamo la pagina alla sua indirizzo fisico
-    if(pa > 0) {
-        // Incrementa le statistiche
-        if (read_len == 0){
-            increment_statistics(STATISTICS_PAGE_FAULT_ZERO); // Incrementa il contatore delle pagine azzerate
+    page_index = (va - (seg->p_vaddr & PAGE_FRAME)) / PAGE_SIZE;
+    niov = 0;
+    total = 0;
+    start = 0;
+    for (i = 0; i < n; i++) {
+        KASSERT(pas[i] > 0); // Verifica che l'indirizzo fisico sia valido
+        seg_page_extent(seg, page_index + i, pas[i], &dest_paddr, &read_len, &file_offset);
+        // Si azzerano solo le parti della pagina che la lettura non sovrascrive
+        zero(pas[i], dest_paddr - pas[i]);
+        zero(dest_paddr + read_len, pas[i] + PAGE_SIZE - (dest_paddr + read_len));
+        if (read_len == 0) {
+            continue;
         }
-        else{
-            increment_statistics(STATISTICS_ELF_FILE_READ); // Incrementa il contatore delle letture di file ELF
-            increment_statistics(STATISTICS_PAGE_FAULT_DISK); // Incrementa il contatore delle page fault dal disco
+        // Dopo una pagina letta solo in parte le successive non hanno dati nel file
+        KASSERT(niov == 0 || file_offset == start + (off_t)total);
+        if (niov == 0) {
+            start = file_offset;
         }
-    } 
+        iov[niov].iov_kbase = (void *)PADDR_TO_KVADDR(dest_paddr);
+        iov[niov].iov_len = read_len;
+        niov++;
+        total += read_len;
+    }
 
+    // Incrementa le statistiche
+    if (total == 0) {
+        increment_statistics(STATISTICS_PAGE_FAULT_ZERO); // Incrementa il contatore delle pagine azzerate
+    }
+    else {
+        increment_statistics(STATISTICS_ELF_FILE_READ); // Incrementa il contatore delle letture di file ELF
+        increment_statistics(STATISTICS_PAGE_FAULT_DISK); // Incrementa il contatore delle page fault dal disco
+    }
+    for (i = 1; i < n; i++) {
+        increment_statistics(STATISTICS_ELF_FAULTAROUND);
+    }
+    if (total == 0) {
+        return 0;
+    }
 
-    uio_kinit(&iov, &u, (void *)PADDR_TO_KVADDR(dest_paddr), read_len, file_offset, UIO_READ);
+    u.uio_iov = iov;
+    u.uio_iovcnt = niov;
+    u.uio_offset = start;
+    u.uio_resid = total;
+    u.uio_segflg = UIO_SYSSPACE;
+    u.uio_rw = UIO_READ;
+    u.uio_space = NULL;
     result = VOP_READ(seg->vnode, &u);
+    if (result == 0 && u.uio_resid != 0) {
+        /* short read; problem with executable? */
+        kprintf("segments.c: short read on segment - file truncated?\n");
+        result = ENOEXEC;
+    }
     if (result) {
-        return result;
+        // Le parti non lette non erano state azzerate: nessun dato precedente dei frame resta visibile
+        for (i = 0; i < n; i++) {
+            zero(pas[i], PAGE_SIZE);
+        }
     }
+    return result;
+}
 
-    if (u.uio_resid != 0) {
-        /* short read; problem with executable? */
-        kprintf("segments.c: short read on segment - file truncated?\n");
-        return ENOEXEC;
+/*
+ * Numero di pagine dopo va, nello stesso segmento, con dati nel file: il
+ * fault-around si ferma alla parte del segmento oltre p_filesz, che va solo
+ * azzerata, e alla finestra impostata con seg_set_faultaround.
+ */
+unsigned int seg_faultaround_window(struct segment* seg, vaddr_t va) {
+    vaddr_t vbase, file_top;
+    unsigned int window;
+
+    if (seg->vnode == NULL || seg->p_filesz == 0) {
+        return 0;
+    }
+    vbase = seg->p_vaddr & PAGE_FRAME;
+    file_top = ROUNDUP(seg->p_vaddr + seg->p_filesz, PAGE_SIZE);
+    va &= PAGE_FRAME;
+    if (va < vbase || va + PAGE_SIZE >= file_top) {
+        return 0;
+    }
+    window = (file_top - va) / PAGE_SIZE - 1;
+    return window < seg_faultaround ? window : seg_faultaround;
+}
+
+int seg_set_faultaround(unsigned int npages) {
+    if (npages > SEG_FAULTAROUND_MAX) {
+        return EINVAL;
     }
+    seg_faultaround = npages;
     return 0;
 }
 
+unsigned int seg_get_faultaround(void) {
+    return seg_faultaround;
+}
+
+/*
+ * Le pagine dei segmenti di codice (PF_R | PF_X, letti dall'ELF) sono uguali
+ * in tutti i processi che eseguono lo stesso file: nella cache delle pagine
+ * la pagina di va e' identificata dall'offset nel file del suo inizio.
+ *
+ * @return 1 e in key l'offset, 0 se la pagina non puo' essere condivisa.
+ */
+int seg_text_key(struct segment* seg, vaddr_t va, off_t *key) {
+    if (seg->vnode == NULL || seg->p_permission != (PF_R | PF_X)) {
+        return 0;
+    }
+    *key = (off_t)seg->p_offset - (off_t)(seg->p_vaddr & ~PAGE_FRAME) +
+           (off_t)((va & PAGE_FRAME) - (seg->p_vaddr & PAGE_FRAME));
+    return 1;
+}
+
 int seg_copy(struct segment *old, struct segment **ret) {
     struct segment *newps;
     int result;
@@ -192,6 +284,7 @@ int seg_copy(struct segment *old, struct segment **ret) {
     }
     result = seg_define(newps, old->p_type, old->p_offset, old->p_vaddr, old->p_filesz, old->p_memsz, old->p_permission, old->vnode);
     KASSERT(result == 0);
+    newps->p_mapflags = old->p_mapflags;
     
     *ret = newps;
     return 0;
@@ -2,6 +2,7 @@
 #include <lib.h>
 #include <synch.h>
 #include <spl.h>
+#include <vm.h>
 #include <statistics.h>
 
 // Spinlock per la sincronizzazione durante l'accesso ai contatori
@@ -22,6 +23,16 @@ static const char *statistics_names[] = {
     "Page Faults from ELF",
     "Page Faults from Swapfile",
     "Swapfile Writes",
+    "Copy-on-Write Faults",
+    "Clean Pages Dropped",
+    "Swap Read-Ahead Pages",
+    "Software TLB Hits",
+    "ELF Fault-Around Pages",
+    "Shared Text Pages",
+    "Zero Pages Dropped",
+    "Compressed Swap Stores",
+    "Compressed Swap Hits",
+    "Compressed Swap Bytes",
 };
 
 // Flag che indica se il sistema di statistiche è attivo
@@ -54,6 +65,83 @@ void increment_statistics(unsigned int stat) {
     spinlock_release(&statistics_spinlock);
 }
 
+/*
+ * Aggiunge `n` al contatore specificato da `stat` (es. i byte occupati dalle
+ * pagine compresse).
+ */
+void add_statistics(unsigned int stat, unsigned int n) {
+    spinlock_acquire(&statistics_spinlock);
+    if (is_active == 1) {
+        KASSERT(stat < N_STATS);
+        counters[stat] += n;
+    }
+    spinlock_release(&statistics_spinlock);
+}
+
+/*
+ * Stampa il rapporto di compressione delle pagine salvate nella cache
+ * compressa dello swap (pagine originali / byte occupati), con due decimali.
+ */
+static void print_compression_ratio(unsigned int stores, unsigned int bytes) {
+    unsigned int ratio;
+
+    if (stores == 0 || bytes == 0) {
+        return;
+    }
+    ratio = (unsigned int)((uint64_t)stores * PAGE_SIZE * 100 / bytes);
+    kprintf("%25s = %7u.%02u\n", "Compression Ratio", ratio / 100, ratio % 100);
+}
+
+/*
+ * Incrementa tutti i contatori i cui bit (STATISTICS_BIT) sono presenti in
+ * `mask`, acquisendo lo spinlock una sola volta: usata dai percorsi frequenti,
+ * come la ricarica veloce della TLB.
+ */
+void increment_statistics_mask(unsigned int mask) {
+    unsigned int i;
+
+    KASSERT(N_STATS <= 32);
+    KASSERT((mask >> N_STATS) == 0); // Solo contatori esistenti
+    spinlock_acquire(&statistics_spinlock);
+    if (is_active == 1) {
+        for (i = 0; mask != 0; i++, mask >>= 1) {
+            counters[i] += mask & 1;
+        }
+    }
+    spinlock_release(&statistics_spinlock);
+}
+
+/*
+ * Copia in `snapshot` il valore corrente di tutti i contatori, per poter
+ * misurare in seguito l'effetto di un singolo carico di lavoro.
+ */
+void get_statistics(unsigned int snapshot[N_STATS]) {
+    int i;
+    spinlock_acquire(&statistics_spinlock);
+    for (i = 0; i < N_STATS; i++) {
+        snapshot[i] = counters[i];
+    }
+    spinlock_release(&statistics_spinlock);
+}
+
+/*
+ * Stampa, per ogni statistica, l'incremento rispetto allo snapshot passato.
+ */
+void print_statistics_delta(const unsigned int snapshot[N_STATS]) {
+    unsigned int now[N_STATS];
+    int i;
+
+    if (is_active == 0) {
+        return;
+    }
+    get_statistics(now);
+    for (i = 0; i < N_STATS; i++) {
+        kprintf("%25s = %10u\n", statistics_names[i], now[i] - snapshot[i]);
+    }
+    print_compression_ratio(now[STATISTICS_ZSWAP_STORE] - snapshot[STATISTICS_ZSWAP_STORE],
+                            now[STATISTICS_ZSWAP_BYTES] - snapshot[STATISTICS_ZSWAP_BYTES]);
+}
+
 /*
  * Stampa tutte le statistiche e verifica la consistenza dei dati.
  * Effettua delle somme parziali e controlla che i totali siano coerenti.
@@ -78,6 +166,7 @@ void print_all_statistics(void) {
         // Stampa il nome della statistica e il relativo contatore
         kprintf("%25s = %10d\n", statistics_names[i], counters[i]);
     }
+    print_compression_ratio(counters[STATISTICS_ZSWAP_STORE], counters[STATISTICS_ZSWAP_BYTES]);
 
     // Calcola somme parziali
     tlb_faults = counters[STATISTICS_TLB_FAULT];
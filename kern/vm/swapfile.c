@@ -1,5 +1,8 @@
 #include <types.h>
+#include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <lib.h>
+#include <kern/stat.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <uio.h>
@@ -7,135 +10,688 @@
 #include <bitmap.h>
 #include <swapfile.h>
 #include <statistics.h>
+#include <zswap.h>
 
-// Creiamo una lista di entries
-static struct swap_page swap_list[NUM_PAGES];
+/*
+ * Gli slot dello swapfile sono gestiti con una bitmap (bit a 1: slot occupato).
+ * La ricerca e' next-fit: parte da swap_hint, subito dopo l'ultimo slot
+ * allocato, e salta i byte della bitmap completamente occupati.
+ * Lo swapfile parte da SWAP_INITIAL_SIZE e cresce a blocchi di SWAP_GROW_PAGES
+ * slot (al massimo raddoppiando) fino al limite swap_max_pages, impostabile
+ * all'avvio con il comando "swap" del menu. La bitmap e swap_refs sono
+ * dimensionati per swap_cap slot (il limite, all'apertura) e gli slot oltre
+ * swap_npages restano marcati come riservati: la crescita li rende
+ * disponibili sotto il lock senza allocare memoria. Una kmalloc nella
+ * crescita potrebbe causare un'eviction, che cercherebbe a sua volta uno
+ * slot nella bitmap ancora piena.
+ *
+ * In alternativa allo swapfile su emu0 si puo' usare una partizione di swap su
+ * un disco lhd grezzo (comando "swapdev" del menu), acceduto tramite
+ * vfs_swapon senza passare per un file system: gli slot hanno dimensione
+ * fissa, pari al disco (al massimo swap_max_pages), e le pagine sono
+ * trasferite direttamente con I/O allineato ai settori.
+ *
+ * Davanti al supporto c'e' la cache compressa in memoria (zswap.c): lo slot
+ * viene sempre allocato, ma una pagina compressa nella cache non viene
+ * scritta e viene riletta decomprimendola.
+ *
+ * Accanto alla bitmap, swap_refs conta i riferimenti a ogni slot occupato
+ * (PTE e frame della coremap): dopo una fork padre e figlio condividono gli
+ * slot delle pagine nello swap (swap_share), che vengono liberati solo con
+ * l'ultimo riferimento e mai riscritti sul posto finche' sono condivisi.
+ */
+static struct bitmap *swap_map = NULL;
+static uint16_t *swap_refs = NULL;         // Riferimenti di ogni slot (0: libero)
+static unsigned int swap_npages = 0;       // Slot utilizzabili (dimensione corrente dello swapfile)
+static unsigned int swap_cap = 0;          // Slot coperti dalla bitmap e da swap_refs
+static unsigned int swap_max_pages = SWAP_MAX_SIZE / PAGE_SIZE;
+static unsigned int swap_hint = 0;         // Prossimo slot da cui cercare (next-fit)
+static unsigned int swap_used = 0;         // Slot occupati
+static unsigned int swap_readahead = SWAP_READAHEAD; // Pagine lette in anticipo ad ogni swap-in
 
-// Solo un processo alla volta può accedere allo swapfile per cui abbiamo bisogno di uno spinlock
+// Solo un processo alla volta può accedere ai metadati dello swapfile per cui abbiamo bisogno di uno spinlock
 static struct spinlock filelock = SPINLOCK_INITIALIZER;
 
 static struct vnode *v = NULL;
+static char swap_devname[SWAP_DEVNAME_MAX] = ""; // Disco grezzo usato come swap, "" per lo swapfile
+static int swap_raw = 0;                          // 1 se v e' il vnode di un disco grezzo
 
 static int timesOut = 0; // Contatore per le pagine swappate out
 static int timesIn = 0;  // Contatore per le pagine swappate in
 
+/*
+ * Apre il disco grezzo swap_devname come swap e restituisce in npages il
+ * numero di slot utilizzabili (multiplo di 8, come richiesto da swap_grow).
+ */
+static int swap_open_device(struct vnode **ret, unsigned int *npages) {
+    struct stat st;
+    int result;
+
+    KASSERT(PAGE_SIZE % SWAP_SECTOR_SIZE == 0); // Ogni slot inizia e finisce su un settore
+
+    result = vfs_swapon(swap_devname, ret);
+    if (result) {
+        return result;
+    }
+    result = VOP_STAT(*ret, &st);
+    if (result == 0 && st.st_blksize != 0 && PAGE_SIZE % st.st_blksize != 0) {
+        result = EINVAL;
+    }
+    if (result == 0) {
+        *npages = st.st_size / PAGE_SIZE;
+        if (*npages > swap_max_pages) {
+            *npages = swap_max_pages;
+        }
+        *npages -= *npages % CHAR_BIT;
+        if (*npages == 0) {
+            result = ENOSPC;
+        }
+    }
+    if (result) {
+        VOP_DECREF(*ret);
+        vfs_swapoff(swap_devname);
+    }
+    return result;
+}
+
+/*
+ * Apre il supporto dello swap (swapfile o disco grezzo) e crea la bitmap degli slot.
+ */
+static int swap_open(void) {
+    int result, raw;
+    unsigned int npages;
+    struct vnode *vn;
+    struct bitmap *map;
+    uint16_t *refs;
+
+    unsigned int cap, i;
+
+    raw = swap_devname[0] != '\0';
+    if (raw) {
+        result = swap_open_device(&vn, &npages);
+        cap = npages;
+    }
+    else {
+        npages = SWAP_INITIAL_SIZE / PAGE_SIZE;
+        cap = swap_max_pages > npages ? swap_max_pages : npages;
+        result = vfs_open((char *)"emu0:/SWAPFILE", O_RDWR | O_CREAT , 0, &vn);
+    }
+    if (result) {
+        return result;
+    }
+
+    // La bitmap viene allocata prima di prendere lo spinlock (kmalloc puo' dormire),
+    // gia' della dimensione massima: gli slot oltre lo swapfile sono riservati
+    map = bitmap_create(cap);
+    KASSERT(map != NULL);
+    for (i = npages; i < cap; i++) {
+        bitmap_mark(map, i);
+    }
+    refs = kmalloc(cap * sizeof(uint16_t));
+    KASSERT(refs != NULL);
+    bzero(refs, cap * sizeof(uint16_t));
+
+    spinlock_acquire(&filelock);
+    if (swap_map != NULL) {
+        spinlock_release(&filelock);
+        bitmap_destroy(map);
+        kfree(refs);
+        if (raw) {
+            VOP_DECREF(vn);
+            vfs_swapoff(swap_devname);
+        }
+        else {
+            vfs_close(vn);
+        }
+        return 0;
+    }
+    swap_map = map;
+    swap_refs = refs;
+    swap_npages = npages;
+    swap_cap = cap;
+    if (!raw && swap_max_pages < swap_npages) {
+        swap_max_pages = swap_npages;
+    }
+    swap_hint = 0;
+    swap_used = 0;
+    swap_raw = raw;
+    v = vn;
+    spinlock_release(&filelock);
+
+    if (raw) {
+        kprintf("swap: using raw device %s (%u slots)\n", swap_devname, npages);
+    }
+    return 0;
+}
+
+// Chiude il supporto dello swap e distrugge la bitmap degli slot
+static void swap_close(void) {
+    struct bitmap *map;
+    struct vnode *vn;
+    uint16_t *refs;
+    int raw;
+
+    spinlock_acquire(&filelock);
+    vn = v;
+    raw = swap_raw;
+    map = swap_map;
+    refs = swap_refs;
+    v = NULL;
+    swap_raw = 0;
+    swap_map = NULL;
+    swap_refs = NULL;
+    swap_npages = 0;
+    swap_cap = 0;
+    swap_hint = 0;
+    swap_used = 0;
+    spinlock_release(&filelock);
+
+    if (raw) {
+        // vfs_swapoff richiede che il riferimento di vfs_swapon sia gia' stato rilasciato
+        VOP_DECREF(vn);
+        vfs_swapoff(swap_devname);
+    }
+    else {
+        vfs_close(vn);
+    }
+    bitmap_destroy(map);
+    kfree(refs);
+}
+
+/*
+ * Apre lo swap all'avvio (vm_bootstrap): lo swapfile e' condiviso da tutti i
+ * processi, ognuno dei quali possiede gli slot registrati nella propria page
+ * table e li rilascia in as_destroy.
+ */
 void swapfile_init(void) {
-    int result,i;
+    int result;
+
+    if (v != NULL) {
+        return;
+    }
 
-    // Inizializziamo la bitmap
-    for(i=0; i<NUM_PAGES; i++)
-    {
-        swap_list[i].ppadd = 0;
-        swap_list[i].pvadd = 0;
-        swap_list[i].swap_offset = 0;
-        swap_list[i].free = 1;
+    result = swap_open();
+    if (result) {
+        panic("swapfile.c: cannot open %s: %s\n", swap_device_name(), strerror(result));
     }
+}
+
+/*
+ * Sceglie il supporto dello swap: name e' un disco grezzo (es. "lhd1") oppure
+ * "file" per lo swapfile su emu0. Se lo swap e' gia' aperto viene riaperto sul
+ * nuovo supporto, purche' nessuno slot sia in uso.
+ */
+int swap_set_device(const char *name) {
+    char old[SWAP_DEVNAME_MAX], buf[SWAP_DEVNAME_MAX];
+    size_t len;
+    int result;
 
-    // Quando a runtime sono necessari più di 9MB => panic
-    result = vfs_open((char *)"emu0:/SWAPFILE", O_RDWR | O_CREAT , 0, &v);
-    KASSERT(result == 0);
-    return;
+    len = strlen(name);
+    if (len == 0 || len >= SWAP_DEVNAME_MAX) {
+        return EINVAL;
+    }
+    strcpy(buf, name);
+    if (buf[len - 1] == ':') {
+        buf[--len] = '\0'; // Come vfs_swapon, si accetta "lhd1:"
+    }
+    if (len == 0) {
+        return EINVAL;
+    }
 
-   
+    spinlock_acquire(&filelock);
+    if (swap_used != 0) {
+        spinlock_release(&filelock);
+        return EBUSY;
+    }
+    spinlock_release(&filelock);
+
+    if (v != NULL) {
+        swap_close();
+    }
+
+    strcpy(old, swap_devname);
+    if (strcmp(buf, "file") == 0) {
+        swap_devname[0] = '\0';
+    }
+    else {
+        strcpy(swap_devname, buf);
+    }
+
+    // Il nuovo supporto viene aperto subito, per segnalare qui un dispositivo errato
+    result = swap_open();
+    if (result) {
+        strcpy(swap_devname, old);
+        if (swap_open()) {
+            panic("swapfile.c: cannot reopen the previous swap backend\n");
+        }
+    }
+    return result;
+}
+
+// Nome del supporto dello swap scelto, nella forma accettata da swap_set_device
+const char *swap_device_name(void) {
+    return swap_devname[0] != '\0' ? swap_devname : "file";
+}
+
+/*
+ * Allarga la bitmap e swap_refs dello swapfile aperto a npages slot, con gli
+ * slot nuovi riservati. Chiamata solo dal comando "swap", fuori dal percorso
+ * dell'eviction: una kmalloc che porta una pagina nello swap trova la bitmap
+ * corrente ancora installata.
+ */
+static int swap_resize_map(unsigned int npages) {
+    struct bitmap *map, *old_map;
+    uint16_t *refs, *old_refs;
+    unsigned int i;
+
+    map = bitmap_create(npages);
+    if (map == NULL) {
+        return ENOMEM;
+    }
+    refs = kmalloc(npages * sizeof(uint16_t));
+    if (refs == NULL) {
+        bitmap_destroy(map);
+        return ENOMEM;
+    }
+
+    spinlock_acquire(&filelock);
+    if (swap_map == NULL || swap_raw || swap_cap >= npages) {
+        spinlock_release(&filelock);
+        bitmap_destroy(map);
+        kfree(refs);
+        return 0;
+    }
+    // Le dimensioni sono multipli di 8 slot: si copiano i byte della vecchia bitmap
+    KASSERT(swap_cap % CHAR_BIT == 0);
+    memcpy(bitmap_getdata(map), bitmap_getdata(swap_map), swap_cap / CHAR_BIT);
+    for (i = swap_cap; i < npages; i++) {
+        bitmap_mark(map, i);
+    }
+    memcpy(refs, swap_refs, swap_cap * sizeof(uint16_t));
+    bzero(refs + swap_cap, (npages - swap_cap) * sizeof(uint16_t));
+    old_map = swap_map;
+    old_refs = swap_refs;
+    swap_map = map;
+    swap_refs = refs;
+    swap_cap = npages;
+    spinlock_release(&filelock);
+
+    bitmap_destroy(old_map);
+    kfree(old_refs);
+    return 0;
 }
 
+/*
+ * Imposta la dimensione massima (in MB) fino a cui lo swapfile puo' crescere.
+ * Non puo' scendere sotto la dimensione gia' raggiunta.
+ */
+int swap_set_max_size(unsigned int mb) {
+    unsigned int npages;
+    int result;
+
+    npages = mb * (1024 * 1024 / PAGE_SIZE);
+    spinlock_acquire(&filelock);
+    if (npages < swap_npages || npages < SWAP_INITIAL_SIZE / PAGE_SIZE) {
+        spinlock_release(&filelock);
+        return EINVAL;
+    }
+    spinlock_release(&filelock);
+
+    // La bitmap viene allargata prima di alzare il limite, che swap_grow non supera
+    result = swap_resize_map(npages);
+    if (result) {
+        return result;
+    }
+    spinlock_acquire(&filelock);
+    swap_max_pages = npages;
+    spinlock_release(&filelock);
+    return 0;
+}
+
+/*
+ * Imposta quante pagine successive vengono lette in anticipo ad ogni swap-in
+ * (0 disattiva il read-ahead).
+ */
+int swap_set_readahead(unsigned int npages) {
+    if (npages >= SWAP_BATCH_MAX) {
+        return EINVAL;
+    }
+    swap_readahead = npages;
+    return 0;
+}
+
+unsigned int swap_get_readahead(void) {
+    return swap_readahead;
+}
+
+/*
+ * Prepara u per trasferire n pagine fisiche da/verso n slot consecutivi a
+ * partire da offset, con un iovec per pagina: una sola chiamata VOP per tutte.
+ */
+static void swap_uio_init(struct iovec *iov, struct uio *u, const paddr_t *ppaddrs,
+                          unsigned int n, off_t offset, enum uio_rw rw) {
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        KASSERT((ppaddrs[i] & PAGE_FRAME) == ppaddrs[i]);
+        iov[i].iov_kbase = (void *) PADDR_TO_KVADDR(ppaddrs[i]);
+        iov[i].iov_len = PAGE_SIZE;
+    }
+    u->uio_iov = iov;
+    u->uio_iovcnt = n;
+    u->uio_offset = offset;
+    u->uio_resid = n * PAGE_SIZE;
+    u->uio_segflg = UIO_SYSSPACE;
+    u->uio_rw = rw;
+    u->uio_space = NULL;
+}
+
+/*
+ * Fa crescere lo swapfile rendendo disponibili gli slot riservati che
+ * seguono swap_npages, senza allocare memoria: puo' essere chiamata anche
+ * dallo swap-out di un'eviction causata da una kmalloc. Lo swapfile cresce
+ * solo se nel frattempo nessun altro thread lo ha gia' fatto crescere.
+ *
+ * @return 0 se ora ci sono slot liberi, ENOSPC se si e' raggiunto il limite.
+ */
+static int swap_grow(unsigned int old_npages) {
+    unsigned int npages, grow, i;
+
+    spinlock_acquire(&filelock);
+    if (swap_npages != old_npages) {
+        spinlock_release(&filelock);
+        return 0;
+    }
+    // Una partizione di swap non puo' crescere oltre la dimensione del disco
+    if (swap_raw || swap_npages >= swap_max_pages) {
+        spinlock_release(&filelock);
+        return ENOSPC;
+    }
+    // Crescita geometrica, per limitare il numero di estensioni del file
+    grow = swap_npages < SWAP_GROW_PAGES ? SWAP_GROW_PAGES : swap_npages;
+    npages = swap_npages + grow;
+    if (npages > swap_max_pages) {
+        npages = swap_max_pages;
+    }
+    KASSERT(npages <= swap_cap);
+    for (i = swap_npages; i < npages; i++) {
+        bitmap_unmark(swap_map, i);
+    }
+    swap_hint = swap_npages; // I nuovi slot sono tutti liberi
+    swap_npages = npages;
+    spinlock_release(&filelock);
+
+    return 0;
+}
+
+// Alloca uno slot dello swapfile e ne restituisce l'indice
+static unsigned int swap_slot_alloc(void) {
+    unsigned int slot, npages;
+    int result;
+
+    while (1) {
+        spinlock_acquire(&filelock);
+        result = bitmap_alloc_from(swap_map, swap_hint, &slot);
+        npages = swap_npages;
+        if (result == 0) {
+            swap_hint = slot + 1;
+            swap_used++;
+            swap_refs[slot] = 1;
+        }
+        spinlock_release(&filelock);
+        if (result == 0) {
+            return slot;
+        }
+
+        if (swap_grow(npages)) {
+            kprintf("Total SWAPOUT: %d -- Total SWAPIN: %d\n", timesOut, timesIn);
+            panic("swapfile.c: Out of swap space \n");
+        }
+    }
+}
+
+// Rilascia un riferimento allo slot all'offset dato, liberandolo con l'ultimo
+void swap_free(off_t offset) {
+    unsigned int slot;
+    int last;
+
+    KASSERT(offset >= 0);
+    slot = offset / PAGE_SIZE;
+
+    spinlock_acquire(&filelock);
+    KASSERT(slot < swap_npages);
+    KASSERT(swap_refs[slot] > 0);
+    swap_refs[slot]--;
+    last = swap_refs[slot] == 0;
+    if (last) {
+        bitmap_unmark(swap_map, slot);
+        swap_used--;
+    }
+    spinlock_release(&filelock);
+
+    if (last) {
+        zswap_invalidate(offset);
+    }
+}
+
+// Aggiunge un riferimento allo slot occupato all'offset dato (fork)
+void swap_share(off_t offset) {
+    unsigned int slot;
+
+    KASSERT(offset >= 0);
+    slot = offset / PAGE_SIZE;
+
+    spinlock_acquire(&filelock);
+    KASSERT(slot < swap_npages);
+    KASSERT(swap_refs[slot] > 0 && swap_refs[slot] < 0xffff);
+    swap_refs[slot]++;
+    spinlock_release(&filelock);
+}
+
+// Indica se lo slot all'offset dato ha piu' di un riferimento
+int swap_is_shared(off_t offset) {
+    unsigned int slot;
+    int shared;
+
+    KASSERT(offset >= 0);
+    slot = offset / PAGE_SIZE;
+
+    spinlock_acquire(&filelock);
+    KASSERT(slot < swap_npages);
+    shared = swap_refs[slot] > 1;
+    spinlock_release(&filelock);
+    return shared;
+}
 
 int swap_out(paddr_t ppaddr, vaddr_t pvaddr) {
     // Dato l'indirizzo fisico della pagina da swappare
     // restituisce l'offset a cui la salviamo nello swapfile
-    int free_index = -1;
-    
     struct iovec iov;
     struct uio u;
-    int i;
-    struct swap_page *entry;
+    unsigned int slot;
     off_t page_offset;
 
-    spinlock_acquire(&filelock);
-    for(i=0; i< NUM_PAGES; i++) {
-        entry = &swap_list[i];
-        if(entry->free) {
-            free_index = i;
-            break;
-        }
-    }
-    spinlock_release(&filelock);
-    if(free_index == -1) {
-        kprintf("Total SWAPOUT: %d -- Total SWAPIN: %d\n", timesOut, timesIn);
-        panic("swapfile.c: Out of swap space \n");
-        return -1;
-    }
+    (void)pvaddr;
+    KASSERT((ppaddr & PAGE_FRAME) == ppaddr); // Verifica che l'indirizzo fisico sia allineato a pagina
 
+    slot = swap_slot_alloc();
     timesOut++;
-    page_offset = free_index * PAGE_SIZE;
-    KASSERT(page_offset < FILE_SIZE);
-    KASSERT((ppaddr & PAGE_FRAME) == ppaddr); // Verifica che l'indirizzo fisico sia allineato a pagina
+    page_offset = (off_t)slot * PAGE_SIZE;
+    if (zswap_store(ppaddr, page_offset)) {
+        return page_offset;
+    }
 
+    // Scrivere oltre la fine del file lo estende: lo swapfile cresce insieme alla bitmap
     uio_kinit(&iov, &u, (void *) PADDR_TO_KVADDR(ppaddr), PAGE_SIZE, page_offset, UIO_WRITE);
     VOP_WRITE(v, &u);
     if(u.uio_resid != 0) {
         panic("swapfile.c: Cannot write to swap file");
         return -1;
-    } else {
-        spinlock_acquire(&filelock);
-        swap_list[free_index].free = 0;
-        swap_list[free_index].ppadd = ppaddr;
-        swap_list[free_index].pvadd = pvaddr;
-        swap_list[free_index].swap_offset = page_offset;
-        spinlock_release(&filelock);
-        increment_statistics(STATISTICS_SWAP_FILE_WRITE); // Incrementa il contatore delle scritture sul file di swap
-        return swap_list[free_index].swap_offset;
     }
+
+    increment_statistics(STATISTICS_SWAP_FILE_WRITE); // Incrementa il contatore delle scritture sul file di swap
+    return page_offset;
 }
 
+/*
+ * Scrive n pagine nello swapfile. offsets[i] e' lo slot gia' assegnato alla
+ * pagina i (riscritto sul posto) oppure -1: in tal caso viene allocato uno
+ * slot nuovo e il suo offset restituito in offsets[i]. Uno slot condiviso con
+ * altre page table contiene ancora la loro copia della pagina: il riferimento
+ * della pagina viene rilasciato e la pagina scritta in uno slot nuovo.
+ * Gli slot allocati uno dopo l'altro sono di solito consecutivi (next-fit):
+ * ogni gruppo di slot consecutivi viene scritto con un'unica VOP_WRITE, con
+ * un iovec per pagina. Le pagine compresse nella cache non vengono scritte.
+ */
+void swap_out_batch(const paddr_t *ppaddrs, unsigned int n, off_t *offsets) {
+    struct iovec iov[SWAP_BATCH_MAX];
+    struct uio u;
+    int stored[SWAP_BATCH_MAX];  // 1 per le pagine compresse nella cache
+    unsigned int i, first, run;
 
-int swap_in(paddr_t ppadd, off_t offset) {
+    KASSERT(n <= SWAP_BATCH_MAX);
+
+    for (i = 0; i < n; i++) {
+        KASSERT((ppaddrs[i] & PAGE_FRAME) == ppaddrs[i]);
+        if (offsets[i] >= 0 && swap_is_shared(offsets[i])) {
+            swap_free(offsets[i]);
+            offsets[i] = -1;
+        }
+        if (offsets[i] < 0) {
+            offsets[i] = (off_t)swap_slot_alloc() * PAGE_SIZE;
+        }
+        stored[i] = zswap_store(ppaddrs[i], offsets[i]);
+        timesOut++;
+    }
+
+    for (first = 0; first < n; first += run) {
+        if (stored[first]) {
+            run = 1;
+            continue;
+        }
+        // Gruppo di slot consecutivi da scrivere che parte da first
+        run = 1;
+        while (first + run < n && !stored[first + run] &&
+               offsets[first + run] == offsets[first + run - 1] + PAGE_SIZE) {
+            run++;
+        }
+
+        swap_uio_init(iov, &u, &ppaddrs[first], run, offsets[first], UIO_WRITE);
+        VOP_WRITE(v, &u);
+        if (u.uio_resid != 0) {
+            panic("swapfile.c: Cannot write to swap file");
+        }
+        for (i = 0; i < run; i++) {
+            increment_statistics(STATISTICS_SWAP_FILE_WRITE);
+        }
+    }
+}
+
+// Copia in ppadd la pagina salvata all'offset dato, lasciando occupato lo slot
+int swap_read(paddr_t ppadd, off_t offset) {
     struct iovec iov;
     struct uio u;
-    int page_index;
     int result;
 
-    timesIn++;
+    KASSERT(offset >= 0);
+    KASSERT((ppadd & PAGE_FRAME) == ppadd);
+
+    if (zswap_load(ppadd, offset)) {
+        return 0;
+    }
+    uio_kinit(&iov, &u, (void *) PADDR_TO_KVADDR(ppadd), PAGE_SIZE, offset, UIO_READ);
+    result = VOP_READ(v, &u);
+    if (result) {
+        return result;
+    }
+    if (u.uio_resid != 0) {
+        panic("swapfile.c: Cannot read from swap file");
+    }
+    return 0;
+}
+
+/*
+ * Riporta in memoria la pagina all'offset dato. Lo slot resta assegnato alla
+ * pagina: finche' non viene modificata la copia nello swap e' valida e una
+ * nuova eviction puo' scartarla senza riscriverla.
+ */
+int swap_in(paddr_t ppadd, off_t offset) {
+    return swap_in_cluster(&ppadd, 1, offset);
+}
+
+/*
+ * Come swap_in, ma legge con un'unica VOP_READ gli n slot consecutivi che
+ * partono da offset: il primo e' la pagina che ha causato il fault, gli altri
+ * sono letti in anticipo (read-ahead) e contati a parte nelle statistiche.
+ * Le pagine presenti nella cache compressa vengono decompresse e le altre
+ * lette dal disco, un gruppo di slot consecutivi alla volta. Se la pagina
+ * del fault viene dalla cache, il fault e' contato come una ricarica della
+ * TLB (come per le pagine di codice condivise), senza accesso al disco.
+ */
+int swap_in_cluster(const paddr_t *ppaddrs, unsigned int n, off_t offset) {
+    struct iovec iov[SWAP_BATCH_MAX];
+    struct uio u;
+    int loaded[SWAP_BATCH_MAX];  // 1 per le pagine decompresse dalla cache
+    unsigned int i, first, run;
+    int result;
 
+    KASSERT(n >= 1 && n <= SWAP_BATCH_MAX);
     KASSERT(offset >= 0); // Verifica che l'offset sia positivo
-    page_index = offset/PAGE_SIZE; // Calcola l'indice della pagina nel file di swap
-    spinlock_acquire(&filelock);
-    // Fix del descriptor dello swapfile
-    swap_list[page_index].ppadd =  0;
-    swap_list[page_index].pvadd  = 0;
-    swap_list[page_index].free  = 1;
-    swap_list[page_index].swap_offset = 0;
-    spinlock_release(&filelock);
-    // Copia nel suo nuovo ppadd
 
-    uio_kinit(&iov, &u, (void *) 
-    PADDR_TO_KVADDR(ppadd), PAGE_SIZE, offset, UIO_READ);
-    result = VOP_READ(v, &u); // Legge una pagina dal file di swap nella memoria fisica specificata da ppadd.
-    KASSERT(result == 0);     // Verifica che la lettura dal file di swap sia avvenuta con successo; genera un panic in caso di errore.
+    timesIn += n;
 
-    if(u.uio_resid != 0)
-    {
-        kprintf("Total SWAPOUT: %d -- Total SWAPIN: %d\n", timesOut, timesIn);
-        panic("swapfile.c: Cannot read from swap file");
-        return -1;
+    for (i = 0; i < n; i++) {
+        loaded[i] = zswap_load(ppaddrs[i], offset + (off_t)i * PAGE_SIZE);
+    }
+
+    // Copia nei nuovi frame delle pagine non presenti nella cache
+    for (first = 0; first < n; first += run) {
+        run = 1;
+        if (loaded[first]) {
+            continue;
+        }
+        while (first + run < n && !loaded[first + run]) {
+            run++;
+        }
+        swap_uio_init(iov, &u, &ppaddrs[first], run, offset + (off_t)first * PAGE_SIZE, UIO_READ);
+        result = VOP_READ(v, &u);
+        KASSERT(result == 0);     // Verifica che la lettura dal file di swap sia avvenuta con successo; genera un panic in caso di errore.
+        if (u.uio_resid != 0) {
+            panic("swapfile.c: Cannot read from swap file");
+        }
+    }
+
+    for (i = 1; i < n; i++) {
+        increment_statistics(STATISTICS_SWAP_READAHEAD); // Pagine lette in anticipo, non ancora richieste
     }
 
+    if (loaded[0]) {
+        increment_statistics_mask(STATISTICS_BIT(STATISTICS_TLB_RELOAD) |
+                                  STATISTICS_BIT(STATISTICS_ZSWAP_HIT));
+        return 0;
+    }
     increment_statistics(STATISTICS_PAGE_FAULT_DISK); // Incrementa il contatore delle page fault dal disco
     increment_statistics(STATISTICS_SWAP_FILE_READ); // Incrementa il contatore delle letture da file di swap
-    return swap_list[page_index].swap_offset;
+    return 0;
 }
 
+// Slot occupati, utilizzabili e massimi dello swap (letti insieme, sotto il lock)
+void swap_get_usage(unsigned int *used, unsigned int *npages, unsigned int *max) {
+    spinlock_acquire(&filelock);
+    *used = swap_used;
+    *npages = swap_npages;
+    *max = swap_raw ? swap_npages : swap_max_pages;
+    spinlock_release(&filelock);
+}
 
 void swap_shutdown(void) {
-    int i;
-    vfs_close(v);
-
-    for(i=0; i<NUM_PAGES; i++) {
-        swap_list[i].ppadd = 0;
-        swap_list[i].pvadd = 0;
-        swap_list[i].swap_offset = 0;
-        swap_list[i].free = 1;
+    if (v == NULL) {
+        return;
     }
+    kprintf("Swap (%s): %u of %u slots in use (max %u)\n", swap_device_name(),
+            swap_used, swap_npages, swap_raw ? swap_npages : swap_max_pages);
+    zswap_print_statistics();
+    swap_close();
 }
 
 int getIn(void) {
@@ -143,4 +699,4 @@ int getIn(void) {
 }
 int getOut(void) {
     return timesOut;
-}
\ No newline at end of file
+}
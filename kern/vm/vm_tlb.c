@@ -3,6 +3,9 @@
 #include <lib.h>
 #include <spl.h>
 #include <cpu.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <platform/maxcpus.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
@@ -12,12 +15,172 @@
 #include <vmc1.h>
 #include <mips/tlb.h>
 #include <vm_tlb.h>
+#include <statistics.h>
+
+/*
+ * Gestione degli ASID: ogni address space riceve un ASID (campo PID di
+ * EntryHi), che etichetta le sue voci nella TLB, cosi' che il cambio di
+ * contesto non debba svuotarla. as->asid contiene la generazione (bit alti)
+ * e il numero dell'ASID (TLB_ASID_BITS bit bassi); vale 0 se non assegnato.
+ * Gli ASID si assegnano in ordine e non vengono riusati all'interno della
+ * stessa generazione: esauriti, inizia una nuova generazione e ogni CPU
+ * svuota la propria TLB prima di eseguire un ASID della nuova generazione.
+ */
+static struct spinlock asid_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned int asid_gen = TLB_NASID;  // Generazione corrente (multiplo di TLB_NASID)
+static unsigned int asid_next = 1;                  // Prossimo ASID libero (0 e' riservato)
+static volatile int asid_flush[MAXCPUS];            // La CPU deve svuotare la TLB prima di usare un nuovo ASID
+static uint32_t asid_pid[MAXCPUS];                  // Campo PID attivo su ogni CPU
+static volatile int asid_enabled = 1;               // 0: svuota la TLB ad ogni attivazione, come senza ASID
+
+// Voci invalidate su ogni CPU e non ancora riusate (stima, usata da tlb_find_free)
+static unsigned int tlb_nfree[MAXCPUS];
+
+// Campo PID di EntryHi per l'ASID asid
+static uint32_t asid_to_pid(unsigned int asid) {
+    return (asid & (TLB_NASID - 1)) << TLB_ASID_SHIFT;
+}
+
+/*
+ * Riporta in EntryHi il PID attivo sulla CPU dopo operazioni (tlb_read,
+ * tlb_probe o l'invalidazione di una voce) che lo hanno sovrascritto: il PID
+ * di EntryHi e' quello usato dalla traduzione degli accessi utente.
+ * tlb_probe carica EntryHi; un indirizzo di kseg0 non tocca nessuna traduzione.
+ * Va chiamata con le interruzioni disabilitate.
+ */
+static void tlb_restore_pid(void) {
+    (void)tlb_probe(TLBHI_INVALID(0) | asid_pid[curcpu->c_number], 0);
+}
+
+// Invalida nella TLB locale la voce (va, pid), se presente. Interruzioni disabilitate.
+static void tlb_invalidate_pid(vaddr_t va, uint32_t pid) {
+    int index;
+
+    index = tlb_probe((va & PAGE_FRAME) | pid, 0);
+    if (index >= 0) {
+        tlb_write(TLBHI_INVALID(index), TLBLO_INVALID(), index);
+        tlb_nfree[curcpu->c_number]++;
+    }
+}
+
+// Svuota la TLB locale. Interruzioni disabilitate.
+static void tlb_flush_local(void) {
+    int i;
+
+    for (i = 0; i < NUM_TLB; i++) {
+        tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+    }
+    tlb_nfree[curcpu->c_number] = NUM_TLB;
+}
+
+/*
+ * Cerca nella TLB locale una voce invalida. La ricerca scorre la TLB solo se
+ * dall'ultima ricerca senza esito qualche voce e' stata invalidata: al
+ * termine di un fault la TLB e' quasi sempre piena. Sovrascrive EntryHi:
+ * il chiamante scrive subito dopo la nuova voce. Interruzioni disabilitate.
+ *
+ * @return Indice della voce invalida, -1 se non ce ne sono.
+ */
+int tlb_find_free(void) {
+    unsigned int me = curcpu->c_number;
+    uint32_t ehi, elo;
+    int i;
+
+    if (tlb_nfree[me] == 0) {
+        return -1;
+    }
+    for (i = 0; i < NUM_TLB; i++) {
+        tlb_read(&ehi, &elo, i);
+        if (!(elo & TLBLO_VALID)) {
+            tlb_nfree[me]--;
+            return i;
+        }
+    }
+    tlb_nfree[me] = 0;
+    return -1;
+}
+
+/*
+ * Attiva as sulla CPU corrente: se il suo ASID appartiene a una generazione
+ * precedente ne assegna uno nuovo e, se l'assegnazione ha esaurito gli ASID,
+ * avvia una nuova generazione. La TLB locale viene svuotata solo se una
+ * nuova generazione e' iniziata dall'ultimo svuotamento (o se gli ASID sono
+ * disabilitati).
+ */
+void tlb_asid_activate(struct addrspace *as) {
+    unsigned int me, i;
+    int spl, flush;
+
+    spl = splhigh();
+    me = curcpu->c_number;
+    KASSERT(me < MAXCPUS);
+
+    // Percorso veloce, senza lock: la generazione e' scritta dopo i flag di
+    // svuotamento, che quindi sono gia' visibili se l'ASID e' della generazione corrente
+    flush = 0;
+    if ((as->asid & ~(TLB_NASID - 1)) != asid_gen || asid_flush[me]) {
+        spinlock_acquire(&asid_lock);
+        if ((as->asid & ~(TLB_NASID - 1)) != asid_gen) {
+            if (asid_next == TLB_NASID) {
+                // ASID esauriti: nuova generazione, tutte le CPU svuoteranno la TLB
+                for (i = 0; i < MAXCPUS; i++) {
+                    asid_flush[i] = 1;
+                }
+                membar_store_store();
+                asid_gen += TLB_NASID;
+                if (asid_gen == 0) {
+                    asid_gen = TLB_NASID;  // 0 indica un ASID non assegnato
+                }
+                asid_next = 1;
+            }
+            as->asid = asid_gen | asid_next++;
+        }
+        flush = asid_flush[me];
+        asid_flush[me] = 0;
+        spinlock_release(&asid_lock);
+    }
+    else {
+        membar_load_load();
+    }
+
+    if (flush || !asid_enabled) {
+        tlb_flush_local();
+        increment_statistics(STATISTICS_TLB_INVALIDATE);
+    }
+    asid_pid[me] = asid_to_pid(as->asid);
+    tlb_restore_pid();
+    splx(spl);
+}
+
+/*
+ * Toglie ad as il suo ASID: le voci etichettate con l'ASID precedente non
+ * verranno piu' usate su nessuna CPU, perche' quell'ASID non viene riusato
+ * prima di una nuova generazione. Se as e' l'address space corrente va
+ * riattivato (as_activate) per ricevere un nuovo ASID.
+ */
+void tlb_asid_renew(struct addrspace *as) {
+    spinlock_acquire(&asid_lock);
+    as->asid = 0;
+    spinlock_release(&asid_lock);
+}
+
+// Valore di EntryHi per la pagina va dell'address space attivo sulla CPU (interruzioni disabilitate)
+uint32_t tlb_ehi(vaddr_t va) {
+    return (va & PAGE_FRAME) | asid_pid[curcpu->c_number];
+}
+
+// Usata dal benchmark vmasidbench per confrontare il comportamento con e senza ASID
+int tlb_asid_set_enabled(int enabled) {
+    int old = asid_enabled;
+
+    asid_enabled = enabled != 0;
+    return old;
+}
 
 
 // Rimuove la voce del TLB corrispondente all'indirizzo virtuale dato (va)
 // Se la voce è presente, la invalida.
 int tlb_remove_by_va(vaddr_t va) {
-    int spl, index;
     struct addrspace *as;
 
     // Ottieni l'address space del processo corrente
@@ -30,19 +193,129 @@ int tlb_remove_by_va(vaddr_t va) {
         return -1;
     }
 
+    tlb_invalidate_va(va);
+
+    // Restituisce 0 per indicare che la rimozione è andata a buon fine
+    return 0;
+}
+
+// Invalida nella TLB locale la voce dell'address space attivo corrispondente a va, se presente
+void tlb_invalidate_va(vaddr_t va) {
+    int spl;
+
     // Disabilita le interruzioni durante la manipolazione del TLB
     spl = splhigh();
+    tlb_invalidate_pid(va, asid_pid[curcpu->c_number]);
+    tlb_restore_pid();
+    // Ripristina lo stato delle interruzioni
+    splx(spl);
+}
 
-    // Cerca la voce nel TLB corrispondente all'indirizzo virtuale (va)
-    index = tlb_probe(va, 0);
-    if (index >= 0) {
-        // Se la voce è presente, la invalida
-        tlb_write(TLBHI_INVALID(index), TLBLO_INVALID(), index);
+// Invalida nella TLB locale le voci di as delle npages pagine a partire da start
+void tlb_invalidate_range(struct addrspace *as, vaddr_t start, unsigned npages) {
+    int spl, i;
+    unsigned p;
+    uint32_t ehi, elo, pid;
+    vaddr_t end;
+
+    start &= PAGE_FRAME;
+    pid = asid_to_pid(as->asid);
+    spl = splhigh();
+    if (npages <= NUM_TLB) {
+        // Pochi indirizzi: una probe per pagina
+        for (p = 0; p < npages; p++) {
+            tlb_invalidate_pid(start + p * PAGE_SIZE, pid);
+        }
+    }
+    else {
+        // Intervallo piu' grande della TLB: conviene scorrere tutte le voci
+        end = start + npages * PAGE_SIZE;
+        for (i = 0; i < NUM_TLB; i++) {
+            tlb_read(&ehi, &elo, i);
+            if ((elo & TLBLO_VALID) && (ehi & TLB_ASID_MASK) == pid &&
+                (ehi & TLBHI_VPAGE) >= start && (ehi & TLBHI_VPAGE) < end) {
+                tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+                tlb_nfree[curcpu->c_number]++;
+            }
+        }
     }
+    tlb_restore_pid();
+    splx(spl);
+}
 
-    // Ripristina lo stato delle interruzioni
+// Invalida tutte le voci della TLB locale
+void tlb_invalidate_all(void) {
+    int spl;
+
+    spl = splhigh();
+    tlb_flush_local();
+    tlb_restore_pid();
     splx(spl);
+}
 
-    // Restituisce 0 per indicare che la rimozione è andata a buon fine
-    return 0;
+// Invalida localmente le richieste del batch e le invia alle altre CPU, attendendone il completamento
+static void tlb_shootdown_send(const struct tlbshootdown *ts, unsigned n) {
+    unsigned i;
+
+    // L'invalidazione locale non dipende dall'address space attivo: le voci
+    // del proprietario restano nella TLB, etichettate con il suo ASID, anche
+    // dopo il passaggio a un altro processo
+    for (i = 0; i < n; i++) {
+        tlb_invalidate_range(ts[i].ts_as, ts[i].ts_start, ts[i].ts_npages);
+    }
+
+    ipi_tlbshootdown_broadcast(ts, n);
+}
+
+// Invalida la traduzione (as, va) sulla CPU corrente e su tutte le altre
+void tlb_shootdown_va(struct addrspace *as, vaddr_t va) {
+    tlb_shootdown_range(as, va, 1);
+}
+
+// Invalida le traduzioni di npages pagine di as su tutte le CPU
+void tlb_shootdown_range(struct addrspace *as, vaddr_t start, unsigned npages) {
+    struct tlbshootdown ts;
+
+    KASSERT(as != NULL);
+
+    ts.ts_as = as;
+    ts.ts_start = start & PAGE_FRAME;
+    ts.ts_npages = npages;
+    tlb_shootdown_send(&ts, 1);
+}
+
+// Sezione batch: raccoglie piu' shootdown e li invia con un'unica attesa
+
+void tlb_batch_init(struct tlb_batch *tb) {
+    tb->tb_count = 0;
+}
+
+void tlb_batch_add(struct tlb_batch *tb, struct addrspace *as, vaddr_t va) {
+    struct tlbshootdown ts;
+    unsigned i;
+
+    KASSERT(as != NULL);
+
+    ts.ts_as = as;
+    ts.ts_start = va & PAGE_FRAME;
+    ts.ts_npages = 1;
+
+    // Le pagine adiacenti dello stesso address space finiscono in un'unica richiesta
+    for (i = 0; i < tb->tb_count; i++) {
+        if (vm_tlbshootdown_merge(&tb->tb_ts[i], &ts)) {
+            return;
+        }
+    }
+    if (tb->tb_count == TLBSHOOTDOWN_MAX) {
+        tlb_batch_flush(tb);
+    }
+    tb->tb_ts[tb->tb_count++] = ts;
+}
+
+void tlb_batch_flush(struct tlb_batch *tb) {
+    if (tb->tb_count == 0) {
+        return;
+    }
+    tlb_shootdown_send(tb->tb_ts, tb->tb_count);
+    tb->tb_count = 0;
 }
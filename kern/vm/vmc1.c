@@ -4,6 +4,7 @@
 #include <spl.h>
 #include <cpu.h>
 #include <spinlock.h>
+#include <membar.h>
 #include <proc.h>
 #include <current.h>
 #include <mips/tlb.h>
@@ -16,10 +17,22 @@
 #include <syscall.h>
 #include <statistics.h>
 #include <segments.h>
+#include <vm_tlb.h>
+#include <pageout.h>
+#include <pagecache.h>
+#include <platform/maxcpus.h>
+#include "opt-c1_tlb_free.h"
+#include "opt-c1_tlb_random.h"
+#include "opt-c1_tlb_plru.h"
 
 // Variabile globale statica che tiene traccia dell'indice della prossima vittima TLB
 static unsigned int current_victim;
+// Ricarica veloce dalla cache software delle traduzioni (stlb) attiva
+static volatile int stlb_enabled = 1;
+// Frame del kernel pieno di zeri, mappato in sola lettura per le pagine PTE_ZERO
+static paddr_t vm_zero_frame = 0;
 
+#if !OPT_C1_TLB_RANDOM && !OPT_C1_TLB_PLRU
 /*
  * Seleziona un entry TLB da sostituire usando la strategia Round-Robin.
  * 
@@ -42,11 +55,385 @@ static unsigned int tlb_get_rr_victim(void) {
     // Restituisce l'indice della vittima selezionata
     return victim;
 }
+#endif
+
+#if OPT_C1_TLB_PLRU
+/*
+ * Pseudo-LRU per la TLB, basato sulla storia campionata dei fault: ogni CPU
+ * ricorda le ultime TLB_HISTORY voci tolte dalla propria TLB. Una pagina che
+ * causa un fault poco dopo essere stata tolta (tipicamente la pagina di codice
+ * in esecuzione o lo stack) e' in uso: la sua nuova voce viene protetta e la
+ * lancetta la salta una volta, togliendole la protezione (second chance).
+ */
+#define TLB_HISTORY 16
+
+struct tlb_plru {
+    uint32_t hot[NUM_TLB / 32];       // Bit delle voci protette
+    uint32_t evicted[TLB_HISTORY];    // EntryHi delle ultime voci tolte (anello)
+    unsigned int next_evicted;        // Prossima posizione da sovrascrivere nell'anello
+    unsigned int hand;                // Lancetta sulle voci della TLB
+};
+
+static struct tlb_plru tlb_plru[MAXCPUS];
+
+static unsigned int tlb_get_plru_victim(struct tlb_plru *p) {
+    unsigned int victim;
+
+    while (1) {
+        victim = p->hand;
+        p->hand = (p->hand + 1) % NUM_TLB;
+        if (!(p->hot[victim / 32] & (1U << (victim % 32)))) {
+            return victim;
+        }
+        p->hot[victim / 32] &= ~(1U << (victim % 32));
+    }
+}
+
+// Aggiorna la storia dopo la scrittura di ehi nella voce victim, che conteneva victim_ehi
+static void tlb_plru_update(struct tlb_plru *p, unsigned int victim, uint32_t ehi,
+                            uint32_t victim_ehi, uint32_t victim_elo) {
+    unsigned int i;
+    int hot = 0;
+
+    for (i = 0; i < TLB_HISTORY; i++) {
+        if (p->evicted[i] == ehi) {
+            hot = 1;
+            p->evicted[i] = TLBHI_INVALID(0); // Ogni eviction protegge al piu' una volta
+            break;
+        }
+    }
+    if (hot) {
+        p->hot[victim / 32] |= 1U << (victim % 32);
+    } else {
+        p->hot[victim / 32] &= ~(1U << (victim % 32));
+    }
+    if (victim_elo & TLBLO_VALID) {
+        p->evicted[p->next_evicted] = victim_ehi;
+        p->next_evicted = (p->next_evicted + 1) % TLB_HISTORY;
+    }
+}
+#endif
+
+/*
+ * Scrive la traduzione (ehi, elo) in una voce della TLB locale scelta con la
+ * politica compilata (opzioni c1_tlb_*): senza opzioni Round-Robin, con le
+ * altre politiche prima una voce invalida e solo in mancanza la vittima
+ * indicata dalla politica. Va chiamata con le interruzioni disabilitate.
+ *
+ * @return STATISTICS_TLB_FAULT_REPLACE se e' stata sostituita una voce
+ *         valida, STATISTICS_TLB_FAULT_FREE altrimenti.
+ */
+static unsigned int tlb_insert(uint32_t ehi, uint32_t elo) {
+    uint32_t victim_ehi, victim_elo;
+    unsigned int victim;
+#if OPT_C1_TLB_FREE || OPT_C1_TLB_RANDOM || OPT_C1_TLB_PLRU
+    int index;
+#endif
+#if OPT_C1_TLB_PLRU
+    struct tlb_plru *p = &tlb_plru[curcpu->c_number];
+#endif
+
+#if OPT_C1_TLB_FREE || OPT_C1_TLB_RANDOM || OPT_C1_TLB_PLRU
+    index = tlb_find_free();
+    if (index >= 0) {
+        victim = index;
+    } else
+#endif
+    {
+#if OPT_C1_TLB_PLRU
+        victim = tlb_get_plru_victim(p);
+#elif OPT_C1_TLB_RANDOM
+        victim = random() % NUM_TLB;
+#else
+        victim = tlb_get_rr_victim();
+#endif
+    }
+
+    tlb_read(&victim_ehi, &victim_elo, victim); // Legge la vittima corrente
+    tlb_write(ehi, elo, victim);
+#if OPT_C1_TLB_PLRU
+    tlb_plru_update(p, victim, ehi, victim_ehi, victim_elo);
+#endif
+
+    return (victim_elo & TLBLO_VALID) ? STATISTICS_TLB_FAULT_REPLACE : STATISTICS_TLB_FAULT_FREE;
+}
+
+// Nome della politica di rimpiazzo della TLB selezionata con le opzioni c1_tlb_*
+const char *vm_tlb_policy_name(void) {
+#if OPT_C1_TLB_PLRU
+    return "free + pseudo-LRU";
+#elif OPT_C1_TLB_RANDOM
+    return "free + random";
+#elif OPT_C1_TLB_FREE
+    return "free + Round Robin";
+#else
+    return "Round Robin";
+#endif
+}
+/*
+ * Ricarica veloce: se la cache software dell'address space contiene una
+ * traduzione valida per va la scrive nella TLB, senza cercare il segmento ne'
+ * percorrere la page table. Un fault in scrittura e' servito solo da una
+ * voce gia' scrivibile. Le statistiche sono aggiornate come per una normale
+ * ricarica, con un solo acquisto dello spinlock.
+ *
+ * Una eviction incrementa stlb_gen prima dello shootdown: se lo fa dopo il
+ * controllo qui sotto, lo shootdown attende che le interruzioni vengano
+ * riabilitate e invalida la voce appena scritta.
+ *
+ * @return 1 se il fault e' stato gestito, 0 se serve il percorso completo.
+ */
+static int vm_stlb_refill(struct addrspace *as, int fault_type, vaddr_t va) {
+    struct stlb_entry *e;
+    uint32_t ehi, elo;
+    unsigned int stats;
+    int spl, index;
+
+    e = &as->stlb[STLB_INDEX(va)];
+    spl = splhigh();
+    if (e->vpn != va || e->gen != as->stlb_gen ||
+        (fault_type == VM_FAULT_WRITE && !(e->elo & TLBLO_DIRTY))) {
+        splx(spl);
+        return 0;
+    }
+    elo = e->elo;
+    ehi = tlb_ehi(va);
+
+    stats = STATISTICS_BIT(STATISTICS_TLB_FAULT) | STATISTICS_BIT(STATISTICS_TLB_RELOAD) |
+            STATISTICS_BIT(STATISTICS_STLB_HIT);
+
+    // Come nel percorso completo, una voce gia' presente va sovrascritta
+    index = tlb_probe(ehi, 0);
+    if (index >= 0) {
+        tlb_write(ehi, elo, index);
+        stats |= STATISTICS_BIT(STATISTICS_TLB_FAULT_FREE);
+    } else {
+        stats |= STATISTICS_BIT(tlb_insert(ehi, elo));
+    }
+    splx(spl);
+
+    coremap_set_referenced(elo & TLBLO_PPAGE);
+    increment_statistics_mask(stats);
+    return 1;
+}
+
+/*
+ * Registra la traduzione (va, elo) appena scritta nella TLB nella cache
+ * software, se la generazione letta prima del percorso completo (gen) e'
+ * ancora quella corrente. La voce porta gen e non la generazione corrente:
+ * una eviction iniziata nel frattempo la rende comunque non valida.
+ * Va chiamata con le interruzioni disabilitate.
+ */
+static void vm_stlb_fill(struct addrspace *as, unsigned int gen, vaddr_t va, uint32_t elo) {
+    struct stlb_entry *e;
+
+    if (gen != as->stlb_gen) {
+        return;
+    }
+    e = &as->stlb[STLB_INDEX(va)];
+    e->vpn = va;
+    e->elo = elo;
+    e->gen = gen;
+}
+
+// Usata dal benchmark vmstlbbench per confrontare i due percorsi di ricarica
+int vm_stlb_set_enabled(int enabled) {
+    int old = stlb_enabled;
+
+    stlb_enabled = enabled != 0;
+    return old;
+}
+
+/*
+ * Indica se il segmento consente la scrittura (dati e stack).
+ */
+static int seg_is_writable(struct segment *seg) {
+    return seg->p_permission == (PF_R | PF_W) || seg->p_permission == PF_S || seg->p_permission == PF_W;
+}
+
+/*
+ * Gestisce la prima scrittura su una pagina mappata in sola lettura di un
+ * segmento scrivibile (VM_FAULT_READONLY): una pagina pulita, che da qui in poi
+ * e' modificata, oppure una pagina condivisa in copy-on-write dopo una fork.
+ * Se il frame non e' condiviso lo si intesta al processo e basta renderlo scrivibile; altrimenti
+ * si copia la pagina in un frame privato e si rilascia il riferimento a quello
+ * condiviso. Il riferimento viene rilasciato solo dopo la copia: finche' lo
+ * si possiede, l'altro processo non puo' rendere scrivibile il frame. Se nel
+ * frattempo un'eviction ha scelto il frame, la copia viene scartata.
+ *
+ * Una pagina di soli zeri (PTE_ZERO), mappata sul frame di zeri del kernel,
+ * riceve invece un frame privato gia' azzerato, senza copia.
+ *
+ * @return Indirizzo fisico (privato) da mappare in scrittura, 0 se la pagina
+ *         nel frattempo e' stata portata nello swap.
+ */
+static paddr_t vm_fault_cow(struct addrspace *as, vaddr_t va) {
+    paddr_t pa, newpa;
+    pte_t *pte;
+    int claim;
+
+    pte = pt_walk(as->pt, va, 0);
+    if (pte != NULL && PTE_IS_ZERO(*pte)) {
+        newpa = page_alloc_zeroed(va);
+        KASSERT(newpa != 0);
+        pte_set_pa(pte, newpa);
+        coremap_publish(newpa, 1, -1);
+        return newpa;
+    }
+    pa = pte != NULL ? PTE_GET_PA(*pte) : PFN_NOT_USED;
+    if (pa == PFN_NOT_USED) {
+        // Evict concorrente: la voce TLB e' gia' stata invalidata, il prossimo
+        // accesso causera' un normale fault che la riporta in memoria
+        return 0;
+    }
+    claim = coremap_cow_claim(pa, as, va);
+    if (claim == COREMAP_COW_BUSY) {
+        // Swap-out in corso: nessuna copia, perche' l'eviction sta per scrivere
+        // lo slot nella stessa PTE; finito questo, il prossimo accesso la
+        // riportera' in memoria
+        coremap_wait_busy(pa);
+        return 0;
+    }
+    if (claim == COREMAP_COW_OWNED) {
+        return pa;
+    }
+
+    newpa = page_alloc(va);
+    KASSERT(newpa != 0);
+    memmove((void *)PADDR_TO_KVADDR(newpa), (const void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+    if (!coremap_unshare(pa, as, va)) {
+        // Il frame condiviso e' stato scelto come vittima durante la copia: la
+        // PTE e' (o sta per essere) aggiornata dall'eviction e la copia, forse
+        // non valida, viene scartata; l'accesso verra' ripetuto
+        page_discard(newpa);
+        coremap_wait_busy(pa);
+        return 0;
+    }
+    pte_set_pa(pte, newpa);
+    coremap_publish(newpa, 1, -1); // La copia privata non ha uno slot nello swap
+    increment_statistics(STATISTICS_COW_FAULT); // Incrementa il contatore delle copie copy-on-write
+
+    return newpa;
+}
+
+/*
+ * Swap-in della pagina va, dallo slot offset, nel frame pa con read-ahead: le
+ * pagine virtuali successive dello stesso segmento che si trovano negli slot
+ * immediatamente successivi (come le lascia il pageout, che assegna slot
+ * contigui a pagine contigue) vengono lette nella stessa VOP_READ. Il
+ * read-ahead usa solo frame liberi e si ferma alla prima pagina che non
+ * rispetta queste condizioni. Tutte le pagine lette sono pulite.
+ * pte e' l'handle (pt_walk) della pagina va.
+ */
+static void vm_swap_in_cluster(struct addrspace *as, struct segment *seg, vaddr_t va, pte_t *pte,
+                               off_t offset, paddr_t pa) {
+    paddr_t pas[SWAP_BATCH_MAX];
+    pte_t *ptes[SWAP_BATCH_MAX];
+    unsigned int n, window, i;
+    vaddr_t next;
+    int result;
+
+    pas[0] = pa;
+    ptes[0] = pte;
+    n = 1;
+    window = swap_get_readahead();
+    while (n <= window) {
+        next = va + n * PAGE_SIZE;
+        if (next < va || as_get_segment(as, next) != seg) {
+            break;
+        }
+        // Solo pagine non residenti il cui slot segue quello della precedente
+        ptes[n] = pt_walk(as->pt, next, 0);
+        if (ptes[n] == NULL || PTE_GET_OFFSET(*ptes[n]) != offset + (off_t)n * PAGE_SIZE) {
+            break;
+        }
+        pas[n] = page_alloc_noevict(as, next);
+        if (pas[n] == 0) {
+            break;
+        }
+        n++;
+    }
+
+    result = swap_in_cluster(pas, n, offset);
+    KASSERT(result == 0);  // Verifica che il caricamento sia riuscito
+
+    // Le pagine sono in memoria e pulite: gli slot passano ai frame come loro copia valida
+    for (i = 0; i < n; i++) {
+        pte_set_pa(ptes[i], pas[i]);
+        coremap_publish(pas[i], 0, offset + (off_t)i * PAGE_SIZE);
+    }
+}
+
+/*
+ * Carica dall'ELF la pagina va nel frame pa con fault-around: le pagine
+ * successive dello stesso segmento mai caricate (PTE a 0), fino alla finestra
+ * impostata con elfra, vengono lette nella stessa VOP_READ e inserite subito
+ * nella page table, pulite. Il fault-around usa solo frame liberi e si ferma
+ * alla prima pagina che non rispetta queste condizioni. La pagina va viene
+ * registrata nella page table dal chiamante.
+ * Le pagine di codice lette entrano nella cache delle pagine prima di essere
+ * pubblicate; il fault-around si ferma anche a una pagina di codice gia'
+ * presente nella cache, che viene mappata condivisa.
+ */
+static int vm_fault_around(struct addrspace *as, struct segment *seg, vaddr_t va, paddr_t pa) {
+    paddr_t pas[SEG_FAULTAROUND_MAX + 1];
+    pte_t *ptes[SEG_FAULTAROUND_MAX + 1];
+    unsigned int n, window, i;
+    vaddr_t next;
+    off_t key;
+    int result, text;
+
+    text = seg_text_key(seg, va, &key);
+    pas[0] = pa;
+    n = 1;
+    window = seg_faultaround_window(seg, va);
+    while (n <= window) {
+        next = va + n * PAGE_SIZE;
+        ptes[n] = pt_walk(as->pt, next, 0);
+        if (ptes[n] == NULL || *ptes[n] != 0) {
+            break;
+        }
+        if (text && (pas[n] = pagecache_lookup(seg->vnode, key + (off_t)n * PAGE_SIZE, as, next, ptes[n])) != 0) {
+            break;
+        }
+        pas[n] = page_alloc_noevict(as, next);
+        if (pas[n] == 0) {
+            break;
+        }
+        n++;
+    }
+
+    result = seg_load_pages(seg, va, pas, n);
+
+    if (text && result == 0) {
+        for (i = 0; i < n; i++) {
+            pagecache_insert(seg->vnode, key + (off_t)i * PAGE_SIZE, pas[i]);
+        }
+    }
+    for (i = 1; i < n; i++) {
+        pte_set_pa(ptes[i], pas[i]);
+        coremap_publish(pas[i], 0, -1);
+    }
+    return result;
+}
+
 /* 
- * Funzione che chiama coremap_init() per inizializzare la coremap.
+ * Funzione che chiama coremap_init() per inizializzare la coremap e apre lo
+ * swap, una sola volta per tutti i processi (i dispositivi, compreso emu0,
+ * sono gia' stati configurati).
  */
 void vm_bootstrap(void) {
+    vaddr_t zero_page;
+
     coremap_init();
+    // Frame di zeri condiviso in sola lettura da tutte le pagine PTE_ZERO
+    zero_page = alloc_kpages(1);
+    KASSERT(zero_page != 0);
+    bzero((void *)zero_page, PAGE_SIZE);
+    vm_zero_frame = zero_page - MIPS_KSEG0;
+    pagecache_init(); // Una voce per frame: dopo la coremap
+    swapfile_init(); // Apre il supporto dello swap, prima che il demone possa usarlo
+    pageout_bootstrap(); // Avvia il demone di pageout
     current_victim = 0; // È inizializzata a 0 e mantiene il suo valore tra le chiamate alla funzione.
     init_statistics(); // Inizializza il sistema di statistiche
 }
@@ -56,6 +443,7 @@ void vm_bootstrap(void) {
  * allocate per la coremap.
  */
 void vm_shutdown(void) {
+    coremap_print_statistics(); // Stampa le statistiche della coremap prima di disattivarla
     coremap_shutdown();
     swap_shutdown(); // Chiude il file di swap
     print_all_statistics(); // Stampa tutte le statistiche raccolte
@@ -90,15 +478,16 @@ void vm_can_sleep(void) {
  */
 int vm_fault(int fault_type, vaddr_t fault_addr)
 {
-    int spl, new_page, result; //i, found
-    unsigned int victim;
-    uint32_t ehi, elo, victim_ehi, victim_elo;;
+    int spl, result, index; //i, found
+    unsigned int gen;
+    uint32_t ehi, elo;
     struct addrspace *as;
     paddr_t pa;
     struct segment * seg;
     vaddr_t pageallign_va;
     off_t swap_offset; // Offset della pagina nello swap file
-    off_t result_swap_in; // Risultato della funzione swap_in
+    pte_t *pte, entry; // Handle della PTE della pagina e suo valore
+    off_t text_key; // Offset nel file di una pagina di codice (cache delle pagine)
     
 
     pageallign_va = fault_addr & PAGE_FRAME;
@@ -106,9 +495,8 @@ int vm_fault(int fault_type, vaddr_t fault_addr)
     // Gestione dei diversi tipi di fault
     switch (fault_type) {
         case VM_FAULT_READONLY:
-            // Se la fault è su una pagina di sola lettura, restituiamo EACCES
-            sys__exit(1); // Termina il processo
-            return EACCES; // Restituisce un errore di accesso per permessi mancanti (in questo caso in scrittura)
+            // Scrittura su una pagina mappata in sola lettura: copy-on-write
+            // se il segmento e' scrivibile, altrimenti violazione dei permessi
         case VM_FAULT_READ:
         case VM_FAULT_WRITE:
             break; // Se la fault è di lettura o scrittura, proseguiamo
@@ -136,92 +524,179 @@ int vm_fault(int fault_type, vaddr_t fault_addr)
         return EFAULT;
     }
 
-    new_page = -1;
+    // Percorso veloce: traduzione recente presente nella cache software
+    if (fault_type != VM_FAULT_READONLY && stlb_enabled &&
+        vm_stlb_refill(as, fault_type, pageallign_va)) {
+        return 0;
+    }
+    // La traduzione calcolata sotto entra nella cache solo se nessuna eviction
+    // dell'address space e' iniziata dopo questa lettura
+    gen = as->stlb_gen;
+    membar_load_load();
+
     seg = as_get_segment(as, fault_addr);
+    if (seg == NULL) {
+        // Accesso sotto lo stack: lo stack cresce se l'indirizzo e' entro il limite
+        seg = as_grow_stack(as, fault_addr);
+    }
     if (seg == NULL)
     {
         return EFAULT;
     }
 
+    if (fault_type == VM_FAULT_READONLY) {
+        if (!seg_is_writable(seg)) {
+            // Scrittura sul segmento di codice: il processo viene terminato
+            sys__exit(1);
+            return EACCES;
+        }
+        pa = vm_fault_cow(as, pageallign_va);
+        if (pa == 0) {
+            return 0;
+        }
+        elo = pa | TLBLO_VALID | TLBLO_DIRTY;
+        goto tlb_update;
+    }
+
     // Determina lo stato da assegnare all'entry TLB in base ai permessi della sezione di memoria.
 
+    // Un'unica visita della page table: lo stato della pagina si legge dalla
+    // PTE e la si aggiorna tramite lo stesso handle
+    pte = pt_walk(as->pt, fault_addr, 1);
+    entry = *pte;
+
     // Cerchiamo l'indirizzo fisico corrispondente nel page table
-    pa = pt_get_pa(as->pt, fault_addr);
+    pa = PTE_GET_PA(entry);
+    if (pa != PFN_NOT_USED && coremap_is_busy(pa)) {
+        // La pagina e' in corso di swap-out: si attende la fine della scrittura
+        // e si ripete l'accesso, che la riportera' in memoria dallo swap
+        coremap_wait_busy(pa);
+        return 0;
+    }
     if (pa > 0) {
         increment_statistics(STATISTICS_TLB_RELOAD); // Incrementa il contatore delle ricariche TLB
     }
+    // Pagina scartata perche' piena di zeri: una lettura viene servita dal
+    // frame di zeri condiviso, in sola lettura, una scrittura da un frame azzerato
+    if (PTE_IS_ZERO(entry)) {
+        increment_statistics(STATISTICS_TLB_FAULT);
+        increment_statistics(STATISTICS_PAGE_FAULT_ZERO);
+        if (fault_type == VM_FAULT_READ) {
+            pa = vm_zero_frame;
+            elo = pa | TLBLO_VALID;
+            goto tlb_update;
+        }
+        pa = page_alloc_zeroed(pageallign_va);
+        KASSERT(pa != 0);
+        pte_set_pa(pte, pa);
+        coremap_publish(pa, 1, -1);
+        elo = pa | TLBLO_VALID | TLBLO_DIRTY;
+        goto tlb_update;
+    }
+
     // Verifichiamo se la pagina è stata swappata
-    swap_offset = pt_get_offset(as->pt, fault_addr);
+    swap_offset = PTE_GET_OFFSET(entry);
+
+    // Pagina di codice mai caricata da questo processo: se un altro processo
+    // che esegue lo stesso file la ha in memoria se ne condivide il frame,
+    // come per una ricarica della TLB
+    if (pa == PFN_NOT_USED && swap_offset == -1 && seg_text_key(seg, pageallign_va, &text_key)) {
+        pa = pagecache_lookup(seg->vnode, text_key, as, pageallign_va, pte);
+        if (pa != 0) {
+            increment_statistics(STATISTICS_TLB_RELOAD);
+            increment_statistics(STATISTICS_TEXT_SHARED);
+        }
+    }
 
-    // Se non esiste, dobbiamo allocare un nuovo frame
+    // Se non esiste, dobbiamo allocare un nuovo frame.
+    // Il frame non puo' essere scelto come vittima finche' non e' riempito e
+    // pubblicato con coremap_publish
     if(pa == PFN_NOT_USED && swap_offset == -1) {
-        // Richiesta di un nuovo frame fisico alla Coremap
-        pa = page_alloc(pageallign_va);
-
-        // Aggiornamento della pagetable, associando all'indirizzo virtuale il frame fisico appena allocato
+        // Richiesta di un nuovo frame fisico alla Coremap.
+        // Stack e heap non hanno un file da cui leggere: la pagina va azzerata.
+        // In C, le variabili non inizializzate non sono garantite ad avere un valore specifico.
+        // Pertanto, se una nuova pagina non viene azzerata prima di essere utilizzata, potrebbe contenere
+        // dati arbitrari che potrebbero causare un comportamento imprevisto del programma.
+        // Il frame arriva gia' azzerato, se possibile dalla riserva riempita dai CPU inattivi
+        if (seg->vnode == NULL) {
+            pa = page_alloc_zeroed(pageallign_va);
+        }
+        else {
+            pa = page_alloc(pageallign_va);
+        }
         KASSERT((pa & PAGE_FRAME) == pa);
-        pt_set_pa(as->pt, fault_addr, pa);
-        if (seg->p_permission == PF_S) // Se il fault si verifica nel segmento dello stack, dobbiamo azzerare la pagina
-        {   
-            // In C, le variabili non inizializzate non sono garantite ad avere un valore specifico.
-            // Pertanto, se una nuova pagina non viene azzerata prima di essere utilizzata, potrebbe contenere
-            // dati arbitrari che potrebbero causare un comportamento imprevisto del programma.
-            // Azzerando la pagina, garantiamo che sia inizializzata con uno stato noto di tutti zeri.
 
-            bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE); // Azzeriamo la pagina alla sua indirizzo fisico
+        if (seg->vnode == NULL)
+        {   
             increment_statistics(STATISTICS_PAGE_FAULT_ZERO); // Incrementa il contatore delle pagine azzerate
+            result = 0;
+        }
+        else {
+            // Pagina del segmento di codice o dati: viene letta dall'ELF,
+            // insieme alle successive (fault-around)
+            result = vm_fault_around(as, seg, pageallign_va, pa);
         }
-        new_page = 1;
+
+        // Aggiornamento della pagetable, associando all'indirizzo virtuale il frame fisico appena allocato.
+        // Le pagine dell'ELF sono pulite (possono essere rilette), quelle di stack e heap no
+        pte_set_pa(pte, pa);
+        coremap_publish(pa, seg->vnode == NULL, -1);
+        if (result)
+            return EFAULT;
     }
-    else if(swap_offset >= 0) {
+    else if(pa == PFN_NOT_USED && swap_offset >= 0) {
 
         // Se la pagina è stata "swappata fuori", la carichiamo dalla swap
         pa = page_alloc(pageallign_va);  // Alloca una pagina fisica
 
-        // Carica la pagina dal file di swap
-        result_swap_in = swap_in(pa, swap_offset);  // Carica la pagina dal file di swap
+        // Carica la pagina dal file di swap, insieme alle successive (read-ahead),
+        // e aggiorna la page table: le pagine sono in memoria e pulite
+        vm_swap_in_cluster(as, seg, pageallign_va, pte, swap_offset, pa);
+    }
 
-        KASSERT(result_swap_in == 0);  // Verifica che il caricamento sia riuscito
+    elo = pa | TLBLO_VALID;
 
-        // Aggiorna lo stato della pagina nella page table
-        // Imposta lo stato della pagina come in memoria
-        pt_set_offset(as->pt, pageallign_va, -1);
-        pt_set_pa(as->pt, pageallign_va, pa);
+    // Le pagine vengono mappate scrivibili solo se gia' modificate o per una
+    // scrittura: la prima scrittura su una pagina pulita, o condivisa in
+    // copy-on-write, causera' un VM_FAULT_READONLY gestito da vm_fault_cow
+    if (seg_is_writable(seg) && (fault_type == VM_FAULT_WRITE || coremap_is_modified(pa)) &&
+        coremap_cow_claim(pa, as, pageallign_va) == COREMAP_COW_OWNED)
+    {
+        elo = elo | TLBLO_DIRTY;
     }
 
+    increment_statistics(STATISTICS_TLB_FAULT); // Incrementa il contatore dei page fault TLB
 
-    // Aggiornare o modificare il codice
-    if(new_page == 1 && seg->p_permission != PF_S) {
-        result = seg_load_page(seg, fault_addr, pa); 
-        if (result)
-            return EFAULT;
-    }    
+    // Un VM_FAULT_READONLY non e' un TLB miss e non viene contato come TLB fault
+tlb_update:
+    coremap_set_referenced(pa); // Ogni ricarica TLB e' un riferimento alla pagina (Clock/WSClock)
 
-    increment_statistics(STATISTICS_TLB_FAULT); // Incrementa il contatore dei page fault TLB
     // Disabilita le interruzioni per gestire la TLB in modo sicuro
     spl = splhigh();
-
-
-
-    victim = tlb_get_rr_victim();
-
-    ehi = pageallign_va;
-    elo = pa | TLBLO_VALID;
-
-    if (seg->p_permission == (PF_R | PF_W) || seg->p_permission == PF_S || seg->p_permission == PF_W)
-    {
-        elo = elo | TLBLO_DIRTY;
+    ehi = tlb_ehi(pageallign_va); // Voce etichettata con l'ASID del processo
+
+    // Uno swap-out iniziato dopo i controlli precedenti attende, per lo shootdown,
+    // che le interruzioni vengano riabilitate: se il frame non e' busy ora, la voce
+    // scritta qui sotto verra' comunque invalidata prima della scrittura sullo swap
+    if (coremap_is_busy(pa)) {
+        splx(spl);
+        coremap_wait_busy(pa);
+        return 0;
     }
 
-    tlb_read(&victim_ehi, &victim_elo, victim); // Legge la vittima corrente
-    if ( victim_elo & TLBLO_VALID ){ // Se la vittima è valida
-        increment_statistics(STATISTICS_TLB_FAULT_REPLACE); // Incrementa il contatore dei page fault TLB sostituiti
-    }else{
-        increment_statistics(STATISTICS_TLB_FAULT_FREE); // Incrementa il contatore dei page fault TLB liberati
+    // Dopo un VM_FAULT_READONLY la voce e' ancora presente: va sovrascritta,
+    // perche' due voci con lo stesso indirizzo virtuale non sono ammesse
+    index = tlb_probe(ehi, 0);
+    if (index >= 0) {
+        tlb_write(ehi, elo, index);
+        vm_stlb_fill(as, gen, pageallign_va, elo);
+        splx(spl);
+        return 0;
     }
 
-    tlb_write(ehi, elo, victim);
-
+    // Sceglie la voce con la politica compilata e conta se era libera o sostituita
+    increment_statistics(tlb_insert(ehi, elo));
+    vm_stlb_fill(as, gen, pageallign_va, elo);
 
     splx(spl);  // Ripristina le interruzioni
 
@@ -229,9 +704,48 @@ int vm_fault(int fault_type, vaddr_t fault_addr)
     return 0;  // Restituisci un errore
 }
 
-    void
-    vm_tlbshootdown(const struct tlbshootdown *ts)
-    {
-        (void)ts;
-        panic("dumbvm tried to do tlb shootdown?!\n");
+/*
+ * Gestisce una richiesta di TLB shootdown ricevuta da un'altra CPU
+ * (chiamata da interprocessor_interrupt con le interruzioni disabilitate).
+ * Si invalidano le voci etichettate con l'ASID di ts_as, che possono essere
+ * presenti anche se ts_as non e' l'address space attivo su questa CPU.
+ */
+void vm_tlbshootdown(const struct tlbshootdown *ts)
+{
+    KASSERT(ts != NULL);
+    tlb_invalidate_range(ts->ts_as, ts->ts_start, ts->ts_npages);
+}
+
+/*
+ * Gestisce l'overflow della coda di shootdown di questa CPU: le richieste
+ * accodate sono state sostituite da un unico svuotamento dell'intera TLB.
+ */
+void vm_tlbshootdown_all(void)
+{
+    tlb_invalidate_all();
+}
+
+/*
+ * Fonde src in dst se riguardano lo stesso address space e intervalli
+ * sovrapposti o adiacenti, cosi' che una raffica di evict consecutive
+ * occupi un solo posto nella coda della CPU destinataria.
+ */
+int vm_tlbshootdown_merge(struct tlbshootdown *dst, const struct tlbshootdown *src)
+{
+    vaddr_t dst_end, src_end, start, end;
+
+    if (dst->ts_as != src->ts_as) {
+        return 0;
+    }
+    dst_end = dst->ts_start + dst->ts_npages * PAGE_SIZE;
+    src_end = src->ts_start + src->ts_npages * PAGE_SIZE;
+    if (src->ts_start > dst_end || dst->ts_start > src_end) {
+        return 0;
     }
+
+    start = dst->ts_start < src->ts_start ? dst->ts_start : src->ts_start;
+    end = dst_end > src_end ? dst_end : src_end;
+    dst->ts_start = start;
+    dst->ts_npages = (end - start) / PAGE_SIZE;
+    return 1;
+}
@@ -0,0 +1,288 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vm.h>
+
+#include <coremap.h>
+#include <statistics.h>
+#include <zswap.h>
+
+#define ZSWAP_WORDS (PAGE_SIZE / sizeof(uint32_t))  // Parole di 32 bit in una pagina
+#define ZSWAP_TAG_WORDS (ZSWAP_WORDS / 16)          // Tag di 2 bit per parola, 16 per uint32_t
+#define ZSWAP_MAX_ALLOC (PAGE_SIZE / 2)             // Blocco kmalloc piu' grande senza una pagina intera
+#define ZSWAP_LOW_BITS 10                           // Bit bassi salvati per una corrispondenza parziale
+
+// Codifica di una parola (tag di 2 bit)
+#define ZSWAP_TAG_ZERO    0   // Parola nulla
+#define ZSWAP_TAG_EXACT   1   // Uguale alla voce del dizionario (indice)
+#define ZSWAP_TAG_PARTIAL 2   // Stessi bit alti della voce del dizionario (indice e bit bassi)
+#define ZSWAP_TAG_FULL    3   // Parola copiata intera
+
+/*
+ * Pagina compressa, in un unico blocco kmalloc. I dati sono, in ordine: i
+ * tag (ZSWAP_TAG_WORDS parole), le nfull parole intere, i nlow valori a 16
+ * bit dei bit bassi e i nidx indici del dizionario, un byte ciascuno.
+ */
+struct zswap_entry {
+    off_t offset;                 // Slot dello swap della pagina
+    struct zswap_entry *next;     // Voce successiva nello stesso bucket
+    unsigned int size;            // Dimensione del blocco, intestazione compresa
+    uint16_t nfull, nlow, nidx;   // Lunghezza di ciascuna sequenza
+    uint32_t data[];
+};
+
+static struct spinlock zswap_lock = SPINLOCK_INITIALIZER;
+static struct zswap_entry *zswap_heads[ZSWAP_BUCKETS];
+static unsigned int zswap_percent = ZSWAP_PERCENT;
+static unsigned int zswap_bytes = 0;      // Memoria occupata dalle voci
+static unsigned int zswap_pages = 0;      // Pagine presenti nella cache
+static unsigned int zswap_rejected = 0;   // Pagine poco comprimibili, scritte su disco
+static int zswap_allocating = 0;          // 1 durante la kmalloc di una voce
+
+static unsigned int zswap_bucket(off_t offset) {
+    return (uint32_t)(offset / PAGE_SIZE) & (ZSWAP_BUCKETS - 1);
+}
+
+// Voce del dizionario per la parola w, scelta dai suoi bit alti
+static unsigned int zswap_dict_index(uint32_t w) {
+    return ((w >> ZSWAP_LOW_BITS) * 2654435761U >> 16) & (ZSWAP_DICT_SIZE - 1);
+}
+
+/*
+ * Comprime la pagina src. Con e == NULL conta soltanto le parole di ogni
+ * tipo (primo passaggio, per dimensionare il blocco); altrimenti scrive i
+ * dati in e, le cui lunghezze sono quelle contate dal primo passaggio.
+ */
+static void zswap_compress(const uint32_t *src, unsigned int *nfull, unsigned int *nlow,
+                           unsigned int *nidx, struct zswap_entry *e) {
+    uint32_t dict[ZSWAP_DICT_SIZE];
+    uint32_t *tags = NULL, *full = NULL;
+    uint16_t *low = NULL;
+    uint8_t *idx = NULL;
+    unsigned int i, h, tag;
+    uint32_t w;
+
+    bzero(dict, sizeof(dict));
+    *nfull = *nlow = *nidx = 0;
+    if (e != NULL) {
+        tags = e->data;
+        full = tags + ZSWAP_TAG_WORDS;
+        low = (uint16_t *)(full + e->nfull);
+        idx = (uint8_t *)(low + e->nlow);
+        bzero(tags, ZSWAP_TAG_WORDS * sizeof(uint32_t));
+    }
+
+    for (i = 0; i < ZSWAP_WORDS; i++) {
+        w = src[i];
+        h = zswap_dict_index(w);
+        if (w == 0) {
+            tag = ZSWAP_TAG_ZERO;
+        }
+        else if (dict[h] == w) {
+            tag = ZSWAP_TAG_EXACT;
+            if (e != NULL) {
+                idx[*nidx] = h;
+            }
+            (*nidx)++;
+        }
+        else if ((dict[h] >> ZSWAP_LOW_BITS) == (w >> ZSWAP_LOW_BITS)) {
+            tag = ZSWAP_TAG_PARTIAL;
+            if (e != NULL) {
+                idx[*nidx] = h;
+                low[*nlow] = w & ((1U << ZSWAP_LOW_BITS) - 1);
+            }
+            (*nidx)++;
+            (*nlow)++;
+            dict[h] = w;
+        }
+        else {
+            tag = ZSWAP_TAG_FULL;
+            if (e != NULL) {
+                full[*nfull] = w;
+            }
+            (*nfull)++;
+            dict[h] = w;
+        }
+        if (e != NULL) {
+            tags[i / 16] |= tag << ((i % 16) * 2);
+        }
+    }
+}
+
+// Ricostruisce in dst la pagina compressa in e
+static void zswap_decompress(const struct zswap_entry *e, uint32_t *dst) {
+    uint32_t dict[ZSWAP_DICT_SIZE];
+    const uint32_t *tags, *full;
+    const uint16_t *low;
+    const uint8_t *idx;
+    unsigned int i, h, nfull = 0, nlow = 0, nidx = 0;
+    uint32_t w;
+
+    bzero(dict, sizeof(dict));
+    tags = e->data;
+    full = tags + ZSWAP_TAG_WORDS;
+    low = (const uint16_t *)(full + e->nfull);
+    idx = (const uint8_t *)(low + e->nlow);
+
+    for (i = 0; i < ZSWAP_WORDS; i++) {
+        switch ((tags[i / 16] >> ((i % 16) * 2)) & 3) {
+            case ZSWAP_TAG_ZERO:
+                w = 0;
+                break;
+            case ZSWAP_TAG_EXACT:
+                w = dict[idx[nidx++]];
+                break;
+            case ZSWAP_TAG_PARTIAL:
+                h = idx[nidx++];
+                w = (dict[h] & ~((1U << ZSWAP_LOW_BITS) - 1)) | low[nlow++];
+                dict[h] = w;
+                break;
+            default:
+                w = full[nfull++];
+                dict[zswap_dict_index(w)] = w;
+                break;
+        }
+        dst[i] = w;
+    }
+    KASSERT(nfull == e->nfull && nlow == e->nlow && nidx == e->nidx);
+}
+
+// Stacca dalla tabella la voce dello slot offset e la restituisce (con zswap_lock)
+static struct zswap_entry *zswap_unlink(off_t offset) {
+    struct zswap_entry **link, *e;
+
+    for (link = &zswap_heads[zswap_bucket(offset)]; *link != NULL; link = &(*link)->next) {
+        e = *link;
+        if (e->offset == offset) {
+            *link = e->next;
+            zswap_bytes -= e->size;
+            zswap_pages--;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+void zswap_invalidate(off_t offset) {
+    struct zswap_entry *e;
+
+    spinlock_acquire(&zswap_lock);
+    e = zswap_unlink(offset);
+    spinlock_release(&zswap_lock);
+    if (e != NULL) {
+        kfree(e);
+    }
+}
+
+/*
+ * La kmalloc di una voce puo' a sua volta richiedere un frame e quindi uno
+ * swap-out: zswap_allocating fa scrivere su disco le pagine di quegli
+ * swap-out (e quelle delle altre CPU nel frattempo), invece di rientrare
+ * nella kmalloc senza limite.
+ */
+int zswap_store(paddr_t pa, off_t offset) {
+    const uint32_t *src;
+    struct zswap_entry *e;
+    unsigned int nfull, nlow, nidx, size, limit;
+
+    KASSERT(offset >= 0 && (pa & PAGE_FRAME) == pa);
+
+    // Lo slot sta per ricevere un nuovo contenuto
+    zswap_invalidate(offset);
+    if (zswap_percent == 0) {
+        return 0;
+    }
+
+    src = (const uint32_t *)PADDR_TO_KVADDR(pa);
+    zswap_compress(src, &nfull, &nlow, &nidx, NULL);
+    size = sizeof(struct zswap_entry) + (ZSWAP_TAG_WORDS + nfull) * sizeof(uint32_t) +
+           nlow * sizeof(uint16_t) + nidx;
+    if (size > ZSWAP_MAX_ALLOC) {
+        spinlock_acquire(&zswap_lock);
+        zswap_rejected++;
+        spinlock_release(&zswap_lock);
+        return 0;
+    }
+
+    // La memoria viene riservata prima della kmalloc, per rispettare il limite
+    limit = coremap_total_frames() * zswap_percent / 100 * PAGE_SIZE;
+    spinlock_acquire(&zswap_lock);
+    if (zswap_allocating || zswap_bytes + size > limit) {
+        spinlock_release(&zswap_lock);
+        return 0;
+    }
+    zswap_allocating = 1;
+    zswap_bytes += size;
+    spinlock_release(&zswap_lock);
+
+    e = kmalloc(size);
+
+    spinlock_acquire(&zswap_lock);
+    zswap_allocating = 0;
+    if (e == NULL) {
+        zswap_bytes -= size;
+    }
+    spinlock_release(&zswap_lock);
+    if (e == NULL) {
+        return 0;
+    }
+
+    e->offset = offset;
+    e->size = size;
+    e->nfull = nfull;
+    e->nlow = nlow;
+    e->nidx = nidx;
+    zswap_compress(src, &nfull, &nlow, &nidx, e);
+
+    spinlock_acquire(&zswap_lock);
+    e->next = zswap_heads[zswap_bucket(offset)];
+    zswap_heads[zswap_bucket(offset)] = e;
+    zswap_pages++;
+    spinlock_release(&zswap_lock);
+
+    increment_statistics(STATISTICS_ZSWAP_STORE);
+    add_statistics(STATISTICS_ZSWAP_BYTES, size);
+    return 1;
+}
+
+/*
+ * Il chiamante possiede un riferimento allo slot, la cui voce viene scartata
+ * solo con l'ultimo riferimento (swap_free) o riscritta da uno swap-out, che
+ * non riusa uno slot condiviso: nessun altro thread puo' liberarla, per cui
+ * viene decompressa fuori dal lock.
+ */
+int zswap_load(paddr_t pa, off_t offset) {
+    struct zswap_entry *e;
+
+    KASSERT(offset >= 0 && (pa & PAGE_FRAME) == pa);
+
+    spinlock_acquire(&zswap_lock);
+    for (e = zswap_heads[zswap_bucket(offset)]; e != NULL && e->offset != offset; e = e->next);
+    spinlock_release(&zswap_lock);
+    if (e == NULL) {
+        return 0;
+    }
+
+    zswap_decompress(e, (uint32_t *)PADDR_TO_KVADDR(pa));
+    return 1;
+}
+
+int zswap_set_percent(unsigned int percent) {
+    if (percent > 100) {
+        return EINVAL;
+    }
+    zswap_percent = percent;
+    return 0;
+}
+
+unsigned int zswap_get_percent(void) {
+    return zswap_percent;
+}
+
+void zswap_print_statistics(void) {
+    kprintf("ZSWAP STATISTICS (%u%% of RAM):\n", zswap_percent);
+    kprintf("%25s = %10u\n", "Compressed Pages", zswap_pages);
+    kprintf("%25s = %10u\n", "Compressed Memory", zswap_bytes);
+    kprintf("%25s = %10u\n", "Incompressible Pages", zswap_rejected);
+}